@@ -10,7 +10,21 @@
 
 #include <vector>
 #include <map>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstring>
 #include <Eigen/Core>
+#include <Eigen/Geometry>
+#include "Object.h"
+#include "Parallel.h"
+#include "MappedFile.h"
+#include "CompressedMesh.h"
 
 class Mesh
 {
@@ -19,13 +33,13 @@ class Mesh
     std::vector<Eigen::Vector3f> normalV;
 
 public:
-    void reedOBJ(std::string const& filename)
+    bool reedOBJ(std::string const& filename)
     {
         std::ifstream ifs(filename);
         if (ifs.fail())
         {
             std::cerr << "Failed to open file." << "\n";
-            std::exit(1);
+            return false;
         }
         std::string line;
         while (std::getline(ifs, line)){
@@ -49,16 +63,269 @@ public:
             }
             else if (line[0] == 'f')
             {
+                // only the vertex index of each "v", "v/vt", "v//vn" or "v/vt/vn" is used
                 Eigen::Vector3i f;
-                std::replace(line.begin(), line.end(), '/', ' ');
                 std::istringstream string_in{line.substr(1)};
-                string_in >> f(0) >> f(0) >> f(1) >> f(1) >> f(2) >> f(2);
+                std::string token;
+                for (int j = 0; j < 3 && string_in >> token; j++)
+                {
+                    f(j) = std::atoi(token.c_str());
+                }
                 f -= Eigen::Vector3i{1, 1, 1};
                 F.push_back(f);
             }
         }
 
-        normalizeMesh();
+        if (normalV.size() != V.size())
+        {
+            compute_normals();
+        }
+        return normalizeMesh();
+    }
+
+    // reads binary little/big-endian PLY with float or double xyz, optional normals and list faces
+    bool readPLY(std::string const& filename)
+    {
+        MappedFile file(filename.c_str());
+        if (!file)
+        {
+            return false;
+        }
+        char const* const text = reinterpret_cast<char const*>(file.data());
+        std::size_t const limit = std::min<std::size_t>(file.size(), 1 << 16);
+        std::string const head(text, limit);
+        std::size_t const headerEnd = head.find("end_header\n");
+        if (head.compare(0, 4, "ply\n") != 0 || headerEnd == std::string::npos)
+        {
+            std::cerr << "Not a PLY file." << "\n";
+            return false;
+        }
+
+        // parse the header
+        std::vector<PLYElement> elements;
+        bool swap = false;
+        std::istringstream header(head.substr(0, headerEnd));
+        std::string line;
+        while (std::getline(header, line))
+        {
+            std::istringstream string_in{line};
+            std::string keyword;
+            string_in >> keyword;
+            if (keyword == "format")
+            {
+                std::string format;
+                string_in >> format;
+                if (format == "ascii")
+                {
+                    std::cerr << "ASCII PLY is not supported." << "\n";
+                    return false;
+                }
+                bool const little = format == "binary_little_endian";
+                swap = little != (std::endian::native == std::endian::little);
+            }
+            else if (keyword == "element")
+            {
+                PLYElement e;
+                string_in >> e.name >> e.count;
+                elements.push_back(e);
+            }
+            else if (keyword == "property" && !elements.empty())
+            {
+                PLYProperty p;
+                std::string type;
+                string_in >> type;
+                p.list = type == "list";
+                if (p.list)
+                {
+                    std::string countType;
+                    string_in >> countType >> type;
+                    p.countType = ply_type(countType);
+                }
+                p.type = ply_type(type);
+                string_in >> p.name;
+                if (p.type.size == 0 || (p.list && p.countType.size == 0))
+                {
+                    std::cerr << "Unknown PLY property type: " << line << "\n";
+                    return false;
+                }
+                elements.back().properties.push_back(p);
+            }
+        }
+
+        std::uint8_t const* data = file.data() + headerEnd + 11;
+        std::uint8_t const* const end = file.data() + file.size();
+        for (auto const& e : elements)
+        {
+            std::size_t const stride = e.stride();
+            if (e.name == "vertex")
+            {
+                if (stride == 0 || !ply_fits(data, end, e.count, stride))
+                {
+                    std::cerr << "Broken PLY vertex element." << "\n";
+                    return false;
+                }
+                if (!read_ply_vertices(e, data, swap))
+                {
+                    return false;
+                }
+                data += e.count * stride;
+            }
+            else if (e.name == "face")
+            {
+                data = read_ply_faces(e, data, end, swap);
+                if (data == nullptr)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                data = skip_ply_element(e, data, end, swap);
+            }
+        }
+
+        // faces may come before the vertices, so the indices are checked once everything is read
+        if (V.empty())
+        {
+            std::cerr << "PLY file has no vertices." << "\n";
+            return false;
+        }
+        for (auto const& f : F)
+        {
+            if (f.minCoeff() < 0 || (std::size_t)f.maxCoeff() >= V.size())
+            {
+                std::cerr << "PLY face index out of range." << "\n";
+                return false;
+            }
+        }
+
+        if (normalV.size() != V.size())
+        {
+            compute_normals();
+        }
+        return normalizeMesh();
+    }
+
+    // reads binary STL; coincident corners are welded into shared vertices
+    bool readSTL(std::string const& filename)
+    {
+        MappedFile file(filename.c_str());
+        if (!file)
+        {
+            return false;
+        }
+        if (file.size() < 84)
+        {
+            std::cerr << "Not a binary STL file." << "\n";
+            return false;
+        }
+        std::uint32_t count;
+        std::memcpy(&count, file.data() + 80, sizeof count);
+        if (84 + (std::size_t)count * 50 != file.size())
+        {
+            std::cerr << "ASCII or broken STL is not supported." << "\n";
+            return false;
+        }
+        if (count == 0)
+        {
+            std::cerr << "STL file has no triangles." << "\n";
+            return false;
+        }
+
+        // copy the corners straight out of the 50-byte records
+        std::size_t const corners = (std::size_t)count * 3;
+        std::vector<Eigen::Vector3f> P(corners);
+        std::uint8_t const* const records = file.data() + 84;
+        parallelFor(0, count, [&](std::size_t first, std::size_t last)
+        {
+            for (std::size_t t = first; t < last; t++)
+            {
+                std::memcpy(P[3*t].data(), records + t * 50 + 12, 36);
+            }
+        });
+
+        // weld identical positions by sorting the corners by their bit patterns
+        std::vector<std::uint32_t> order(corners);
+        for (std::size_t i = 0; i < corners; i++)
+        {
+            order[i] = (std::uint32_t)i;
+        }
+        std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+        {
+            int const c = std::memcmp(P[a].data(), P[b].data(), 12);
+            return c < 0 || (c == 0 && a < b);
+        });
+        std::vector<int> index(corners);
+        V.clear();
+        V.reserve(corners / 6 + 1);
+        for (std::size_t i = 0; i < corners; i++)
+        {
+            if (i == 0 || std::memcmp(P[order[i]].data(), P[order[i-1]].data(), 12) != 0)
+            {
+                V.push_back(P[order[i]]);
+            }
+            index[order[i]] = (int)V.size() - 1;
+        }
+        std::vector<Eigen::Vector3f>().swap(P);
+
+        F.resize(count);
+        std::memcpy(F.data()->data(), index.data(), corners * sizeof(int));
+
+        compute_normals();
+        return normalizeMesh();
+    }
+
+    // a compressed mesh is stored normalized, so only the normals may need to be rebuilt
+    bool readMeshz(std::string const& filename)
+    {
+        if (!CompressedMesh::read(filename.c_str(), V, F, normalV))
+        {
+            return false;
+        }
+        if (normalV.size() != V.size())
+        {
+            compute_normals();
+            for (auto& vn : normalV)
+            {
+                vn.normalize();
+            }
+        }
+        return true;
+    }
+
+    // picks the reader from the extension; on failure the error is printed and the mesh is left empty
+    bool readMesh(std::string const& filename)
+    {
+        std::string ext = filename.substr(filename.find_last_of('.') + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        bool ok;
+        if (ext == "ply")
+        {
+            ok = readPLY(filename);
+        }
+        else if (ext == "stl")
+        {
+            ok = readSTL(filename);
+        }
+        else if (ext == "meshz")
+        {
+            ok = readMeshz(filename);
+        }
+        else
+        {
+            ok = reedOBJ(filename);
+        }
+        if (!ok)
+        {
+            release();
+            return false;
+        }
+
+        // drop the slack left by push_back growth
+        V.shrink_to_fit();
+        F.shrink_to_fit();
+        normalV.shrink_to_fit();
+        return true;
     }
 
     GLuint getVertexSize()
@@ -71,6 +338,21 @@ public:
         return (GLuint)F.size() * 3;
     }
 
+    std::vector<Eigen::Vector3f> const& getVertices() const
+    {
+        return V;
+    }
+
+    std::vector<Eigen::Vector3f> const& getNormals() const
+    {
+        return normalV;
+    }
+
+    std::vector<Eigen::Vector3i> const& getFaces() const
+    {
+        return F;
+    }
+
     void convertMeshData(Object::Vertex *Vertices, GLuint *Indices)
     {
         for (int i = 0; i < V.size(); i++)
@@ -87,28 +369,157 @@ public:
         }
     }
 
+    // converts vertices [first, first + count) to the GPU layout, so a large mesh can be
+    // uploaded through a small staging buffer instead of a full interleaved copy
+    void convertMeshData(Object::Vertex *Vertices, std::size_t first, std::size_t count) const
+    {
+        parallelFor(0, count, [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                Eigen::Vector3f const& v = V[first + i];
+                Eigen::Vector3f const& n = normalV[first + i];
+                Vertices[i] = {v(0), v(1), v(2), n(0), n(1), n(2)};
+            }
+        });
+    }
+
+    // F is already three packed ints per face, which is exactly the index buffer layout
+    GLuint const* getIndices() const
+    {
+        static_assert(sizeof(Eigen::Vector3i) == 3 * sizeof(GLuint), "faces must be tightly packed");
+        return reinterpret_cast<GLuint const*>(F.data()->data());
+    }
+
+    // bytes held by the CPU-side geometry
+    std::size_t memoryBytes() const
+    {
+        return (V.capacity() + normalV.capacity()) * sizeof(Eigen::Vector3f) + F.capacity() * sizeof(Eigen::Vector3i);
+    }
+
+    // frees the CPU-side geometry once it lives on the GPU
+    void release()
+    {
+        std::vector<Eigen::Vector3f>().swap(V);
+        std::vector<Eigen::Vector3f>().swap(normalV);
+        std::vector<Eigen::Vector3i>().swap(F);
+    }
+
     void exportOBJ(std::string name)
     {
-        std::ofstream of;
         name.erase(name.length()-4);
         std::string filename = name + "_normalized.obj";
-        of.open(filename, std::ios::out);
-        for(auto& v : V)
+        std::ofstream of(filename, std::ios::out | std::ios::binary);
+        auto start = std::chrono::steady_clock::now();
+
+        // "v x y z\n" and "f a//a b//b c//c\n" are formatted in parallel with to_chars
+        std::size_t bytes = write_chunks(of, V.size(), 64, [&](std::size_t i, char* p, char* end)
         {
-            of << "v " << v(0) << " " << v(1) << " " << v(2) << std::endl;
-        }
-        for (auto& vn : normalV)
+            return write_vector(p, end, "v ", V[i]);
+        });
+        bytes += write_chunks(of, normalV.size(), 64, [&](std::size_t i, char* p, char* end)
         {
-            of << "vn " << vn(0) << " " << vn(1) << " " << vn(2) << std::endl;
-        }
-        for(auto& f : F)
+            return write_vector(p, end, "vn ", normalV[i]);
+        });
+        bool const hasNormal = !normalV.empty();
+        bytes += write_chunks(of, F.size(), 72, [&](std::size_t i, char* p, char* end)
+        {
+            *p++ = 'f';
+            for (int j = 0; j < 3; j++)
+            {
+                *p++ = ' ';
+                p = std::to_chars(p, end, F[i](j)+1).ptr;
+                if (hasNormal)
+                {
+                    *p++ = '/';
+                    *p++ = '/';
+                    p = std::to_chars(p, end, F[i](j)+1).ptr;
+                }
+            }
+            *p++ = '\n';
+            return p;
+        });
+        of.close();
+        report_throughput("OBJ", filename, bytes, start);
+    }
+
+    void exportPLY(std::string name)
+    {
+        name.erase(name.length()-4);
+        std::string filename = name + "_normalized.ply";
+        std::ofstream of(filename, std::ios::out | std::ios::binary);
+        auto start = std::chrono::steady_clock::now();
+
+        // records are copied in host order, so the header declares the host's byte order
+        bool const hasNormal = normalV.size() == V.size();
+        std::ostringstream header;
+        header << "ply\n"
+        << "format " << (std::endian::native == std::endian::little ? "binary_little_endian" : "binary_big_endian") << " 1.0\n"
+        << "element vertex " << V.size() << "\n"
+        << "property float x\nproperty float y\nproperty float z\n";
+        if (hasNormal)
         {
-            of << "f "
-            << f(0)+1 << "//" << f(0)+1 << " "
-            << f(1)+1 << "//" << f(1)+1 << " "
-            << f(2)+1 << "//" << f(2)+1 << std::endl;
+            header << "property float nx\nproperty float ny\nproperty float nz\n";
         }
+        header << "element face " << F.size() << "\n"
+        << "property list uchar int vertex_indices\n"
+        << "end_header\n";
+        std::string const h = header.str();
+        of.write(h.data(), h.size());
+        std::size_t bytes = h.size();
+
+        // vertex records have the same layout as Object::Vertex when normals are present
+        std::size_t const vertexSize = hasNormal ? 6 * sizeof(float) : 3 * sizeof(float);
+        bytes += write_chunks(of, V.size(), vertexSize, [&](std::size_t i, char* p, char*)
+        {
+            std::memcpy(p, V[i].data(), 3 * sizeof(float));
+            if (hasNormal)
+            {
+                std::memcpy(p + 3 * sizeof(float), normalV[i].data(), 3 * sizeof(float));
+            }
+            return p + vertexSize;
+        });
+        bytes += write_chunks(of, F.size(), 13, [&](std::size_t i, char* p, char*)
+        {
+            *p = 3;
+            std::memcpy(p + 1, F[i].data(), 3 * sizeof(int));
+            return p + 13;
+        });
+        of.close();
+        report_throughput("PLY", filename, bytes, start);
+    }
+
+    // binary STL is little-endian by definition and the records are copied in host order
+    void exportSTL(std::string name)
+    {
+        static_assert(std::endian::native == std::endian::little, "exportSTL writes host-order floats");
+        name.erase(name.length()-4);
+        std::string filename = name + "_normalized.stl";
+        std::ofstream of(filename, std::ios::out | std::ios::binary);
+        auto start = std::chrono::steady_clock::now();
+
+        char header[80] = "binary STL exported by OpenGL_test";
+        std::uint32_t const count = (std::uint32_t)F.size();
+        of.write(header, sizeof header);
+        of.write(reinterpret_cast<char const*>(&count), sizeof count);
+        std::size_t bytes = sizeof header + sizeof count;
+
+        // normal, three vertices and a 16-bit attribute per triangle
+        bytes += write_chunks(of, F.size(), 50, [&](std::size_t i, char* p, char*)
+        {
+            Eigen::Vector3f const& a = V[F[i](0)];
+            Eigen::Vector3f const& b = V[F[i](1)];
+            Eigen::Vector3f const& c = V[F[i](2)];
+            Eigen::Vector3f const n = (b - a).cross(c - a).normalized();
+            std::memcpy(p, n.data(), 12);
+            std::memcpy(p + 12, a.data(), 12);
+            std::memcpy(p + 24, b.data(), 12);
+            std::memcpy(p + 36, c.data(), 12);
+            std::memset(p + 48, 0, 2);
+            return p + 50;
+        });
         of.close();
+        report_throughput("STL", filename, bytes, start);
     }
 
 private:
@@ -138,11 +549,12 @@ private:
         return s;
     }
 
+    // V must hold at least two distinct positions
     Sphere min_bounding_sphere()
     {
         Sphere s;
-        Eigen::Vector3f initial_pa;
-        Eigen::Vector3f initial_pb;
+        Eigen::Vector3f initial_pa = V[1];
+        Eigen::Vector3f initial_pb = V[0];
 
         // initial sphere
         float max_dist = (V[1] - V[0]).norm();
@@ -177,8 +589,361 @@ private:
         return s;
     }
 
-    void normalizeMesh()
+    struct PLYType
+    {
+        char kind;      // 'i', 'u' or 'f'
+        int size;       // bytes, 0 if unknown
+    };
+
+    struct PLYProperty
+    {
+        std::string name;
+        PLYType type;
+        bool list;
+        PLYType countType;
+    };
+
+    struct PLYElement
+    {
+        std::string name;
+        std::size_t count;
+        std::vector<PLYProperty> properties;
+
+        // record size, or 0 if the element has list properties
+        std::size_t stride() const
+        {
+            std::size_t size = 0;
+            for (auto const& p : properties)
+            {
+                if (p.list)
+                {
+                    return 0;
+                }
+                size += p.type.size;
+            }
+            return size;
+        }
+    };
+
+    static PLYType ply_type(std::string const& name)
+    {
+        if (name == "char" || name == "int8") return {'i', 1};
+        if (name == "uchar" || name == "uint8") return {'u', 1};
+        if (name == "short" || name == "int16") return {'i', 2};
+        if (name == "ushort" || name == "uint16") return {'u', 2};
+        if (name == "int" || name == "int32") return {'i', 4};
+        if (name == "uint" || name == "uint32") return {'u', 4};
+        if (name == "float" || name == "float32") return {'f', 4};
+        if (name == "double" || name == "float64") return {'f', 8};
+        return {'?', 0};
+    }
+
+    static double ply_value(std::uint8_t const* p, PLYType const& t, bool swap)
+    {
+        std::uint8_t b[8];
+        std::memcpy(b, p, t.size);
+        if (swap)
+        {
+            std::reverse(b, b + t.size);
+        }
+        switch (t.kind * 16 + t.size)
+        {
+            case 'i' * 16 + 1: { std::int8_t v; std::memcpy(&v, b, 1); return v; }
+            case 'u' * 16 + 1: { std::uint8_t v; std::memcpy(&v, b, 1); return v; }
+            case 'i' * 16 + 2: { std::int16_t v; std::memcpy(&v, b, 2); return v; }
+            case 'u' * 16 + 2: { std::uint16_t v; std::memcpy(&v, b, 2); return v; }
+            case 'i' * 16 + 4: { std::int32_t v; std::memcpy(&v, b, 4); return v; }
+            case 'u' * 16 + 4: { std::uint32_t v; std::memcpy(&v, b, 4); return v; }
+            case 'f' * 16 + 4: { float v; std::memcpy(&v, b, 4); return v; }
+            default: { double v; std::memcpy(&v, b, 8); return v; }
+        }
+    }
+
+    bool read_ply_vertices(PLYElement const& e, std::uint8_t const* data, bool swap)
+    {
+        static char const* const names[6] = {"x", "y", "z", "nx", "ny", "nz"};
+        int offset[6] = {-1, -1, -1, -1, -1, -1};
+        bool allFloat = true;
+        int position = 0;
+        for (auto const& p : e.properties)
+        {
+            for (int j = 0; j < 6; j++)
+            {
+                if (p.name == names[j])
+                {
+                    offset[j] = position;
+                    allFloat = allFloat && p.type.kind == 'f' && p.type.size == 4;
+                }
+            }
+            position += p.type.size;
+        }
+        if (offset[0] < 0 || offset[1] < 0 || offset[2] < 0)
+        {
+            std::cerr << "PLY vertex element has no position." << "\n";
+            return false;
+        }
+        bool const hasNormal = offset[3] >= 0 && offset[4] >= 0 && offset[5] >= 0;
+        std::size_t const stride = e.stride();
+        V.resize(e.count);
+        normalV.resize(hasNormal ? e.count : 0);
+
+        bool const packed = !swap && allFloat && offset[0] == 0 && offset[1] == 4 && offset[2] == 8;
+        if (packed && stride == 12)
+        {
+            // float x, y, z only: the whole block is the position array
+            std::memcpy(V.data()->data(), data, e.count * 12);
+        }
+        else if (packed && hasNormal && stride == sizeof(Object::Vertex)
+                 && offset[3] == 12 && offset[4] == 16 && offset[5] == 20)
+        {
+            // the Object::Vertex layout: split it into the position and normal arrays
+            parallelFor(0, e.count, [&](std::size_t first, std::size_t last)
+            {
+                for (std::size_t i = first; i < last; i++)
+                {
+                    std::memcpy(V[i].data(), data + i * stride, 12);
+                    std::memcpy(normalV[i].data(), data + i * stride + 12, 12);
+                }
+            });
+        }
+        else
+        {
+            // any other layout goes through the per-property conversion
+            PLYType types[6];
+            for (auto const& p : e.properties)
+            {
+                for (int j = 0; j < 6; j++)
+                {
+                    if (p.name == names[j])
+                    {
+                        types[j] = p.type;
+                    }
+                }
+            }
+            parallelFor(0, e.count, [&](std::size_t first, std::size_t last)
+            {
+                for (std::size_t i = first; i < last; i++)
+                {
+                    std::uint8_t const* const r = data + i * stride;
+                    for (int j = 0; j < 3; j++)
+                    {
+                        V[i](j) = (float)ply_value(r + offset[j], types[j], swap);
+                        if (hasNormal)
+                        {
+                            normalV[i](j) = (float)ply_value(r + offset[j+3], types[j+3], swap);
+                        }
+                    }
+                }
+            });
+        }
+        return true;
+    }
+
+    std::uint8_t const* read_ply_faces(PLYElement const& e, std::uint8_t const* data, std::uint8_t const* end, bool swap)
+    {
+        // the common layout is a single "uchar/int count, int/uint indices" list of triangles
+        PLYProperty const* list = nullptr;
+        for (auto const& p : e.properties)
+        {
+            if (p.list && (p.name == "vertex_indices" || p.name == "vertex_index"))
+            {
+                list = &p;
+            }
+        }
+        if (list == nullptr)
+        {
+            return skip_ply_element(e, data, end, swap);
+        }
+
+        if (e.properties.size() == 1 && !swap && list->type.kind != 'f' && list->type.size == 4)
+        {
+            std::size_t const countSize = list->countType.size;
+            std::size_t const stride = countSize + 12;
+            bool triangles = ply_fits(data, end, e.count, stride);
+            for (std::size_t i = 0; triangles && i < e.count; i++)
+            {
+                triangles = ply_value(data + i * stride, list->countType, false) == 3;
+            }
+            if (triangles)
+            {
+                // fixed-size records: copy the three indices of each face
+                F.resize(e.count);
+                parallelFor(0, e.count, [&](std::size_t first, std::size_t last)
+                {
+                    for (std::size_t i = first; i < last; i++)
+                    {
+                        std::memcpy(F[i].data(), data + i * stride + countSize, 12);
+                    }
+                });
+                return data + e.count * stride;
+            }
+        }
+
+        // general records: polygons are split into fans
+        // a face takes at least a few bytes, so a bogus count cannot reserve more than the file could hold
+        F.reserve(std::min<std::size_t>(e.count, (std::size_t)(end - std::min(data, end)) / 4));
+        for (std::size_t i = 0; i < e.count; i++)
+        {
+            for (auto const& p : e.properties)
+            {
+                if (!ply_fits(data, end, 1, p.list ? p.countType.size : p.type.size))
+                {
+                    std::cerr << "Broken PLY face element." << "\n";
+                    return nullptr;
+                }
+                if (!p.list)
+                {
+                    data += p.type.size;
+                    continue;
+                }
+                double const count = ply_value(data, p.countType, swap);
+                data += p.countType.size;
+                if (count < 0.0 || count > (double)(end - data) || !ply_fits(data, end, (std::size_t)count, p.type.size))
+                {
+                    std::cerr << "Broken PLY face element." << "\n";
+                    return nullptr;
+                }
+                int const n = (int)count;
+                if (&p == list)
+                {
+                    int const v0 = (int)ply_value(data, p.type, swap);
+                    for (int k = 2; k < n; k++)
+                    {
+                        F.emplace_back(v0, (int)ply_value(data + (k-1) * p.type.size, p.type, swap),
+                                       (int)ply_value(data + k * p.type.size, p.type, swap));
+                    }
+                }
+                data += (std::size_t)n * p.type.size;
+            }
+        }
+        return data;
+    }
+
+    // true if count records of size bytes starting at data end at or before end (without overflowing)
+    static bool ply_fits(std::uint8_t const* data, std::uint8_t const* end, std::size_t count, std::size_t size)
+    {
+        return data <= end && (size == 0 || count <= (std::size_t)(end - data) / size);
+    }
+
+    // skips an element; a truncated element leaves data at end, so the elements after it are empty
+    static std::uint8_t const* skip_ply_element(PLYElement const& e, std::uint8_t const* data, std::uint8_t const* end, bool swap)
+    {
+        std::size_t const stride = e.stride();
+        if (stride > 0)
+        {
+            return ply_fits(data, end, e.count, stride) ? data + e.count * stride : end;
+        }
+        for (std::size_t i = 0; i < e.count && data < end; i++)
+        {
+            for (auto const& p : e.properties)
+            {
+                std::size_t const size = p.list ? p.countType.size : p.type.size;
+                if (!ply_fits(data, end, 1, size))
+                {
+                    return end;
+                }
+                if (p.list)
+                {
+                    double const n = ply_value(data, p.countType, swap);
+                    data += p.countType.size;
+                    if (n < 0.0 || n > (double)(end - data) || !ply_fits(data, end, (std::size_t)n, p.type.size))
+                    {
+                        return end;
+                    }
+                    data += (std::size_t)n * p.type.size;
+                }
+                else
+                {
+                    data += p.type.size;
+                }
+            }
+        }
+        return data;
+    }
+
+    // area-weighted vertex normals for files that do not carry them
+    void compute_normals()
+    {
+        normalV.assign(V.size(), Eigen::Vector3f::Zero());
+        for (auto const& f : F)
+        {
+            Eigen::Vector3f const n = (V[f(1)] - V[f(0)]).cross(V[f(2)] - V[f(0)]);
+            normalV[f(0)] += n;
+            normalV[f(1)] += n;
+            normalV[f(2)] += n;
+        }
+    }
+
+    // formats count elements in parallel, chunk by chunk, and writes the chunks in order
+    // maxLength : upper bound of the bytes written for one element
+    // format(i, p, end) writes element i at p and returns the end of what it wrote
+    template <typename Format>
+    static std::size_t write_chunks(std::ofstream& of, std::size_t count, std::size_t maxLength, Format format)
+    {
+        std::size_t const chunk = 1 << 16;
+        std::size_t const wave = threadCount() * 2;
+        std::vector<std::vector<char>> buffers(wave);
+        std::vector<std::size_t> lengths(wave);
+        std::size_t written = 0;
+        for (std::size_t first = 0; first < count; first += chunk * wave)
+        {
+            std::size_t const chunks = std::min(wave, (count - first + chunk - 1) / chunk);
+            parallelFor(0, chunks, [&](std::size_t b, std::size_t e)
+            {
+                for (std::size_t c = b; c < e; c++)
+                {
+                    std::size_t const lo = first + c * chunk;
+                    std::size_t const hi = std::min(count, lo + chunk);
+                    buffers[c].resize((hi - lo) * maxLength);
+                    char* const begin = buffers[c].data();
+                    char* const end = begin + buffers[c].size();
+                    char* p = begin;
+                    for (std::size_t i = lo; i < hi; i++)
+                    {
+                        p = format(i, p, end);
+                    }
+                    lengths[c] = p - begin;
+                }
+            });
+            for (std::size_t c = 0; c < chunks; c++)
+            {
+                of.write(buffers[c].data(), lengths[c]);
+                written += lengths[c];
+            }
+        }
+        return written;
+    }
+
+    static char* write_vector(char* p, char* end, char const* tag, Eigen::Vector3f const& v)
     {
+        while (*tag != '\0')
+        {
+            *p++ = *tag++;
+        }
+        for (int j = 0; j < 3; j++)
+        {
+            p = std::to_chars(p, end, v(j)).ptr;
+            *p++ = j < 2 ? ' ' : '\n';
+        }
+        return p;
+    }
+
+    static void report_throughput(char const* format, std::string const& filename, std::size_t bytes,
+                                  std::chrono::steady_clock::time_point start)
+    {
+        double const sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << format << ": " << filename << " " << bytes / 1.0e6 << " MB in " << sec << " s ("
+        << bytes / 1.0e6 / sec << " MB/s)\n";
+    }
+
+    // fits the mesh into the unit sphere; a mesh without extent can't be scaled and is rejected
+    bool normalizeMesh()
+    {
+        if (std::find_if(V.begin(), V.end(), [&](Eigen::Vector3f const& v) { return v != V[0]; }) == V.end())
+        {
+            std::cerr << "Mesh needs at least two distinct vertices." << "\n";
+            return false;
+        }
         Sphere s = min_bounding_sphere();
         for (auto& v : V)
         {
@@ -189,6 +954,7 @@ private:
         {
             vn.normalize();
         }
+        return true;
     }
 };
 
@@ -0,0 +1,218 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include "BVH.h"
+#include "JobSystem.h"
+
+// 頂点ごとの環境遮蔽 (ambient occlusion) を CPU で求める
+//
+// 各頂点から法線の周りの半球にコサイン分布の光線を飛ばし，radius までに遮られなかった割合を求める．
+// 同じ頂点から出る光線を 4 本ずつまとめて BVH をたどり，頂点の範囲をワークスティーリングで分担する
+class AmbientOcclusion {
+public:
+
+    // 計測結果
+    struct Stats {
+        // 処理にかかった時間 (秒)
+        double seconds;
+
+        // 飛ばした光線の数
+        std::uint64_t rays;
+
+        // 使ったスレッドの数
+        unsigned int threads;
+
+        // 一秒あたりの光線の数
+        double raysPerSecond() const { return seconds > 0.0 ? rays / seconds : 0.0; }
+    };
+
+private:
+
+    // 交差判定に使う BVH
+    const BVH &bvh;
+
+    // 頂点の位置と法線
+    const std::vector<Eigen::Vector3f> &V;
+    const std::vector<Eigen::Vector3f> &N;
+
+    // 頂点あたりの光線の数 (4 の倍数)
+    const int samples;
+
+    // 遮蔽を調べる距離
+    const float radius;
+
+    // 自己交差を避けるために始点を法線方向にずらす量
+    const float offset;
+
+    // 単位円板上の標本点 (Hammersley 点列を同心円写像したもの)
+    std::vector<float> diskX, diskY;
+
+    // キャッシュファイルの識別子
+    static constexpr char signature[8] = { 'G', 'L', 'A', 'O', '0', '0', '0', '1' };
+
+    // キャッシュファイルのヘッダ
+    struct Header {
+        char magic[8];
+        std::uint32_t vertexCount;
+        std::uint32_t samples;
+        float radius;
+        std::uint32_t reserved;
+        std::uint64_t hash;
+    };
+
+public:
+
+    // コンストラクタ
+    // bvh : メッシュの BVH
+    // V : 頂点の位置
+    // N : 頂点の法線
+    // samples : 頂点あたりの光線の数 (4 の倍数に切り上げる)
+    // radius : 遮蔽を調べる距離
+    AmbientOcclusion(const BVH &bvh, const std::vector<Eigen::Vector3f> &V, const std::vector<Eigen::Vector3f> &N,
+                     int samples = 64, float radius = 0.5f)
+    : bvh(bvh)
+    , V(V)
+    , N(N)
+    , samples((std::max(samples, 4) + 3) & ~3)
+    , radius(radius)
+    , offset(radius * 1e-4f)
+    {
+        // Hammersley 点列 (i / n, 基数 2 の逆順) を単位円板に写す
+        diskX.resize(this->samples);
+        diskY.resize(this->samples);
+        for (int i = 0; i < this->samples; ++i) {
+            std::uint32_t b(static_cast<std::uint32_t>(i));
+            b = (b << 16) | (b >> 16);
+            b = ((b & 0x55555555u) << 1) | ((b & 0xaaaaaaaau) >> 1);
+            b = ((b & 0x33333333u) << 2) | ((b & 0xccccccccu) >> 2);
+            b = ((b & 0x0f0f0f0fu) << 4) | ((b & 0xf0f0f0f0u) >> 4);
+            b = ((b & 0x00ff00ffu) << 8) | ((b & 0xff00ff00u) >> 8);
+            const float u((i + 0.5f) / this->samples), v(b * 2.3283064365386963e-10f);
+            const float r(std::sqrt(u)), phi(6.2831853f * v);
+            diskX[i] = r * std::cos(phi);
+            diskY[i] = r * std::sin(phi);
+        }
+    }
+
+private:
+
+    // 頂点 i の遮られなかった割合を求める
+    float evaluate(std::size_t i) const{
+        const Eigen::Vector3f &p(V[i]);
+        const Eigen::Vector3f &n(N[i]);
+
+        // 法線を z 軸とする正規直交基底 (Duff et al. 2017)
+        const float sign(std::copysign(1.0f, n(2)));
+        const float a(-1.0f / (sign + n(2))), b(n(0) * n(1) * a);
+        const Eigen::Vector3f t(1.0f + sign * n(0) * n(0) * a, sign * b, -sign * n(0));
+        const Eigen::Vector3f s(b, sign + n(1) * n(1) * a, -n(1));
+
+        // 頂点ごとに標本点を回転して縞模様を避ける
+        std::uint32_t h(static_cast<std::uint32_t>(i) * 0x9e3779b9u);
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        const float angle(h * 1.4629180792671596e-9f);
+        const float c(std::cos(angle)), sn(std::sin(angle));
+
+        float o[12], d[12];
+        for (int k = 0; k < 4; ++k) {
+            o[k] = p(0) + n(0) * offset;
+            o[k + 4] = p(1) + n(1) * offset;
+            o[k + 8] = p(2) + n(2) * offset;
+        }
+
+        int blocked(0);
+        for (int j = 0; j < samples; j += 4) {
+            for (int k = 0; k < 4; ++k) {
+                // 円板上の点を半球に持ち上げるとコサイン分布になる
+                const float x(c * diskX[j + k] - sn * diskY[j + k]), y(sn * diskX[j + k] + c * diskY[j + k]);
+                const float z(std::sqrt(std::max(0.0f, 1.0f - x * x - y * y)));
+                d[k] = t(0) * x + s(0) * y + n(0) * z;
+                d[k + 4] = t(1) * x + s(1) * y + n(1) * z;
+                d[k + 8] = t(2) * x + s(2) * y + n(2) * z;
+            }
+            const int m(bvh.occluded4(o, d, radius));
+            blocked += (m & 1) + (m >> 1 & 1) + (m >> 2 & 1) + (m >> 3 & 1);
+        }
+        return 1.0f - static_cast<float>(blocked) / samples;
+    }
+
+public:
+
+    // [first, last) の頂点の環境遮蔽を求める
+    // jobs : 使うスレッドプール
+    // value : 結果を格納する配列 (頂点の番号で参照する)
+    Stats bake(JobSystem &jobs, std::size_t first, std::size_t last, float *value) const{
+        const auto start(std::chrono::steady_clock::now());
+        jobs.parallelFor(first, last, 64, [&](std::size_t p, std::size_t q){
+            for (std::size_t i = p; i < q; ++i) value[i] = evaluate(i);
+        });
+        Stats stats;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.rays = static_cast<std::uint64_t>(last - first) * samples;
+        stats.threads = jobs.getThreadCount();
+        return stats;
+    }
+
+    // 頂点あたりの光線の数
+    int getSamples() const { return samples; }
+
+    // メッシュの内容から求めたハッシュ値 (キャッシュの照合に使う)
+    static std::uint64_t hash(const std::vector<Eigen::Vector3f> &V, const std::vector<Eigen::Vector3i> &F){
+        std::uint64_t h(0xcbf29ce484222325ull);
+        auto add = [&h](const void *data, std::size_t bytes){
+            const std::uint32_t *const w(static_cast<const std::uint32_t *>(data));
+            for (std::size_t k = 0; k < bytes / 4; ++k) h = (h ^ w[k]) * 0x100000001b3ull;
+        };
+        if (!V.empty()) add(V.data()->data(), V.size() * sizeof(Eigen::Vector3f));
+        if (!F.empty()) add(F.data()->data(), F.size() * sizeof(Eigen::Vector3i));
+        return h;
+    }
+
+    // キャッシュファイルの名前 (メッシュのファイルの隣に置く)
+    static std::string cacheName(const std::string &filename) { return filename + ".ao"; }
+
+    // キャッシュファイルを読み込む
+    // filename : メッシュのファイル名
+    // V, F : 読み込んだメッシュ (内容が変わっていればキャッシュを使わない)
+    // value : 読み込んだ値
+    // samples : 0 でなければこの光線の数で求めたキャッシュだけを使う
+    // radius : 0 でなければこの距離で求めたキャッシュだけを使う
+    static bool load(const std::string &filename, const std::vector<Eigen::Vector3f> &V,
+                     const std::vector<Eigen::Vector3i> &F, std::vector<float> &value, int samples = 0, float radius = 0.0f){
+        std::ifstream file(cacheName(filename), std::ios::binary);
+        if (!file) return false;
+        Header header;
+        if (!file.read(reinterpret_cast<char *>(&header), sizeof header)
+            || std::memcmp(header.magic, signature, sizeof signature) != 0
+            || header.vertexCount != V.size()
+            || (samples > 0 && header.samples != static_cast<std::uint32_t>((std::max(samples, 4) + 3) & ~3))
+            || (radius > 0.0f && header.radius != radius)
+            || header.hash != hash(V, F)) return false;
+        value.resize(V.size());
+        return static_cast<bool>(file.read(reinterpret_cast<char *>(value.data()), value.size() * sizeof(float)));
+    }
+
+    // キャッシュファイルに書き出す
+    bool save(const std::string &filename, const std::vector<Eigen::Vector3i> &F, const std::vector<float> &value) const{
+        std::ofstream file(cacheName(filename), std::ios::binary);
+        if (!file) return false;
+        Header header;
+        std::memcpy(header.magic, signature, sizeof signature);
+        header.vertexCount = static_cast<std::uint32_t>(V.size());
+        header.samples = static_cast<std::uint32_t>(samples);
+        header.radius = radius;
+        header.reserved = 0;
+        header.hash = hash(V, F);
+        file.write(reinterpret_cast<const char *>(&header), sizeof header);
+        file.write(reinterpret_cast<const char *>(value.data()), value.size() * sizeof(float));
+        return static_cast<bool>(file);
+    }
+};
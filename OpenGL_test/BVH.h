@@ -0,0 +1,567 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <Eigen/Core>
+#include "Simd.h"
+#include "JobSystem.h"
+
+// 三角形の境界ボリューム階層
+// 表面積ヒューリスティック (SAH) で二分木をスレッドの数が決まった JobSystem の上で並列に構築し，
+// 4 分木に畳み込んで 4 つの子の箱を SIMD でまとめて判定する
+class BVH {
+public:
+
+    // 交差しなかったことを表す値
+    static constexpr std::uint32_t none = 0xffffffffu;
+
+    // 交差の結果
+    struct Hit {
+        // 三角形の番号 (交差しなければ none)
+        std::uint32_t triangle;
+
+        // 光線のパラメータ
+        float t;
+
+        // 三角形上の重心座標 (頂点 1, 2 の重み)
+        float u, v;
+    };
+
+private:
+
+    // 4 分木の節点
+    struct Node {
+        // 子の箱
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+
+        // 内部節点なら節点の番号，葉なら最初の三角形の番号，空なら -1
+        std::int32_t child[4];
+
+        // 葉の三角形の数 (内部節点なら 0)
+        std::uint32_t count[4];
+    };
+
+    // 交差判定用の三角形 (頂点 0 と二辺，調べるときに頂点の位置から作る)
+    struct Triangle {
+        float v0[3], e1[3], e2[3];
+    };
+
+    // 構築用の箱
+    struct Box {
+        Eigen::Vector3f lo, hi;
+
+        Box()
+        : lo(Eigen::Vector3f::Constant(std::numeric_limits<float>::max()))
+        , hi(Eigen::Vector3f::Constant(-std::numeric_limits<float>::max()))
+        {
+        }
+
+        void grow(const Eigen::Vector3f &p) { lo = lo.cwiseMin(p); hi = hi.cwiseMax(p); }
+        void grow(const Box &b) { lo = lo.cwiseMin(b.lo); hi = hi.cwiseMax(b.hi); }
+        Eigen::Vector3f center() const { return (lo + hi) * 0.5f; }
+        float center(int axis) const { return (lo(axis) + hi(axis)) * 0.5f; }
+        float area() const{
+            const Eigen::Vector3f d((hi - lo).cwiseMax(0.0f));
+            return 2.0f * (d(0) * d(1) + d(1) * d(2) + d(2) * d(0));
+        }
+    };
+
+    // 構築用の二分木の節点
+    struct BuildNode {
+        Box box;
+        const BuildNode *child[2];
+        std::uint32_t first, count;
+    };
+
+    // 分割の候補の数
+    static constexpr int binCount = 16;
+
+    // 葉に入れる三角形の最大数
+    static constexpr std::uint32_t leafSize = 8;
+
+    // これより多い三角形の範囲は二つの子を別の仕事にして構築し，箱の計算と振り分けも分割する
+    static constexpr std::uint32_t taskSize = 1 << 15;
+
+    // 二分木の深さの上限 (これより深い範囲は三角形が多くても葉にする)
+    static constexpr int maxDepth = 64;
+
+    // たどるときのスタックの大きさ
+    // 4 分木の深さは二分木の深さを超えず，一段降りるたびに積むのは高々 3 つ増えるだけなので溢れない
+    static constexpr int stackSize = 256;
+    static_assert(3 * maxDepth + 1 <= stackSize, "the traversal stack must hold the deepest tree");
+
+    // 4 分木の節点
+    std::vector<Node> nodes;
+
+    // 頂点の位置と，木の順序に並べた三角形の頂点のインデックスと元の番号
+    // 頂点 0 と二辺を三角形ごとに持つより小さい
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3i> faces;
+    std::vector<std::uint32_t> ids;
+
+    // 構築に使う三角形の箱 (重心は箱の中心を使う)
+    std::vector<Box> boxes;
+
+    // 二分木の節点を置く領域と使った数
+    // 節点は三角形の数の 2 倍を超えないのでまとめて確保し (触れた分だけがメモリに載る)，
+    // 細かく確保しないので畳み込んだ後に一度に返せる
+    BuildNode *pool;
+    std::atomic<std::uint32_t> poolUsed;
+
+    // 構築にかかった時間
+    double buildSeconds;
+
+public:
+
+    // コンストラクタ
+    // V : 頂点の位置
+    // F : 面の頂点のインデックス
+    BVH(const std::vector<Eigen::Vector3f> &V, const std::vector<Eigen::Vector3i> &F)
+    : pool(nullptr)
+    , poolUsed(0)
+    , buildSeconds(0.0)
+    {
+        const auto start(std::chrono::steady_clock::now());
+        const std::uint32_t n(static_cast<std::uint32_t>(F.size()));
+
+        // 再帰的に分かれる仕事も含めて，構築の間だけ作るスレッドの数の決まったプールで実行する
+        JobSystem jobs;
+        boxes.resize(n);
+        ids.resize(n);
+        jobs.parallelFor(0, n, taskSize, [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) {
+                Box b;
+                for (int j = 0; j < 3; ++j) b.grow(V[F[i](j)]);
+                boxes[i] = b;
+                ids[i] = static_cast<std::uint32_t>(i);
+            }
+        }, "bvh");
+
+        if (n > 0) {
+            std::allocator<BuildNode> allocator;
+            const std::size_t poolSize(2 * static_cast<std::size_t>(n));
+            pool = allocator.allocate(poolSize);
+            const BuildNode *const root(build(jobs, 0, n, 0));
+
+            // 箱は畳み込む前に捨て，節点は数えてから確保して二分木と同時に持つメモリを抑える
+            std::vector<Box>().swap(boxes);
+            nodes.reserve(root->count > 0 ? 1 : quadCount(root));
+
+            // 4 分木に畳み込む
+            if (root->count > 0) {
+                // 根が葉なら一つだけ子を持つ節点にする
+                nodes.emplace_back();
+                clear(nodes[0]);
+                set(nodes[0], 0, root->box, static_cast<std::int32_t>(root->first), root->count);
+            }
+            else {
+                collapse(root);
+            }
+            allocator.deallocate(pool, poolSize);
+            pool = nullptr;
+        }
+
+        // 木の順序に三角形を並べる
+        positions = V;
+        faces.resize(n);
+        jobs.parallelFor(0, n, taskSize, [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) faces[i] = F[ids[i]];
+        }, "bvh");
+
+        buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+
+    // [first, last) の三角形の二分木を構築する
+    BuildNode *build(JobSystem &jobs, std::uint32_t first, std::uint32_t last, int depth){
+        BuildNode *const node(new (pool + poolUsed++) BuildNode);
+        const std::uint32_t n(last - first);
+
+        // 箱と重心の範囲
+        Box centroidBox;
+        bounds(jobs, first, last, node->box, centroidBox);
+        node->child[0] = node->child[1] = nullptr;
+        node->first = first;
+        node->count = n;
+        if (n <= 2 || depth >= maxDepth) return node;
+
+        // 三軸それぞれで重心を区間に振り分けて SAH が最小になる分割を探す
+        const Eigen::Vector3f extent(centroidBox.hi - centroidBox.lo);
+        int bestAxis(-1), bestSplit(0);
+        float bestCost(std::numeric_limits<float>::max());
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent(axis) <= 0.0f) continue;
+            Box bin[binCount];
+            std::uint32_t count[binCount] = {};
+            binning(jobs, first, last, axis, centroidBox.lo(axis), binCount / extent(axis), bin, count);
+
+            // 右から累積した面積と数
+            float rightArea[binCount];
+            std::uint32_t rightCount[binCount];
+            Box right;
+            std::uint32_t r(0);
+            for (int k = binCount - 1; k > 0; --k) {
+                right.grow(bin[k]);
+                r += count[k];
+                rightArea[k] = right.area();
+                rightCount[k] = r;
+            }
+            Box left;
+            std::uint32_t l(0);
+            for (int k = 1; k < binCount; ++k) {
+                left.grow(bin[k - 1]);
+                l += count[k - 1];
+                if (l == 0 || rightCount[k] == 0) continue;
+                const float cost(left.area() * l + rightArea[k] * rightCount[k]);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = k;
+                }
+            }
+        }
+
+        std::uint32_t middle;
+        if (bestAxis < 0) {
+            // 重心がすべて重なっているので数で二等分する
+            if (n <= leafSize) return node;
+            middle = first + n / 2;
+        }
+        else {
+            // 分割しても得にならない小さい範囲は葉にする
+            const float leafCost(node->box.area() * n);
+            if (n <= leafSize && node->box.area() + bestCost >= leafCost) return node;
+
+            const float lo(centroidBox.lo(bestAxis)), scale(binCount / extent(bestAxis));
+            middle = static_cast<std::uint32_t>(std::partition(ids.begin() + first, ids.begin() + last, [&](std::uint32_t i){
+                return binIndex(boxes[i].center(bestAxis), lo, scale) < bestSplit;
+            }) - ids.begin());
+        }
+
+        // 大きい範囲の右側は盗める仕事にする
+        node->count = 0;
+        if (n > taskSize) {
+            jobs.invoke("bvh", [&]{ node->child[0] = build(jobs, first, middle, depth + 1); },
+                        "bvh", [&]{ node->child[1] = build(jobs, middle, last, depth + 1); });
+        }
+        else {
+            node->child[0] = build(jobs, first, middle, depth + 1);
+            node->child[1] = build(jobs, middle, last, depth + 1);
+        }
+        return node;
+    }
+
+    // 区間の番号
+    static int binIndex(float c, float lo, float scale){
+        return std::min(binCount - 1, static_cast<int>((c - lo) * scale));
+    }
+
+    // [first, last) の三角形の箱と重心の範囲を求める
+    void bounds(JobSystem &jobs, std::uint32_t first, std::uint32_t last, Box &box, Box &centroidBox) const{
+        if (last - first < taskSize) {
+            for (std::uint32_t k = first; k < last; ++k) {
+                box.grow(boxes[ids[k]]);
+                centroidBox.grow(boxes[ids[k]].center());
+            }
+            return;
+        }
+        std::vector<Box> b(jobs.getThreadCount()), c(jobs.getThreadCount());
+        const std::size_t step((last - first + b.size() - 1) / b.size());
+        jobs.parallelFor(0, b.size(), 1, [&](std::size_t p, std::size_t q){
+            for (std::size_t t = p; t < q; ++t)
+                for (std::size_t k = first + t * step; k < std::min<std::size_t>(last, first + (t + 1) * step); ++k) {
+                    b[t].grow(boxes[ids[k]]);
+                    c[t].grow(boxes[ids[k]].center());
+                }
+        }, "bvh");
+        for (std::size_t t = 0; t < b.size(); ++t) {
+            box.grow(b[t]);
+            centroidBox.grow(c[t]);
+        }
+    }
+
+    // [first, last) の三角形を重心で区間に振り分ける
+    void binning(JobSystem &jobs, std::uint32_t first, std::uint32_t last, int axis, float lo, float scale,
+                 Box *bin, std::uint32_t *count) const{
+        auto serial = [&](std::size_t p, std::size_t q, Box *bin, std::uint32_t *count){
+            for (std::size_t k = p; k < q; ++k) {
+                const int b(binIndex(boxes[ids[k]].center(axis), lo, scale));
+                bin[b].grow(boxes[ids[k]]);
+                ++count[b];
+            }
+        };
+        const std::size_t parts(jobs.getThreadCount());
+        if (last - first < taskSize || parts == 1) {
+            serial(first, last, bin, count);
+            return;
+        }
+        std::vector<Box> b(parts * binCount);
+        std::vector<std::uint32_t> c(parts * binCount, 0);
+        const std::size_t step((last - first + parts - 1) / parts);
+        jobs.parallelFor(0, parts, 1, [&](std::size_t p, std::size_t q){
+            for (std::size_t t = p; t < q; ++t)
+                serial(std::min<std::size_t>(last, first + t * step), std::min<std::size_t>(last, first + (t + 1) * step),
+                       &b[t * binCount], &c[t * binCount]);
+        }, "bvh");
+        for (std::size_t t = 0; t < parts; ++t)
+            for (int k = 0; k < binCount; ++k) {
+                bin[k].grow(b[t * binCount + k]);
+                count[k] += c[t * binCount + k];
+            }
+    }
+
+    // 節点の子をすべて空にする
+    static void clear(Node &node){
+        for (int i = 0; i < 4; ++i) {
+            node.minX[i] = node.minY[i] = node.minZ[i] = std::numeric_limits<float>::max();
+            node.maxX[i] = node.maxY[i] = node.maxZ[i] = -std::numeric_limits<float>::max();
+            node.child[i] = -1;
+            node.count[i] = 0;
+        }
+    }
+
+    // 節点の i 番目の子を設定する
+    static void set(Node &node, int i, const Box &b, std::int32_t child, std::uint32_t count){
+        node.minX[i] = b.lo(0); node.minY[i] = b.lo(1); node.minZ[i] = b.lo(2);
+        node.maxX[i] = b.hi(0); node.maxY[i] = b.hi(1); node.maxZ[i] = b.hi(2);
+        node.child[i] = child;
+        node.count[i] = count;
+    }
+
+    // 二分木の内部節点 b の子を最大 4 つまで孫に展開して child に入れ，その数を返す (面積の大きい内部節点から)
+    static int expand(const BuildNode *b, const BuildNode *(&child)[4]){
+        child[0] = b->child[0];
+        child[1] = b->child[1];
+        int n(2);
+        while (n < 4) {
+            int largest(-1);
+            for (int i = 0; i < n; ++i)
+                if (child[i]->count == 0 && (largest < 0 || child[i]->box.area() > child[largest]->box.area())) largest = i;
+            if (largest < 0) break;
+            const BuildNode *const c(child[largest]);
+            child[largest] = c->child[0];
+            child[n++] = c->child[1];
+        }
+        return n;
+    }
+
+    // 二分木の内部節点 b を畳み込んだ 4 分木の節点の数
+    static std::size_t quadCount(const BuildNode *b){
+        const BuildNode *child[4];
+        const int n(expand(b, child));
+        std::size_t count(1);
+        for (int i = 0; i < n; ++i) if (child[i]->count == 0) count += quadCount(child[i]);
+        return count;
+    }
+
+    // 二分木の内部節点を 4 分木の節点にする
+    std::int32_t collapse(const BuildNode *b){
+        const BuildNode *child[4];
+        const int n(expand(b, child));
+
+        const std::int32_t index(static_cast<std::int32_t>(nodes.size()));
+        nodes.emplace_back();
+        clear(nodes[index]);
+        for (int i = 0; i < n; ++i) {
+            if (child[i]->count > 0) {
+                set(nodes[index], i, child[i]->box, static_cast<std::int32_t>(child[i]->first), child[i]->count);
+            }
+            else {
+                const std::int32_t c(collapse(child[i]));
+                set(nodes[index], i, child[i]->box, c, 0);
+            }
+        }
+        return index;
+    }
+
+    // 木の順序で index 番目の三角形
+    Triangle triangle(std::uint32_t index) const{
+        const Eigen::Vector3i &f(faces[index]);
+        const Eigen::Vector3f e1(positions[f(1)] - positions[f(0)]), e2(positions[f(2)] - positions[f(0)]);
+        Triangle tri;
+        for (int j = 0; j < 3; ++j) {
+            tri.v0[j] = positions[f(0)](j);
+            tri.e1[j] = e1(j);
+            tri.e2[j] = e2(j);
+        }
+        return tri;
+    }
+
+    // 三角形との交差判定 (Möller–Trumbore)
+    static bool intersect(const Triangle &tri, const float *o, const float *d, float tmax, Hit &hit){
+        const float *const e1(tri.e1), *const e2(tri.e2);
+        const float px(d[1] * e2[2] - d[2] * e2[1]), py(d[2] * e2[0] - d[0] * e2[2]), pz(d[0] * e2[1] - d[1] * e2[0]);
+        const float det(e1[0] * px + e1[1] * py + e1[2] * pz);
+        if (std::abs(det) < 1e-12f) return false;
+        const float inv(1.0f / det);
+        const float sx(o[0] - tri.v0[0]), sy(o[1] - tri.v0[1]), sz(o[2] - tri.v0[2]);
+        const float u((sx * px + sy * py + sz * pz) * inv);
+        if (u < 0.0f || u > 1.0f) return false;
+        const float qx(sy * e1[2] - sz * e1[1]), qy(sz * e1[0] - sx * e1[2]), qz(sx * e1[1] - sy * e1[0]);
+        const float v((d[0] * qx + d[1] * qy + d[2] * qz) * inv);
+        if (v < 0.0f || u + v > 1.0f) return false;
+        const float t((e2[0] * qx + e2[1] * qy + e2[2] * qz) * inv);
+        if (t <= 0.0f || t >= tmax) return false;
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+
+    // 4 本の光線と三角形との交差をまとめて求め，tmax より手前で交差する光線のビットを返す
+    static int intersect4(const Triangle &tri, const Float4 *o, const Float4 *d, Float4 tmax){
+        const Float4 e1x(tri.e1[0]), e1y(tri.e1[1]), e1z(tri.e1[2]);
+        const Float4 e2x(tri.e2[0]), e2y(tri.e2[1]), e2z(tri.e2[2]);
+        const Float4 px(d[1] * e2z - d[2] * e2y), py(d[2] * e2x - d[0] * e2z), pz(d[0] * e2y - d[1] * e2x);
+        const Float4 det(e1x * px + e1y * py + e1z * pz);
+        const Float4 inv(Float4(1.0f) / det);
+        const Float4 sx(o[0] - Float4(tri.v0[0])), sy(o[1] - Float4(tri.v0[1])), sz(o[2] - Float4(tri.v0[2]));
+        const Float4 u((sx * px + sy * py + sz * pz) * inv);
+        const Float4 qx(sy * e1z - sz * e1y), qy(sz * e1x - sx * e1z), qz(sx * e1y - sy * e1x);
+        const Float4 v((d[0] * qx + d[1] * qy + d[2] * qz) * inv);
+        const Float4 t((e2x * qx + e2y * qy + e2z * qz) * inv);
+        const Float4 zero(0.0f);
+        return mask((max(det, zero - det) > Float4(1e-12f)) & (u >= zero) & (v >= zero) & (u + v <= Float4(1.0f))
+                    & (t > zero) & (t < tmax));
+    }
+
+    // 光線をたどる
+    // anyHit : 最初に見つかった交差で打ち切るかどうか
+    Hit traverse(const float *o, const float *d, float tmax, bool anyHit) const{
+        Hit hit = { none, tmax, 0.0f, 0.0f };
+        if (nodes.empty()) return hit;
+
+        // 方向の逆数 (0 の成分は大きな値にする)
+        float inv[3];
+        for (int j = 0; j < 3; ++j)
+            inv[j] = std::abs(d[j]) > 1e-30f ? 1.0f / d[j] : std::copysign(1e30f, d[j]);
+        const Float4 ox(o[0]), oy(o[1]), oz(o[2]);
+        const Float4 ix(inv[0]), iy(inv[1]), iz(inv[2]);
+
+        std::int32_t stack[stackSize];
+        int top(0);
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node(nodes[stack[--top]]);
+
+            // 4 つの子の箱との交差をまとめて求める
+            const Float4 tx0((Float4::load(node.minX) - ox) * ix), tx1((Float4::load(node.maxX) - ox) * ix);
+            const Float4 ty0((Float4::load(node.minY) - oy) * iy), ty1((Float4::load(node.maxY) - oy) * iy);
+            const Float4 tz0((Float4::load(node.minZ) - oz) * iz), tz1((Float4::load(node.maxZ) - oz) * iz);
+            const Float4 tnear(max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), Float4(0.0f))));
+            const Float4 tfar(min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), Float4(hit.t))));
+            int m(mask(tnear <= tfar));
+            if (m == 0) continue;
+
+            // 近い子が先に取り出されるように遠い順に積む
+            float t[4];
+            tnear.store(t);
+            int order[4], n(0);
+            for (int i = 0; i < 4; ++i) if (m & 1 << i && node.child[i] >= 0) order[n++] = i;
+            std::sort(order, order + n, [&](int a, int b){ return t[a] > t[b]; });
+            for (int k = 0; k < n; ++k) {
+                const int i(order[k]);
+                if (node.count[i] == 0) {
+                    stack[top++] = node.child[i];
+                    continue;
+                }
+
+                // 葉の三角形を調べる
+                for (std::uint32_t j = 0; j < node.count[i]; ++j) {
+                    const std::uint32_t index(node.child[i] + j);
+                    if (intersect(triangle(index), o, d, hit.t, hit)) {
+                        hit.triangle = ids[index];
+                        if (anyHit) return hit;
+                    }
+                }
+            }
+        }
+        return hit;
+    }
+
+public:
+
+    // 光線と最も近い三角形との交差を求める
+    // o : 光線の始点
+    // d : 光線の方向
+    // tmax : 光線のパラメータの上限
+    Hit intersect(const float *o, const float *d, float tmax = std::numeric_limits<float>::max()) const{
+        return traverse(o, d, tmax, false);
+    }
+
+    // 光線が tmax までに何かに遮られるかどうか
+    bool occluded(const float *o, const float *d, float tmax) const{
+        return traverse(o, d, tmax, true).triangle != none;
+    }
+
+    // 4 本の光線をまとめてたどり，tmax までに遮られた光線のビットを返す
+    // 始点の近い光線 (同じ頂点から出る環境遮蔽の光線など) をまとめると節点の読み込みを共有できる
+    // o : 光線の始点 (x, y, z の順にそれぞれ 4 本分)
+    // d : 光線の方向 (x, y, z の順にそれぞれ 4 本分)
+    // tmax : 光線のパラメータの上限
+    // active : 調べる光線のビット
+    int occluded4(const float *o, const float *d, float tmax, int active = 0xf) const{
+        if (nodes.empty() || active == 0) return 0;
+
+        const Float4 origin[3] = { Float4::load(o), Float4::load(o + 4), Float4::load(o + 8) };
+        const Float4 direction[3] = { Float4::load(d), Float4::load(d + 4), Float4::load(d + 8) };
+        float inv[12];
+        for (int j = 0; j < 12; ++j)
+            inv[j] = std::abs(d[j]) > 1e-30f ? 1.0f / d[j] : std::copysign(1e30f, d[j]);
+        const Float4 ix(Float4::load(inv)), iy(Float4::load(inv + 4)), iz(Float4::load(inv + 8));
+        const Float4 limit(tmax), zero(0.0f);
+
+        int hit(0);
+        std::int32_t stack[stackSize];
+        int top(0);
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node(nodes[stack[--top]]);
+            for (int i = 0; i < 4; ++i) {
+                if (node.child[i] < 0) continue;
+
+                // まだ遮られていない光線と子の箱との交差
+                const Float4 tx0((Float4(node.minX[i]) - origin[0]) * ix), tx1((Float4(node.maxX[i]) - origin[0]) * ix);
+                const Float4 ty0((Float4(node.minY[i]) - origin[1]) * iy), ty1((Float4(node.maxY[i]) - origin[1]) * iy);
+                const Float4 tz0((Float4(node.minZ[i]) - origin[2]) * iz), tz1((Float4(node.maxZ[i]) - origin[2]) * iz);
+                const Float4 tnear(max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), zero)));
+                const Float4 tfar(min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), limit)));
+                int m(mask(tnear <= tfar) & active & ~hit);
+                if (m == 0) continue;
+                if (node.count[i] == 0) {
+                    stack[top++] = node.child[i];
+                    continue;
+                }
+
+                // 葉の三角形を調べる
+                for (std::uint32_t j = 0; j < node.count[i] && m != 0; ++j) {
+                    hit |= intersect4(triangle(node.child[i] + j), origin, direction, limit) & m;
+                    m &= ~hit;
+                }
+                if ((hit & active) == active) return hit;
+            }
+        }
+        return hit;
+    }
+
+    // 構築にかかった時間 (秒)
+    double getBuildSeconds() const { return buildSeconds; }
+
+    // 節点の数
+    std::size_t getNodeCount() const { return nodes.size(); }
+
+    // 使用しているメモリのバイト数
+    std::size_t memoryBytes() const{
+        return nodes.capacity() * sizeof(Node) + positions.capacity() * sizeof(Eigen::Vector3f)
+        + faces.capacity() * sizeof(Eigen::Vector3i)
+        + ids.capacity() * sizeof(std::uint32_t);
+    }
+};
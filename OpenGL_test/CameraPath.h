@@ -0,0 +1,228 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 一フレームの入力の状態
+struct InputState {
+    // 経過時間 (秒)
+    float time;
+
+    // ウィンドウのサイズ
+    float size[2];
+
+    // ワールド座標系に対するデバイス座標系の拡大率
+    float scale;
+
+    // 図形の正規化デバイス座標系上での位置
+    float location[2];
+
+    // 押されているキーのビット (どのキーを記録するかは呼び出し側で決める)
+    std::uint32_t keys;
+
+    // このフレームで左ボタンが押されたかどうか
+    std::uint32_t clicked;
+};
+
+// 入力の記録
+// フレームごとの入力の状態をそのままファイルに並べる (1 フレーム 32 バイト)
+class CameraPath {
+    // ファイルの識別子
+    static constexpr char signature[8] = { 'G', 'L', 'P', 'A', 'T', 'H', '0', '1' };
+
+    // ファイルのヘッダ
+    struct Header {
+        char magic[8];
+        std::uint32_t frameCount;
+        float timestep;
+        std::uint32_t reserved[2];
+    };
+
+    // フレームごとの入力
+    std::vector<InputState> frames;
+
+    // 再生するときの一フレームの時間 (秒)
+    float timestep;
+
+public:
+
+    // コンストラクタ
+    // timestep : 再生するときの一フレームの時間 (秒)
+    explicit CameraPath(float timestep = 1.0f / 60.0f)
+    : timestep(timestep)
+    {
+    }
+
+    // フレームの入力を追加する
+    void append(const InputState &input) { frames.push_back(input); }
+
+    // ファイルに書き出す
+    bool save(const char *filename) const{
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) return false;
+        Header header = {};
+        std::memcpy(header.magic, signature, sizeof signature);
+        header.frameCount = static_cast<std::uint32_t>(frames.size());
+        header.timestep = timestep;
+        file.write(reinterpret_cast<const char *>(&header), sizeof header);
+        file.write(reinterpret_cast<const char *>(frames.data()), frames.size() * sizeof(InputState));
+        return static_cast<bool>(file);
+    }
+
+    // ファイルから読み込む
+    bool load(const char *filename){
+        std::ifstream file(filename, std::ios::binary);
+        Header header;
+        if (!file.read(reinterpret_cast<char *>(&header), sizeof header)
+            || std::memcmp(header.magic, signature, sizeof signature) != 0) return false;
+        frames.resize(header.frameCount);
+        timestep = header.timestep;
+        return static_cast<bool>(file.read(reinterpret_cast<char *>(frames.data()), frames.size() * sizeof(InputState)));
+    }
+
+    // フレームの数
+    std::size_t size() const { return frames.size(); }
+
+    // フレームの入力
+    const InputState &operator[](std::size_t i) const { return frames[i]; }
+
+    // 再生するときの一フレームの時間
+    float getTimestep() const { return timestep; }
+};
+
+// フレームごとの処理時間と画像のハッシュ値の記録
+// 同じ入力を再生した二つのビルドの結果を CSV で比べられるようにする
+class FrameLog {
+public:
+
+    // 一フレームの記録
+    struct Frame {
+        // CPU の処理時間 (ミリ秒)
+        double cpu;
+
+        // GPU の処理時間 (ミリ秒，計測できなければ負)
+        double gpu;
+
+        // 画像のハッシュ値 (求めていなければ 0)
+        std::uint64_t hash;
+    };
+
+private:
+
+    // フレームごとの記録
+    std::vector<Frame> frames;
+
+public:
+
+    // 値の並びの p パーセンタイル
+    static double percentile(std::vector<double> value, double p){
+        if (value.empty()) return 0.0;
+        const std::size_t k(std::min(value.size() - 1, static_cast<std::size_t>(p * 0.01 * value.size())));
+        std::nth_element(value.begin(), value.begin() + k, value.end());
+        return value[k];
+    }
+
+    // 処理時間の分布を一行で表示する
+    static void printRow(std::ostream &out, const char *name, const std::vector<double> &value){
+        if (value.empty()) return;
+        double sum(0.0);
+        for (const double v : value) sum += v;
+        out << "  " << name << " mean " << sum / value.size() << ", median " << percentile(value, 50.0)
+        << ", 95% " << percentile(value, 95.0) << ", max " << *std::max_element(value.begin(), value.end()) << " ms\n";
+    }
+
+    // コンストラクタ
+    // count : フレームの数
+    explicit FrameLog(std::size_t count = 0)
+    : frames(count, Frame{ 0.0, -1.0, 0 })
+    {
+    }
+
+    // フレームの記録
+    Frame &operator[](std::size_t i) { return frames[i]; }
+    const Frame &operator[](std::size_t i) const { return frames[i]; }
+
+    // フレームの数
+    std::size_t size() const { return frames.size(); }
+
+    // 画像のハッシュ値を求める (FNV-1a)
+    static std::uint64_t hash(const std::uint8_t *data, std::size_t size){
+        std::uint64_t h(14695981039346656037ull);
+        for (std::size_t i = 0; i < size; ++i) h = (h ^ data[i]) * 1099511628211ull;
+        return h;
+    }
+
+    // CSV で書き出す
+    bool save(const char *filename) const{
+        std::ofstream file(filename);
+        if (!file) return false;
+        file << "frame,cpu_ms,gpu_ms,hash\n" << std::fixed << std::setprecision(4);
+        for (std::size_t i = 0; i < frames.size(); ++i)
+            file << i << ',' << frames[i].cpu << ',' << frames[i].gpu << ','
+            << std::hex << std::setw(16) << std::setfill('0') << frames[i].hash << std::dec << std::setfill(' ') << '\n';
+        return static_cast<bool>(file);
+    }
+
+    // CSV から読み込む
+    bool load(const char *filename){
+        std::ifstream file(filename);
+        std::string line;
+        if (!std::getline(file, line)) return false;
+        frames.clear();
+        while (std::getline(file, line)) {
+            std::istringstream row(line);
+            std::size_t i;
+            Frame f;
+            char comma;
+            if (row >> i >> comma >> f.cpu >> comma >> f.gpu >> comma >> std::hex >> f.hash) frames.push_back(f);
+        }
+        return true;
+    }
+
+    // 処理時間の分布を表示する
+    void print(std::ostream &out, const char *title) const{
+        std::vector<double> cpu, gpu;
+        for (const Frame &f : frames) {
+            cpu.push_back(f.cpu);
+            if (f.gpu >= 0.0) gpu.push_back(f.gpu);
+        }
+        out << title << " (" << frames.size() << " frames)\n";
+        printRow(out, "CPU", cpu);
+        printRow(out, "GPU", gpu);
+        out << std::flush;
+    }
+
+    // 別の記録と比べて，画像の異なるフレームと処理時間の比を表示する
+    // 戻り値 : 画像の異なるフレームの数
+    std::size_t compare(const FrameLog &other, std::ostream &out) const{
+        const std::size_t count(std::min(frames.size(), other.frames.size()));
+        std::size_t differ(0);
+        double cpu[2] = { 0.0, 0.0 }, gpu[2] = { 0.0, 0.0 };
+        for (std::size_t i = 0; i < count; ++i) {
+            const Frame &a(frames[i]), &b(other.frames[i]);
+            if (a.hash != b.hash) {
+                if (differ < 10) out << "  frame " << i << " differs\n";
+                ++differ;
+            }
+            cpu[0] += a.cpu;
+            cpu[1] += b.cpu;
+            if (a.gpu >= 0.0 && b.gpu >= 0.0) {
+                gpu[0] += a.gpu;
+                gpu[1] += b.gpu;
+            }
+        }
+        if (frames.size() != other.frames.size())
+            out << "  frame counts differ: " << frames.size() << " and " << other.frames.size() << "\n";
+        out << "  " << differ << " of " << count << " frames differ\n";
+        if (cpu[0] > 0.0) out << "  CPU time ratio " << cpu[1] / cpu[0] << "\n";
+        if (gpu[0] > 0.0) out << "  GPU time ratio " << gpu[1] / gpu[0] << "\n";
+        out << std::flush;
+        return differ;
+    }
+};
@@ -0,0 +1,545 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "Frustum.h"
+#include "ChunkedMesh.h"
+#include "GLState.h"
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+
+// ディスク上のブロックを固定サイズの GPU バッファのプールに読み込みながら描画する
+class ChunkStreamer {
+public:
+
+    // 統計情報
+    struct Stats {
+        // 視錐台内にあるブロックの数
+        std::uint32_t visible;
+
+        // 描画したブロックの数
+        std::uint32_t drawn;
+
+        // GPU に載っているブロックの数
+        std::uint32_t resident;
+
+        // このフレームで転送したバイト数
+        std::size_t uploaded;
+
+        // 起動してから転送したバイト数
+        std::size_t totalUploaded;
+
+        // 起動してから追い出したブロックの数
+        std::size_t evictions;
+
+        // 先読みして保持しているバイト数
+        std::size_t prefetched;
+
+        // このフレームで遮蔽物に隠れていたブロックの数とオクルージョンカリングの時間 (秒)
+        std::uint32_t occluded;
+        double occlusionSeconds;
+
+        // 起動してからのフレーム数と，視錐台内にあったブロックと隠れていたブロックの延べ数，オクルージョンカリングの時間
+        std::uint64_t frames;
+        std::size_t totalVisible;
+        std::size_t totalOccluded;
+        double totalOcclusionSeconds;
+    };
+
+    // 1 フレームに描く遮蔽物の三角形の数の上限 (画面上で大きいブロックから)
+    static constexpr std::size_t occluderTriangles = 32768;
+
+    // 遮蔽物を作るときのメッシュ全体を囲む箱の分割数
+    static constexpr std::uint32_t proxyResolution = 128;
+
+private:
+
+    // ブロックの状態
+    // checking は先読みのスレッドがインデックスを確かめている間，broken はインデックスが範囲外で使わないブロック
+    enum State { none, checking, prefetched, resident, broken };
+
+    // GPU 上のバッファの一区画
+    struct Slot {
+        // 頂点配列オブジェクト
+        GLuint vao;
+
+        // 頂点バッファオブジェクト
+        GLuint vbo;
+
+        // インデックスの頂点バッファオブジェクト
+        GLuint ibo;
+
+        // 載っているブロック (空なら -1)
+        std::int64_t block;
+
+        // 最後に描画したフレーム
+        std::uint64_t lastUsed;
+    };
+
+    // 先読みの要求
+    struct Request {
+        Matrix projection;
+        Matrix modelview;
+        GLfloat height;
+    };
+
+    // ディスク上のメッシュ
+    const ChunkedMesh &mesh;
+
+    // バッファのプール
+    std::vector<Slot> slots;
+
+    // ブロックが載っている区画 (載っていなければ -1)
+    std::vector<std::int32_t> slotOf;
+
+    // ブロックの状態
+    std::unique_ptr<std::atomic<int>[]> state;
+
+    // 今回のフレームで描画するブロック
+    std::vector<std::uint32_t> drawList;
+
+    // 1 フレームで転送するバイト数の上限
+    const std::size_t uploadLimit;
+
+    // 先読みに使うメモリの上限
+    const std::size_t prefetchLimit;
+
+    // 何フレーム先のカメラを予測して先読みするか
+    const GLfloat lookahead;
+
+    // フレーム番号
+    std::uint64_t frame;
+
+    // 前のフレームのモデルビュー変換行列
+    Matrix previous;
+
+    // 統計情報
+    Stats stats;
+
+    // オクルージョンカリング (使わなければ空) と，遮蔽物を並列に描くスレッドプール
+    std::unique_ptr<OcclusionCuller> culler;
+    JobSystem *jobs;
+
+    // ブロックごとの遮蔽物の三角形 (転送するときに作り，追い出すときに捨てる)
+    std::vector<std::vector<GLfloat>> proxies;
+
+    // 遮蔽物を作る格子の原点とセルの大きさ
+    GLfloat proxyOrigin[3];
+    GLfloat proxyCell;
+
+    // 先読みのスレッドとの通信
+    std::mutex mutex;
+    std::condition_variable ready;
+    Request request;
+    std::uint64_t generation;
+    bool quit;
+    std::atomic<std::size_t> prefetchedBytes;
+    std::thread prefetcher;
+
+public:
+
+    // コンストラクタ
+    // mesh : 描画するディスク上のメッシュ
+    // gpuBudget : バッファのプールに使う GPU メモリのバイト数
+    // cpuBudget : 先読みに使うメモリのバイト数
+    // uploadLimit : 1 フレームで転送するバイト数の上限
+    ChunkStreamer(const ChunkedMesh &mesh, std::size_t gpuBudget, std::size_t cpuBudget,
+                  std::size_t uploadLimit = 32u << 20, GLfloat lookahead = 8.0f)
+    : mesh(mesh)
+    , slotOf(mesh.getBlockCount(), -1)
+    , state(new std::atomic<int>[mesh.getBlockCount()])
+    , uploadLimit(uploadLimit), prefetchLimit(cpuBudget), lookahead(lookahead)
+    , frame(0), previous(Matrix::identity()), stats()
+    , jobs(nullptr), proxies(mesh.getBlockCount()), proxyOrigin{ 0.0f, 0.0f, 0.0f }, proxyCell(1.0f)
+    , generation(0), quit(false), prefetchedBytes(0)
+    {
+        for (std::uint32_t i = 0; i < mesh.getBlockCount(); ++i) state[i] = none;
+
+        // 区画の大きさは最大のブロックに合わせる
+        const ChunkedMesh::Header &h(mesh.getHeader());
+        const std::size_t vertexBytes(h.maxBlockVertices * sizeof(Object::Vertex));
+        const std::size_t indexBytes(h.maxBlockIndices * sizeof(GLuint));
+        const std::size_t slotBytes(std::max<std::size_t>(1, vertexBytes + indexBytes));
+        if (gpuBudget < slotBytes) {
+            std::cerr << "Error: GPU budget of " << (gpuBudget >> 20) << " MB is smaller than one block ("
+            << ((slotBytes + (1 << 20) - 1) >> 20) << " MB)" << std::endl;
+            return;
+        }
+        const std::size_t count(std::min<std::size_t>(mesh.getBlockCount(), gpuBudget / slotBytes));
+
+        slots.resize(count);
+        for (auto &s : slots) {
+            glGenVertexArrays(1, &s.vao);
+            GLState::get().bindVertexArray(s.vao);
+
+            glGenBuffers(1, &s.vbo);
+            GLState::get().bindBuffer(GL_ARRAY_BUFFER, s.vbo);
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, NULL, GL_DYNAMIC_DRAW);
+            PositionNormal::setInterleaved();
+
+            glGenBuffers(1, &s.ibo);
+            GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, s.ibo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_DYNAMIC_DRAW);
+
+            s.block = -1;
+            s.lastUsed = 0;
+        }
+
+        // 先読みのスレッドを起動する
+        prefetcher = std::thread(&ChunkStreamer::prefetchLoop, this);
+    }
+
+    // デストラクタ
+    virtual ~ChunkStreamer(){
+        // 先読みのスレッドを止める
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        ready.notify_one();
+        if (prefetcher.joinable()) prefetcher.join();
+
+        for (auto &s : slots) {
+            GLState::get().deleteVertexArrays(1, &s.vao);
+            GLState::get().deleteBuffers(1, &s.vbo);
+            GLState::get().deleteBuffers(1, &s.ibo);
+        }
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    ChunkStreamer(const ChunkStreamer &c);
+
+    // 代入によるコピー禁止
+    ChunkStreamer &operator=(const ChunkStreamer &c);
+
+    // 視錐台内のブロックを画面上の大きさの降順に求める
+    void collect(const Matrix &projection, const Matrix &modelview, GLfloat height,
+                 std::vector<std::pair<GLfloat, std::uint32_t>> &visible) const{
+        const Frustum frustum(projection * modelview);
+        visible.clear();
+        for (std::uint32_t i = 0; i < mesh.getBlockCount(); ++i) {
+            const ChunkedMesh::Block &b(mesh.getBlock(i));
+            if (!frustum.intersects(b.center, b.radius)) continue;
+
+            // 視点からの距離と画面上での半径 (画素数)
+            const GLfloat depth(-(modelview[2] * b.center[0] + modelview[6] * b.center[1]
+                                  + modelview[10] * b.center[2] + modelview[14]));
+            const GLfloat size(depth > b.radius
+                               ? b.radius * projection[5] * height * 0.5f / depth
+                               : height);
+            visible.emplace_back(size, i);
+        }
+        std::sort(visible.begin(), visible.end(), std::greater<>());
+    }
+
+    // ブロックを載せる区画を選ぶ
+    // 空いている区画がなければこのフレームで使っていない最も古い区画を追い出す
+    Slot *acquire(){
+        Slot *victim(nullptr);
+        for (auto &s : slots) {
+            if (s.block < 0) return &s;
+            if (s.lastUsed < frame && (victim == nullptr || s.lastUsed < victim->lastUsed)) victim = &s;
+        }
+        if (victim != nullptr) {
+            // 遮蔽物も区画と一緒に捨てて，載っているブロックの分だけ持つ
+            std::vector<GLfloat>().swap(proxies[victim->block]);
+            slotOf[victim->block] = -1;
+            state[victim->block] = none;
+            victim->block = -1;
+            ++stats.evictions;
+        }
+        return victim;
+    }
+
+    // ブロックを頂点のクラスタリングで粗くした遮蔽物を作る
+    // メッシュ全体を囲む箱を proxyResolution 分割した格子のセルの中心に頂点を寄せ，潰れた三角形を捨てる．
+    // 遮蔽物が元の面より手前や輪郭の外に出ると見えているブロックを隠してしまうので，内側に収める．
+    // 寄せた頂点は元の面からセルの対角線の半分以内にあるので，描くときに視線に沿ってそれより奥に押しやる (proxyBias())．
+    // 頂点の法線がそろわないセル (角や縁，薄い部分) では面がセルの中で折れていて輪郭の外にはみ出しやすいので，
+    // そこにかかる三角形は遮蔽物から削る
+    void makeProxy(std::uint32_t i){
+        const ChunkedMesh::Block &b(mesh.getBlock(i));
+        const Object::Vertex *const v(mesh.getVertices(i));
+        const GLuint *const index(mesh.getIndices(i));
+
+        // 頂点のセルの番号 (各軸の番号を 10 ビットずつ詰める)
+        static_assert(proxyResolution <= 1024, "cell coordinates must fit in 10 bits");
+        std::vector<std::uint32_t> cellOf(b.vertexCount);
+        for (std::uint32_t k = 0; k < b.vertexCount; ++k) {
+            std::uint32_t c(0);
+            for (int j = 0; j < 3; ++j)
+                c = c << 10 | std::min(proxyResolution - 1, static_cast<std::uint32_t>(std::max(0.0f, (v[k].position[j] - proxyOrigin[j]) / proxyCell)));
+            cellOf[k] = c;
+        }
+
+        // セルごとに頂点の法線を足し合わせる
+        std::vector<std::uint32_t> cells(cellOf);
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+        std::vector<std::array<GLfloat, 4>> normal(cells.size(), { 0.0f, 0.0f, 0.0f, 0.0f });
+        std::vector<std::uint32_t> slot(b.vertexCount);
+        for (std::uint32_t k = 0; k < b.vertexCount; ++k) {
+            slot[k] = static_cast<std::uint32_t>(std::lower_bound(cells.begin(), cells.end(), cellOf[k]) - cells.begin());
+            for (int j = 0; j < 3; ++j) normal[slot[k]][j] += v[k].normal[j];
+            normal[slot[k]][3] += 1.0f;
+        }
+
+        // 法線の平均の長さが 1 に近いセルだけを使う
+        std::vector<std::uint8_t> flat(cells.size());
+        for (std::size_t c = 0; c < cells.size(); ++c)
+            flat[c] = normal[c][0] * normal[c][0] + normal[c][1] * normal[c][1] + normal[c][2] * normal[c][2]
+                      >= 0.81f * normal[c][3] * normal[c][3];
+
+        // 三つの頂点が別々の使えるセルにある三角形を重複なく残す
+        std::vector<std::array<std::uint32_t, 3>> triangles;
+        for (std::uint32_t t = 0; t + 2 < b.indexCount; t += 3) {
+            std::array<std::uint32_t, 3> c = { slot[index[t]], slot[index[t + 1]], slot[index[t + 2]] };
+            if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0]) continue;
+            if (!flat[c[0]] || !flat[c[1]] || !flat[c[2]]) continue;
+            std::sort(c.begin(), c.end());
+            triangles.push_back(c);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+        std::vector<GLfloat> &proxy(proxies[i]);
+        proxy.resize(triangles.size() * 9);
+        for (std::size_t t = 0; t < triangles.size(); ++t)
+            for (int k = 0; k < 3; ++k)
+                for (int j = 0; j < 3; ++j)
+                    proxy[t * 9 + k * 3 + j] = proxyOrigin[j] + ((cells[triangles[t][k]] >> (10 * (2 - j)) & 1023u) + 0.5f) * proxyCell;
+    }
+
+    // 遮蔽物を描くときに視線に沿って奥に押しやる距離 (セルの対角線の長さ)
+    // セルの中心と元の面の隔たりの上限 (対角線の半分) に，三角形の内部で面から離れる分の余裕を加えたもの
+    GLfloat proxyBias() const { return proxyCell * 1.7320508f; }
+
+    // ブロックを区画に転送する
+    void upload(Slot &s, std::uint32_t i){
+        const ChunkedMesh::Block &b(mesh.getBlock(i));
+        if (culler && proxies[i].empty()) makeProxy(i);
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, s.vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, b.vertexCount * sizeof(Object::Vertex), mesh.getVertices(i));
+        GLState::get().bindVertexArray(s.vao);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, b.indexCount * sizeof(GLuint), mesh.getIndices(i));
+
+        // 転送し終わったページはもう要らない
+        mesh.release(i);
+
+        s.block = i;
+        s.lastUsed = frame;
+        slotOf[i] = static_cast<std::int32_t>(&s - slots.data());
+        state[i] = resident;
+        stats.uploaded += b.bytes();
+    }
+
+    // ブロックのインデックスを確かめ，範囲外を指していたら知らせて以後使わない
+    bool validate(std::uint32_t i){
+        if (mesh.validIndices(i)) return true;
+        std::cerr << "Error: Block " << i << " has an index out of range and is skipped" << std::endl;
+        return false;
+    }
+
+    // 先読みのスレッド
+    void prefetchLoop(){
+        std::uint64_t seen(0);
+        std::vector<std::pair<GLfloat, std::uint32_t>> visible;
+
+        // 先読みしたブロックと要求の世代
+        std::deque<std::pair<std::uint32_t, std::uint64_t>> cache;
+
+        for (;;) {
+            Request r;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&]{ return quit || generation != seen; });
+                if (quit) break;
+                seen = generation;
+                r = request;
+            }
+
+            collect(r.projection, r.modelview, r.height, visible);
+            for (const auto &v : visible) {
+                const std::uint32_t i(v.second);
+                int expected(none);
+                if (!state[i].compare_exchange_strong(expected, checking)) continue;
+
+                // 上限を超えるなら古い要求で先読みしたものから捨てる
+                const std::size_t bytes(mesh.getBlock(i).bytes());
+                while (!cache.empty() && prefetchedBytes + bytes > prefetchLimit && cache.front().second != seen) {
+                    evict(cache.front().first);
+                    cache.pop_front();
+                }
+                if (prefetchedBytes + bytes > prefetchLimit) {
+                    state[i] = none;
+                    break;
+                }
+
+                // ページを読み込んだついでにインデックスを確かめる
+                // 確かめている間に描画のスレッドが転送していたらそちらに任せる
+                mesh.prefetch(i);
+                const bool valid(validate(i));
+                expected = checking;
+                if (!state[i].compare_exchange_strong(expected, valid ? prefetched : broken)) continue;
+                if (!valid) {
+                    mesh.release(i);
+                    continue;
+                }
+                prefetchedBytes += bytes;
+                cache.emplace_back(i, seen);
+
+                // 新しい要求が来ていたらそちらを優先する
+                std::lock_guard<std::mutex> lock(mutex);
+                if (generation != seen || quit) break;
+            }
+        }
+    }
+
+    // 先読みしたブロックを捨てる
+    void evict(std::uint32_t i){
+        prefetchedBytes -= mesh.getBlock(i).bytes();
+
+        // 既に GPU に転送済みならページは解放されている
+        int expected(prefetched);
+        if (state[i].compare_exchange_strong(expected, none)) mesh.release(i);
+    }
+
+public:
+
+    // オクルージョンカリングを使うようにする
+    // jobs : 遮蔽物を並列に描くスレッドプール (NULL なら使わない)
+    void setOcclusionCulling(JobSystem *jobs){
+        this->jobs = jobs;
+        culler.reset(jobs ? new OcclusionCuller : nullptr);
+
+        // 遮蔽物を作る格子はメッシュ全体を囲む立方体を分割する
+        GLfloat upper[3];
+        for (int j = 0; j < 3; ++j) {
+            proxyOrigin[j] = std::numeric_limits<GLfloat>::max();
+            upper[j] = -std::numeric_limits<GLfloat>::max();
+        }
+        for (std::uint32_t i = 0; i < mesh.getBlockCount(); ++i) {
+            for (int j = 0; j < 3; ++j) {
+                proxyOrigin[j] = std::min(proxyOrigin[j], mesh.getBlock(i).min[j]);
+                upper[j] = std::max(upper[j], mesh.getBlock(i).max[j]);
+            }
+        }
+        proxyCell = std::max({ upper[0] - proxyOrigin[0], upper[1] - proxyOrigin[1], upper[2] - proxyOrigin[2], 1e-6f }) / proxyResolution;
+    }
+
+    // 描画するブロックを決めて足りないブロックを転送する
+    // projection : 投影変換行列
+    // modelview : モデルビュー変換行列
+    // height : ビューポートの高さ
+    // occlusion : オクルージョンカリングを行うかどうか (setOcclusionCulling() していなければ行わない)
+    void update(const Matrix &projection, const Matrix &modelview, GLfloat height, bool occlusion = true){
+        ++frame;
+        stats.uploaded = 0;
+
+        std::vector<std::pair<GLfloat, std::uint32_t>> visible;
+        collect(projection, modelview, height, visible);
+        stats.visible = static_cast<std::uint32_t>(visible.size());
+        stats.totalVisible += visible.size();
+
+        // 画面上で大きい転送済みのブロックを遮蔽物にして，隠れているブロックを除く
+        stats.occluded = 0;
+        stats.occlusionSeconds = 0.0;
+        if (culler && occlusion) {
+            culler->resetStats();
+            culler->begin(projection, modelview);
+            std::size_t triangles(0);
+            for (const auto &v : visible) {
+                const std::vector<GLfloat> &proxy(proxies[v.second]);
+                if (proxy.empty()) continue;
+                if (triangles + proxy.size() / 9 > occluderTriangles) break;
+                culler->addOccluders(proxy.data(), proxy.size() / 9, proxyBias());
+                triangles += proxy.size() / 9;
+            }
+            culler->rasterize(*jobs);
+            visible.erase(std::remove_if(visible.begin(), visible.end(), [this](const std::pair<GLfloat, std::uint32_t> &v){
+                const ChunkedMesh::Block &b(mesh.getBlock(v.second));
+                return !culler->visible(b.center, b.radius);
+            }), visible.end());
+            stats.occluded = static_cast<std::uint32_t>(culler->getStats().culled);
+            stats.occlusionSeconds = culler->getStats().seconds;
+            stats.totalOccluded += stats.occluded;
+            stats.totalOcclusionSeconds += stats.occlusionSeconds;
+        }
+
+        // GPU に載っているブロックは使用中の印をつけて描画する
+        drawList.clear();
+        for (const auto &v : visible) {
+            const std::int32_t s(slotOf[v.second]);
+            if (s >= 0) {
+                slots[s].lastUsed = frame;
+                drawList.push_back(v.second);
+            }
+        }
+
+        // 載っていないブロックを画面上で大きいものから転送する
+        // 先読みのスレッドが確かめていないブロックはここでインデックスを確かめる
+        for (const auto &v : visible) {
+            if (stats.uploaded >= uploadLimit) break;
+            if (slotOf[v.second] >= 0 || state[v.second] == broken) continue;
+            if (state[v.second] != prefetched && !validate(v.second)) {
+                state[v.second] = broken;
+                mesh.release(v.second);
+                continue;
+            }
+            Slot *const s(acquire());
+            if (s == nullptr) break;
+            upload(*s, v.second);
+            drawList.push_back(v.second);
+        }
+
+        // カメラの動きを外挿して先読みを要求する
+        Matrix predicted;
+        for (int i = 0; i < 16; ++i) predicted[i] = modelview[i] + (modelview[i] - previous[i]) * lookahead;
+        previous = modelview;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            request = { projection, predicted, height };
+            ++generation;
+        }
+        ready.notify_one();
+
+        stats.drawn = static_cast<std::uint32_t>(drawList.size());
+        stats.resident = 0;
+        for (const auto &s : slots) if (s.block >= 0) ++stats.resident;
+        stats.totalUploaded += stats.uploaded;
+        stats.prefetched = prefetchedBytes;
+        ++stats.frames;
+    }
+
+    // 描画する
+    void draw() const{
+        for (const std::uint32_t i : drawList) {
+            GLState::get().bindVertexArray(slots[slotOf[i]].vao);
+            glDrawElements(GL_TRIANGLES, mesh.getBlock(i).indexCount, GL_UNSIGNED_INT, 0);
+        }
+    }
+
+    // バッファのプールを用意できたかどうか (GPU メモリの上限がブロック一つ分に満たなければ失敗する)
+    explicit operator bool() const { return !slots.empty(); }
+
+    // GPU のバッファのプールの区画数を取り出す
+    std::size_t getSlotCount() const { return slots.size(); }
+
+    // 統計情報を取り出す
+    const Stats &getStats() const { return stats; }
+};
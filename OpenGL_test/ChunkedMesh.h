@@ -0,0 +1,324 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "Object.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+// 空間的にまとまった三角形のブロックに分割したディスク上のメッシュ
+//
+// ファイルの構成
+//   Header
+//   ブロック 0 の頂点 (Object::Vertex) とローカルなインデックス (GLuint)
+//   ブロック 1 ...
+//   Block の配列 (ディレクトリ)
+// 各ブロックの先頭は blockAlignment の倍数の位置に置くので，
+// ブロックごとに独立してページを読み込んだり解放したりできる
+class ChunkedMesh {
+public:
+
+    // ファイルの先頭に置くヘッダ
+    struct Header {
+        // 識別子
+        char magic[8];
+
+        // ブロックの数
+        std::uint32_t blockCount;
+
+        // 一つのブロックに含まれる頂点とインデックスの最大数
+        std::uint32_t maxBlockVertices;
+        std::uint32_t maxBlockIndices;
+
+        // 予約
+        std::uint32_t reserved;
+
+        // メッシュ全体の頂点と三角形の数
+        std::uint64_t vertexCount;
+        std::uint64_t triangleCount;
+
+        // ディレクトリの位置
+        std::uint64_t directoryOffset;
+    };
+
+    // ブロックの情報
+    struct Block {
+        // バウンディングスフィア
+        GLfloat center[3];
+        GLfloat radius;
+
+        // バウンディングボックス
+        GLfloat min[3];
+        GLfloat max[3];
+
+        // ファイル中のデータの位置
+        std::uint64_t offset;
+
+        // 頂点の数とインデックスの要素数
+        std::uint32_t vertexCount;
+        std::uint32_t indexCount;
+
+        // 頂点とインデックスを合わせたバイト数
+        std::size_t bytes() const{
+            return vertexCount * sizeof(Object::Vertex) + indexCount * sizeof(GLuint);
+        }
+    };
+
+    // ファイルの識別子
+    static constexpr char signature[8] = { 'G', 'L', 'C', 'H', 'U', 'N', 'K', '1' };
+
+    // ブロックの境界 (Apple Silicon のページサイズに合わせる)
+    static constexpr std::uint64_t blockAlignment = 16384;
+
+private:
+
+    // マップしたファイル
+    MappedFile file;
+
+    // ヘッダ
+    Header header;
+
+    // ディレクトリ
+    const Block *blocks;
+
+public:
+
+    // コンストラクタ
+    // name : 読み込むファイル名
+    ChunkedMesh(const char *name)
+    : file(name), header(), blocks(nullptr)
+    {
+        if (!file || file.size() < sizeof(Header)) return;
+
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, signature, sizeof signature) != 0
+            || header.directoryOffset > file.size() || header.directoryOffset % alignof(Block) != 0
+            || header.blockCount > (file.size() - header.directoryOffset) / sizeof(Block)) {
+            std::cerr << "Error: Not a chunked mesh: " << name << std::endl;
+            header.blockCount = 0;
+            return;
+        }
+
+        // ディレクトリはファイル中の配列をそのまま参照する
+        // ブロックのデータがファイルの中に収まり，ヘッダの最大数を超えないことを使う前に確かめる
+        const Block *const directory(reinterpret_cast<const Block *>(file.data() + header.directoryOffset));
+        for (std::uint32_t i = 0; i < header.blockCount; ++i) {
+            const Block &b(directory[i]);
+            if (b.offset > file.size() || b.offset % alignof(Object::Vertex) != 0 || b.bytes() > file.size() - b.offset
+                || b.vertexCount > header.maxBlockVertices || b.indexCount > header.maxBlockIndices || b.indexCount % 3 != 0) {
+                std::cerr << "Error: Broken block " << i << " in " << name << std::endl;
+                header.blockCount = 0;
+                return;
+            }
+        }
+        blocks = directory;
+    }
+
+    // 読み込みに成功したかどうか
+    explicit operator bool() const { return blocks != nullptr; }
+
+    // ヘッダを取り出す
+    const Header &getHeader() const { return header; }
+
+    // ブロックの数を取り出す
+    std::uint32_t getBlockCount() const { return header.blockCount; }
+
+    // ブロックの情報を取り出す
+    const Block &getBlock(std::uint32_t i) const { return blocks[i]; }
+
+    // ブロックの頂点を取り出す
+    const Object::Vertex *getVertices(std::uint32_t i) const{
+        return reinterpret_cast<const Object::Vertex *>(file.data() + blocks[i].offset);
+    }
+
+    // ブロックのインデックスを取り出す
+    const GLuint *getIndices(std::uint32_t i) const{
+        return reinterpret_cast<const GLuint *>(getVertices(i) + blocks[i].vertexCount);
+    }
+
+    // ブロックのインデックスがすべてそのブロックの頂点を指しているかどうか
+    // ディレクトリと違ってブロックのページを読み込むので，使う直前に確かめる
+    bool validIndices(std::uint32_t i) const{
+        const GLuint *const index(getIndices(i));
+        const std::uint32_t n(blocks[i].vertexCount);
+        return std::all_of(index, index + blocks[i].indexCount, [n](GLuint k){ return k < n; });
+    }
+
+    // ブロックのデータを先読みする
+    void prefetch(std::uint32_t i) const{
+        file.prefetch(blocks[i].offset, blocks[i].bytes());
+    }
+
+    // ブロックのデータのページを解放する
+    void release(std::uint32_t i) const{
+        file.release(blocks[i].offset, blocks[i].bytes());
+    }
+
+    // メッシュをブロックに分割してファイルに書き出す
+    // mesh : 正規化済みのメッシュ
+    // name : 書き出すファイル名
+    // trianglesPerBlock : 一つのブロックに含める三角形の数
+    static bool write(const Mesh &mesh, const char *name, std::uint32_t trianglesPerBlock = 32768){
+        const std::vector<Eigen::Vector3f> &V(mesh.getVertices());
+        const std::vector<Eigen::Vector3f> &N(mesh.getNormals());
+        const std::vector<Eigen::Vector3i> &F(mesh.getFaces());
+        if (trianglesPerBlock == 0) trianglesPerBlock = 1;
+
+        // メッシュ全体のバウンディングボックス
+        Eigen::Vector3f lower(Eigen::Vector3f::Constant(std::numeric_limits<float>::max()));
+        Eigen::Vector3f upper(-lower);
+        for (const auto &v : V) {
+            lower = lower.cwiseMin(v);
+            upper = upper.cwiseMax(v);
+        }
+        const Eigen::Vector3f extent((upper - lower).cwiseMax(Eigen::Vector3f::Constant(1e-20f)));
+
+        // 三角形の重心のモートン符号で並べ替えて空間的にまとまったブロックを作る
+        std::vector<std::uint64_t> order(F.size());
+        for (std::size_t t = 0; t < F.size(); ++t) {
+            const Eigen::Vector3f c((V[F[t](0)] + V[F[t](1)] + V[F[t](2)]) / 3.0f);
+            const Eigen::Vector3f q(((c - lower).cwiseQuotient(extent) * 1023.0f).cwiseMax(0.0f).cwiseMin(1023.0f));
+            const std::uint64_t code(morton(static_cast<std::uint32_t>(q(0)),
+                                            static_cast<std::uint32_t>(q(1)),
+                                            static_cast<std::uint32_t>(q(2))));
+            order[t] = code << 32 | t;
+        }
+        std::sort(order.begin(), order.end());
+
+        std::ofstream of(name, std::ios::binary);
+        if (of.fail()) {
+            std::cerr << "Error: Can't create file: " << name << std::endl;
+            return false;
+        }
+
+        Header h{};
+        std::memcpy(h.magic, signature, sizeof signature);
+        h.vertexCount = V.size();
+        h.triangleCount = F.size();
+        of.write(reinterpret_cast<const char *>(&h), sizeof h);
+
+        // 元の頂点番号からブロック内の頂点番号への対応
+        std::vector<GLuint> local(V.size(), std::numeric_limits<GLuint>::max());
+        std::vector<GLuint> used;
+        std::vector<Object::Vertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<Block> directory;
+        std::uint64_t position(sizeof h);
+
+        for (std::size_t first = 0; first < order.size(); first += trianglesPerBlock) {
+            const std::size_t last(std::min(order.size(), first + trianglesPerBlock));
+            vertices.clear();
+            indices.clear();
+            used.clear();
+
+            for (std::size_t k = first; k < last; ++k) {
+                const Eigen::Vector3i &f(F[order[k] & 0xffffffffu]);
+                for (int j = 0; j < 3; ++j) {
+                    GLuint &l(local[f(j)]);
+                    if (l == std::numeric_limits<GLuint>::max()) {
+                        l = static_cast<GLuint>(used.size());
+                        used.push_back(f(j));
+                        const Eigen::Vector3f &p(V[f(j)]);
+                        const Eigen::Vector3f n(N.empty() ? Eigen::Vector3f::Zero() : N[f(j)]);
+                        vertices.push_back({ p(0), p(1), p(2), n(0), n(1), n(2) });
+                    }
+                    indices.push_back(l);
+                }
+            }
+
+            // 次のブロックのために対応を戻しておく
+            for (const GLuint v : used) local[v] = std::numeric_limits<GLuint>::max();
+
+            Block b{};
+            b.vertexCount = static_cast<std::uint32_t>(vertices.size());
+            b.indexCount = static_cast<std::uint32_t>(indices.size());
+            bound(vertices, b);
+
+            // ブロックの先頭を境界に揃える
+            const std::uint64_t aligned((position + blockAlignment - 1) / blockAlignment * blockAlignment);
+            pad(of, aligned - position);
+            b.offset = aligned;
+            of.write(reinterpret_cast<const char *>(vertices.data()), vertices.size() * sizeof(Object::Vertex));
+            of.write(reinterpret_cast<const char *>(indices.data()), indices.size() * sizeof(GLuint));
+            position = aligned + b.bytes();
+
+            h.maxBlockVertices = std::max(h.maxBlockVertices, b.vertexCount);
+            h.maxBlockIndices = std::max(h.maxBlockIndices, b.indexCount);
+            directory.push_back(b);
+        }
+
+        // ディレクトリを書き出す
+        const std::uint64_t aligned((position + alignof(Block) - 1) / alignof(Block) * alignof(Block));
+        pad(of, aligned - position);
+        h.directoryOffset = aligned;
+        h.blockCount = static_cast<std::uint32_t>(directory.size());
+        of.write(reinterpret_cast<const char *>(directory.data()), directory.size() * sizeof(Block));
+
+        // ヘッダを書き直す
+        of.seekp(0);
+        of.write(reinterpret_cast<const char *>(&h), sizeof h);
+        of.close();
+
+        if (of.fail()) {
+            std::cerr << "Error: Could not write file: " << name << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 10 ビットの整数の各ビットの間に 2 ビットずつ隙間を空ける
+    static std::uint64_t spread(std::uint32_t x){
+        std::uint64_t v(x & 0x3ff);
+        v = (v | v << 16) & 0x030000ff;
+        v = (v | v << 8) & 0x0300f00f;
+        v = (v | v << 4) & 0x030c30c3;
+        v = (v | v << 2) & 0x09249249;
+        return v;
+    }
+
+    // 三次元のモートン符号 (各座標 10 ビット，点群の並べ替えにも使う)
+    static std::uint64_t morton(std::uint32_t x, std::uint32_t y, std::uint32_t z){
+        return spread(x) | spread(y) << 1 | spread(z) << 2;
+    }
+
+private:
+
+    // ブロックのバウンディングボックスとバウンディングスフィアを求める
+    static void bound(const std::vector<Object::Vertex> &vertices, Block &b){
+        for (int j = 0; j < 3; ++j) {
+            b.min[j] = std::numeric_limits<float>::max();
+            b.max[j] = -std::numeric_limits<float>::max();
+        }
+        for (const auto &v : vertices) {
+            for (int j = 0; j < 3; ++j) {
+                b.min[j] = std::min(b.min[j], v.position[j]);
+                b.max[j] = std::max(b.max[j], v.position[j]);
+            }
+        }
+        for (int j = 0; j < 3; ++j) b.center[j] = (b.min[j] + b.max[j]) * 0.5f;
+
+        float r2(0.0f);
+        for (const auto &v : vertices) {
+            const float dx(v.position[0] - b.center[0]);
+            const float dy(v.position[1] - b.center[1]);
+            const float dz(v.position[2] - b.center[2]);
+            r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+        }
+        b.radius = std::sqrt(r2);
+    }
+
+    // 0 で埋める
+    static void pad(std::ofstream &of, std::uint64_t count){
+        static const char zero[256] = {};
+        while (count > 0) {
+            const std::uint64_t n(std::min<std::uint64_t>(count, sizeof zero));
+            of.write(zero, static_cast<std::streamsize>(n));
+            count -= n;
+        }
+    }
+};
@@ -0,0 +1,720 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <Eigen/Core>
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+// 量子化して予測符号化とエントロピー符号化で圧縮したメッシュ
+//
+// 三角形は頂点キャッシュを活かす順 (optimizeOrder) に並べ，頂点はその順に初めて使うところで番号を付け直す．
+// インデックスは次に初めて使う頂点の番号との差 (0 なら新しい頂点) を，位置はバウンディングボックスの格子に
+// 量子化して，一つ前の三角形と辺を共有していれば平行四辺形で，そうでなければ同じ三角形の既知の頂点から予測した差を，
+// 法線は八面体の平面に写して量子化して同じ三角形の既知の頂点の法線との差を符号化する．
+// 値はビット長を 4 本に交互に振り分けた rANS で，ビット長より下のビットはそのまま書き出す．
+// 三角形を chunkTriangles ずつのチャンクに分け，チャンクごとに独立して並列に復号する
+//
+// ファイルの構成
+//   Header
+//   チャンク 0 の位置・法線・インデックスのストリーム
+//   チャンク 1 ...
+//   Chunk の配列 (ディレクトリ)
+class CompressedMesh {
+public:
+
+    // ファイルの先頭に置くヘッダ
+    struct Header {
+        // 識別子
+        char magic[8];
+
+        // 頂点と三角形の数
+        std::uint64_t vertexCount;
+        std::uint64_t triangleCount;
+
+        // チャンクの数
+        std::uint32_t chunkCount;
+
+        // 位置の各成分と法線の八面体の平面上の各成分の量子化のビット数
+        std::uint8_t positionBits;
+        std::uint8_t normalBits;
+
+        // 法線を持つかどうか
+        std::uint8_t hasNormals;
+
+        // 予約
+        std::uint8_t reserved;
+
+        // 量子化の格子の原点と間隔
+        float lower[3];
+        float step[3];
+
+        // ディレクトリの位置
+        std::uint64_t directoryOffset;
+    };
+
+    // チャンクの情報
+    struct Chunk {
+        // ファイル中のデータの位置とバイト数
+        std::uint64_t offset;
+        std::uint64_t bytes;
+
+        // このチャンクで初めて使う頂点の範囲
+        std::uint32_t firstVertex;
+        std::uint32_t vertexCount;
+
+        // 三角形の範囲
+        std::uint32_t firstTriangle;
+        std::uint32_t triangleCount;
+    };
+
+    // 復号の統計
+    struct Stats {
+        // 圧縮したバイト数と，展開した頂点・法線・インデックスのバイト数
+        std::size_t compressedBytes;
+        std::size_t rawBytes;
+
+        // 復号にかかった時間 (秒，ファイルの読み込みを除く)
+        double seconds;
+    };
+
+    // ファイルの識別子
+    static constexpr char signature[8] = { 'G', 'L', 'M', 'E', 'S', 'H', 'Z', '1' };
+
+    // 一つのチャンクの三角形の数
+    static constexpr std::uint32_t chunkTriangles = 16384;
+
+private:
+
+    // ストリームの先頭に置くヘッダ
+    struct StreamHeader {
+        // rANS の語 (16 ビット) の数と，そのまま書いたビットのバイト数
+        std::uint32_t wordCount;
+        std::uint32_t bitBytes;
+
+        // ビット長ごとの頻度 (合計が probabilityScale)
+        std::uint16_t frequency[33];
+        std::uint16_t reserved;
+    };
+
+    static_assert(sizeof(Header) == 64 && sizeof(Chunk) == 32, "unexpected padding in the file layout");
+    static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float) && sizeof(Eigen::Vector3i) == 3 * sizeof(int),
+                  "vertices and faces must be tightly packed");
+
+    // 値のビット長の種類 (0 から 32)
+    static constexpr int alphabetSize = 33;
+
+    // rANS の確率の精度と状態の下限
+    static constexpr int probabilityBits = 12;
+    static constexpr std::uint32_t probabilityScale = 1u << probabilityBits;
+    static constexpr std::uint32_t stateLower = 1u << 16;
+
+    // 交互に使う rANS の状態の数
+    static constexpr int lanes = 4;
+
+    // ビット長
+    static std::uint32_t bitLength(std::uint32_t u){
+        return static_cast<std::uint32_t>(std::bit_width(u));
+    }
+
+    // 符号付きの差を符号なしの値にする (0, -1, 1, -2, ... を 0, 1, 2, 3, ... にする)
+    static std::uint32_t zigzag(std::int32_t d){
+        return static_cast<std::uint32_t>(d) << 1 ^ static_cast<std::uint32_t>(d >> 31);
+    }
+    static std::int32_t unzigzag(std::uint32_t u){
+        return static_cast<std::int32_t>(u >> 1) ^ -static_cast<std::int32_t>(u & 1);
+    }
+
+    // 値の列を符号化して out に追加する
+    static void encodeStream(const std::vector<std::uint32_t> &values, std::vector<std::uint8_t> &out){
+        // ビット長の頻度を合計が probabilityScale になるように直す (現れるものは 1 以上にする)
+        std::uint32_t count[alphabetSize] = {};
+        for (std::uint32_t v : values) ++count[bitLength(v)];
+        StreamHeader header{};
+        std::uint32_t total(0);
+        int largest(0);
+        for (int s = 0; s < alphabetSize; ++s) {
+            if (count[s] == 0) continue;
+            header.frequency[s] = static_cast<std::uint16_t>(std::max<std::uint64_t>(1, std::uint64_t(count[s]) * probabilityScale / values.size()));
+            total += header.frequency[s];
+            if (count[s] > count[largest]) largest = s;
+        }
+        if (!values.empty()) header.frequency[largest] = static_cast<std::uint16_t>(header.frequency[largest] + probabilityScale - total);
+        std::uint32_t start[alphabetSize + 1] = {};
+        for (int s = 0; s < alphabetSize; ++s) start[s + 1] = start[s] + header.frequency[s];
+
+        // 後ろから rANS で符号化し，最後に並びを逆にする
+        std::vector<std::uint16_t> words;
+        words.reserve(values.size() / 2 + 2 * lanes);
+        std::uint32_t state[lanes];
+        std::fill(state, state + lanes, stateLower);
+        for (std::size_t i = values.size(); i-- > 0; ) {
+            const std::uint32_t s(bitLength(values[i])), f(header.frequency[s]);
+            std::uint32_t &x(state[i % lanes]);
+            if (x >= (std::uint64_t(stateLower >> probabilityBits) << 16) * f) {
+                words.push_back(static_cast<std::uint16_t>(x));
+                x >>= 16;
+            }
+            x = (x / f << probabilityBits) + x % f + start[s];
+        }
+        for (int k = lanes; k-- > 0; ) {
+            words.push_back(static_cast<std::uint16_t>(state[k] >> 16));
+            words.push_back(static_cast<std::uint16_t>(state[k]));
+        }
+        std::reverse(words.begin(), words.end());
+        words.resize((words.size() + 3) / 4 * 4);
+
+        // ビット長より下のビットを前から詰める (最上位のビットは 1 に決まっているので書かない)
+        std::vector<std::uint8_t> bits;
+        std::uint64_t buffer(0);
+        int filled(0);
+        for (std::uint32_t v : values) {
+            const std::uint32_t n(bitLength(v));
+            if (n < 2) continue;
+            buffer |= std::uint64_t(v & ((1u << (n - 1)) - 1)) << filled;
+            filled += n - 1;
+            for (; filled >= 8; filled -= 8, buffer >>= 8) bits.push_back(static_cast<std::uint8_t>(buffer));
+        }
+        if (filled > 0) bits.push_back(static_cast<std::uint8_t>(buffer));
+
+        // 復号で 8 バイトずつ読めるように余白を付けて 8 バイトの倍数にする
+        bits.resize((bits.size() + 8 + 7) / 8 * 8);
+
+        header.wordCount = static_cast<std::uint32_t>(words.size());
+        header.bitBytes = static_cast<std::uint32_t>(bits.size());
+        const std::uint8_t *const h(reinterpret_cast<const std::uint8_t *>(&header));
+        out.insert(out.end(), h, h + sizeof header);
+        const std::uint8_t *const w(reinterpret_cast<const std::uint8_t *>(words.data()));
+        out.insert(out.end(), w, w + words.size() * sizeof(std::uint16_t));
+        out.insert(out.end(), bits.begin(), bits.end());
+    }
+
+    // ストリームを復号して count 個の値を values に書き出す
+    // 戻り値 : 次のストリームの位置 (壊れていれば NULL)
+    static const std::uint8_t *decodeStream(const std::uint8_t *p, const std::uint8_t *end, std::uint32_t *values, std::size_t count){
+        StreamHeader header;
+        if (end - p < static_cast<std::ptrdiff_t>(sizeof header)) return NULL;
+        std::memcpy(&header, p, sizeof header);
+        p += sizeof header;
+        const std::size_t wordBytes(std::size_t(header.wordCount) * sizeof(std::uint16_t));
+        if (static_cast<std::size_t>(end - p) < wordBytes + header.bitBytes || header.bitBytes < 8) return NULL;
+        if (count == 0) return p + wordBytes + header.bitBytes;
+        if (header.wordCount < 2 * lanes) return NULL;
+
+        // 確率の区間の位置から，ビット長・頻度・区間の先頭からの位置を引く表
+        // ビット 0-5 : ビット長，6-17 : 区間の先頭からの位置，18-30 : 頻度
+        std::uint32_t table[probabilityScale];
+        std::uint32_t slot(0);
+        for (int s = 0; s < alphabetSize; ++s)
+            for (std::uint32_t k = 0; k < header.frequency[s] && slot < probabilityScale; ++k)
+                table[slot++] = std::uint32_t(header.frequency[s]) << 18 | k << 6 | static_cast<std::uint32_t>(s);
+        if (slot != probabilityScale) return NULL;
+
+        // 語は 16 ビット単位だが整列しているとは限らないので memcpy で読む
+        const std::uint8_t *word(p);
+        const std::uint8_t *const wordEnd(p + wordBytes);
+        const auto next = [&word]{
+            std::uint16_t w;
+            std::memcpy(&w, word, sizeof w);
+            word += sizeof w;
+            return w;
+        };
+        std::uint32_t state[lanes];
+        for (int k = 0; k < lanes; ++k) {
+            const std::uint32_t low(next());
+            state[k] = low | std::uint32_t(next()) << 16;
+        }
+
+        // 分岐を減らすため，語の補充とビット列の読み出しは常に行って使うかどうかだけを選ぶ
+        // (語の後ろにはビット列が 8 バイト以上あるので，語を読み過ぎても範囲内に収まる)
+        const std::uint8_t *const bits(wordEnd);
+        const std::uint64_t bitLimit((std::uint64_t(header.bitBytes) - 8) * 8);
+        std::uint64_t position(0);
+        const auto decode = [&](std::uint32_t &x){
+            const std::uint32_t e(table[x & (probabilityScale - 1)]);
+            x = (e >> 18) * (x >> probabilityBits) + (e >> 6 & (probabilityScale - 1));
+            std::uint16_t w;
+            std::memcpy(&w, word, sizeof w);
+            const bool refill(x < stateLower);
+            x = refill ? x << 16 | w : x;
+            word += refill ? sizeof w : 0;
+
+            const std::uint32_t n(e & 63), extra(n - (n > 0));
+            std::uint64_t buffer;
+            std::memcpy(&buffer, bits + (position >> 3), sizeof buffer);
+            const std::uint32_t low(static_cast<std::uint32_t>(buffer >> (position & 7)) & ((1u << extra) - 1));
+            position += extra;
+            return (n > 0 ? 1u << extra : 0u) | low;
+        };
+        std::size_t i(0);
+        for (; i + lanes <= count; i += lanes) {
+            values[i] = decode(state[0]);
+            values[i + 1] = decode(state[1]);
+            values[i + 2] = decode(state[2]);
+            values[i + 3] = decode(state[3]);
+            if (word > wordEnd || position > bitLimit) return NULL;
+        }
+        for (; i < count; ++i) values[i] = decode(state[i % lanes]);
+        if (word > wordEnd || position > bitLimit) return NULL;
+        return wordEnd + header.bitBytes;
+    }
+
+    // 八面体の平面上の点 (各成分 [-1, 1]) を単位ベクトルに戻す
+    static Eigen::Vector3f octDecode(float x, float y){
+        const float z(1.0f - std::abs(x) - std::abs(y)), t(std::max(-z, 0.0f));
+        const Eigen::Vector3f n(x + (x >= 0.0f ? -t : t), y + (y >= 0.0f ? -t : t), z);
+        return n.normalized();
+    }
+
+    // 単位ベクトルを八面体の平面に写して量子化する (四つの格子点のうち最も向きの近いものを選ぶ)
+    static void octEncode(const Eigen::Vector3f &n, int bits, std::uint32_t q[2]){
+        const float scale(static_cast<float>((1u << bits) - 1));
+        const float l1(std::abs(n(0)) + std::abs(n(1)) + std::abs(n(2)));
+        float x(l1 > 0.0f ? n(0) / l1 : 0.0f), y(l1 > 0.0f ? n(1) / l1 : 0.0f);
+        if (l1 > 0.0f && n(2) < 0.0f) {
+            const float u((1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f));
+            const float v((1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f));
+            x = u;
+            y = v;
+        }
+        const float fx((x * 0.5f + 0.5f) * scale), fy((y * 0.5f + 0.5f) * scale);
+        float best(-2.0f);
+        for (int k = 0; k < 4; ++k) {
+            const float cx(std::min(k & 1 ? std::ceil(fx) : std::floor(fx), scale));
+            const float cy(std::min(k & 2 ? std::ceil(fy) : std::floor(fy), scale));
+            const float d(octDecode(cx / scale * 2.0f - 1.0f, cy / scale * 2.0f - 1.0f).dot(n));
+            if (d > best) {
+                best = d;
+                q[0] = static_cast<std::uint32_t>(cx);
+                q[1] = static_cast<std::uint32_t>(cy);
+            }
+        }
+    }
+
+    // チャンクの三角形を順にたどり，初めて使う頂点ごとに予測に使う頂点を渡す
+    // F : 番号を付け直した三角形
+    // visit(v, a, b, c) : v が初めて使う頂点，a, b は同じ三角形の復号済みの頂点，
+    //                     c は a, b を共有する一つ前の三角形の残りの頂点 (それぞれ使えなければ -1)
+    // 予測には同じチャンクの頂点だけを使うので，チャンクは独立して復号できる
+    template <typename Visit>
+    static void walk(const Eigen::Vector3i *F, const Chunk &chunk, Visit visit){
+        const std::int64_t first(chunk.firstVertex);
+        std::int64_t next(first);
+        const Eigen::Vector3i *previous(NULL);
+        for (std::uint32_t t = 0; t < chunk.triangleCount; ++t) {
+            const Eigen::Vector3i &f(F[chunk.firstTriangle + t]);
+            for (int k = 0; k < 3; ++k) {
+                if (f(k) != next) continue;
+                std::int64_t known[2] = { -1, -1 };
+                int n(0);
+                for (int j = 1; j < 3; ++j) {
+                    const std::int64_t u(f((k + j) % 3));
+                    if (u >= first && u < next) known[n++] = u;
+                }
+                std::int64_t c(-1);
+                if (n == 2 && previous) {
+                    int shared(0);
+                    for (int j = 0; j < 3; ++j) {
+                        if ((*previous)(j) == known[0] || (*previous)(j) == known[1]) ++shared;
+                        else c = (*previous)(j);
+                    }
+                    if (shared != 2 || c < first) c = -1;
+                }
+                visit(next++, known[0], known[1], c);
+            }
+            previous = &f;
+        }
+        for (; next < first + chunk.vertexCount; ++next) visit(next, -1, -1, -1);
+    }
+
+    // 予測した格子の番号 (q は頂点ごとに dimension 個の成分，チャンクの先頭の頂点からの並び)
+    static std::int32_t predict(const std::int32_t *q, int dimension, int j, std::int64_t v, std::int64_t a, std::int64_t b, std::int64_t c,
+                                std::int32_t levels){
+        if (c >= 0) return std::clamp(q[a * dimension + j] + q[b * dimension + j] - q[c * dimension + j], 0, levels);
+        if (b >= 0) return (q[a * dimension + j] + q[b * dimension + j]) >> 1;
+        if (a >= 0) return q[a * dimension + j];
+        return v > 0 ? q[(v - 1) * dimension + j] : 0;
+    }
+
+    // 一つのチャンクを復号する
+    // 戻り値 : 壊れていなければ true
+    static bool decodeChunk(const Header &header, const Chunk &chunk, const std::uint8_t *p, const std::uint8_t *end,
+                            Eigen::Vector3f *V, Eigen::Vector3f *N, Eigen::Vector3i *F){
+        const std::size_t nv(chunk.vertexCount), nt(chunk.triangleCount);
+        std::vector<std::uint32_t> values(std::max(nv * 3, nt * 3));
+
+        // インデックスは 0 なら新しい頂点，それ以外は次に初めて使う頂点の番号との差
+        if (!(p = decodeStream(p, end, values.data(), nt * 3))) return false;
+        std::uint32_t next(chunk.firstVertex);
+        bool valid(true);
+        int *const index(reinterpret_cast<int *>(F + chunk.firstTriangle));
+        for (std::size_t k = 0; k < nt * 3; ++k) {
+            const std::uint32_t c(values[k]);
+            valid &= c <= next;
+            index[k] = static_cast<int>(next - c);
+            next += c == 0;
+        }
+        if (!valid || next > std::uint64_t(chunk.firstVertex) + chunk.vertexCount) return false;
+
+        // 位置と法線は三角形をたどって予測との差から格子の番号に戻す
+        std::vector<std::uint32_t> normalValues(header.hasNormals ? nv * 2 : 0);
+        if (!(p = decodeStream(p, end, values.data(), nv * 3))) return false;
+        if (header.hasNormals && !(p = decodeStream(p, end, normalValues.data(), nv * 2))) return false;
+        const std::int32_t levels(static_cast<std::int32_t>((1u << header.positionBits) - 1));
+        const std::int32_t normalLevels(static_cast<std::int32_t>((1u << header.normalBits) - 1));
+        std::vector<std::int32_t> q(nv * 3), o(normalValues.size());
+        const std::int64_t first(chunk.firstVertex);
+        walk(F, chunk, [&](std::int64_t v, std::int64_t a, std::int64_t b, std::int64_t c){
+            v -= first, a -= a >= 0 ? first : 0, b -= b >= 0 ? first : 0, c -= c >= 0 ? first : 0;
+            for (int j = 0; j < 3; ++j) q[v * 3 + j] = predict(q.data(), 3, j, v, a, b, c, levels) + unzigzag(values[v * 3 + j]);
+            if (o.empty()) return;
+            for (int j = 0; j < 2; ++j) o[v * 2 + j] = predict(o.data(), 2, j, v, a, b, -1, normalLevels) + unzigzag(normalValues[v * 2 + j]);
+        });
+
+        // 位置は SIMD で 4 頂点 (12 成分) ずつ格子の座標に直す
+        float *const position(reinterpret_cast<float *>(V + chunk.firstVertex));
+        for (std::size_t i = 0; i < nv * 3; ++i) position[i] = static_cast<float>(q[i]);
+        const float *const lower(header.lower), *const step(header.step);
+        const Float4 l0(lower[0], lower[1], lower[2], lower[0]), s0(step[0], step[1], step[2], step[0]);
+        const Float4 l1(lower[1], lower[2], lower[0], lower[1]), s1(step[1], step[2], step[0], step[1]);
+        const Float4 l2(lower[2], lower[0], lower[1], lower[2]), s2(step[2], step[0], step[1], step[2]);
+        std::size_t i(0);
+        for (; i + 12 <= nv * 3; i += 12) {
+            (l0 + Float4::load(position + i) * s0).store(position + i);
+            (l1 + Float4::load(position + i + 4) * s1).store(position + i + 4);
+            (l2 + Float4::load(position + i + 8) * s2).store(position + i + 8);
+        }
+        for (; i < nv * 3; ++i) position[i] = lower[i % 3] + position[i] * step[i % 3];
+
+        // 法線は八面体の平面上の座標から SIMD で 4 本ずつ単位ベクトルに直す
+        if (header.hasNormals) {
+            const float scale(2.0f / static_cast<float>(normalLevels));
+            std::vector<float> u(nv + 3), w(nv + 3);
+            for (std::size_t k = 0; k < nv; ++k) {
+                u[k] = o[2 * k] * scale - 1.0f;
+                w[k] = o[2 * k + 1] * scale - 1.0f;
+            }
+            const Float4 zero(0.0f), one(1.0f);
+            for (std::size_t k = 0; k < nv; k += 4) {
+                Float4 x(Float4::load(&u[k])), y(Float4::load(&w[k]));
+                const Float4 z(one - max(x, zero - x) - max(y, zero - y)), t(max(zero - z, zero));
+                x = x + select(x >= zero, zero - t, t);
+                y = y + select(y >= zero, zero - t, t);
+                const Float4 r(one / sqrt(x * x + y * y + z * z));
+                float nx[4], ny[4], nz[4];
+                (x * r).store(nx);
+                (y * r).store(ny);
+                (z * r).store(nz);
+                for (std::size_t j = 0; j < 4 && k + j < nv; ++j) N[chunk.firstVertex + k + j] = Eigen::Vector3f(nx[j], ny[j], nz[j]);
+            }
+        }
+        return true;
+    }
+
+public:
+
+    // 頂点キャッシュを活かす三角形の順番を求める (Tipsify)
+    // 描いた三角形の頂点の周りの三角形を続けて描き，次の中心はキャッシュに残っていそうな頂点から選ぶ．
+    // 続く三角形が頂点と辺を共有するので，インデックスは最近使った頂点を指す小さな差に集まる
+    // F : 三角形
+    // vertexCount : 頂点の数
+    // cacheSize : 想定する頂点キャッシュの大きさ
+    // 戻り値 : 元の三角形の番号を並べ替えた順に並べたもの
+    static std::vector<std::uint32_t> optimizeOrder(const std::vector<Eigen::Vector3i> &F, std::size_t vertexCount, int cacheSize = 16){
+        // 頂点ごとに使っている三角形
+        std::vector<std::uint32_t> offset(vertexCount + 1, 0), around(F.size() * 3);
+        for (const auto &f : F) for (int k = 0; k < 3; ++k) ++offset[f(k) + 1];
+        for (std::size_t v = 0; v < vertexCount; ++v) offset[v + 1] += offset[v];
+        std::vector<std::uint32_t> live(vertexCount), fill(offset.begin(), offset.end() - 1);
+        for (std::size_t t = 0; t < F.size(); ++t)
+            for (int k = 0; k < 3; ++k) around[fill[F[t](k)]++] = static_cast<std::uint32_t>(t);
+        for (std::size_t v = 0; v < vertexCount; ++v) live[v] = offset[v + 1] - offset[v];
+
+        std::vector<std::uint32_t> order;
+        order.reserve(F.size());
+        std::vector<std::int64_t> stamp(vertexCount, 0);
+        std::vector<bool> emitted(F.size(), false);
+        std::vector<std::uint32_t> deadEnd, candidates;
+        std::int64_t time(cacheSize + 1);
+        std::size_t cursor(0);
+        std::int64_t fan(vertexCount > 0 ? 0 : -1);
+        while (fan >= 0) {
+            // 中心の頂点の周りの三角形をすべて描く
+            candidates.clear();
+            for (std::uint32_t k = offset[fan]; k < offset[fan + 1]; ++k) {
+                const std::uint32_t t(around[k]);
+                if (emitted[t]) continue;
+                emitted[t] = true;
+                order.push_back(t);
+                for (int j = 0; j < 3; ++j) {
+                    const std::uint32_t v(static_cast<std::uint32_t>(F[t](j)));
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (time - stamp[v] > cacheSize) stamp[v] = time++;
+                }
+            }
+
+            // 描いた頂点のうち，残りの三角形を描いてもキャッシュに残っているものの中で最も古いものを次の中心にする
+            fan = -1;
+            std::int64_t best(-1);
+            for (std::uint32_t v : candidates) {
+                if (live[v] == 0) continue;
+                const std::int64_t age(time - stamp[v]);
+                const std::int64_t priority(age + 2 * live[v] <= cacheSize ? age : 0);
+                if (priority > best) {
+                    best = priority;
+                    fan = v;
+                }
+            }
+
+            // 行き詰まったら最近描いた頂点か，番号の順に残っている頂点に移る
+            while (fan < 0 && !deadEnd.empty()) {
+                const std::uint32_t v(deadEnd.back());
+                deadEnd.pop_back();
+                if (live[v] > 0) fan = v;
+            }
+            while (fan < 0 && cursor < vertexCount) {
+                if (live[cursor] > 0) fan = static_cast<std::int64_t>(cursor);
+                ++cursor;
+            }
+        }
+        return order;
+    }
+
+    // 圧縮して書き出す
+    // 三角形は optimizeOrder() の順に並べ替え，頂点は三角形が初めて使う順に番号を付け直して書き出す
+    // name : 書き出すファイル名
+    // V, F, N : 正規化した頂点，三角形，頂点の法線 (なければ空)
+    // positionBits : 位置の各成分の量子化のビット数
+    // normalBits : 法線の八面体の平面上の各成分の量子化のビット数
+    static bool write(const char *name, const std::vector<Eigen::Vector3f> &V, const std::vector<Eigen::Vector3i> &F,
+                      const std::vector<Eigen::Vector3f> &N, int positionBits = 16, int normalBits = 12){
+        if (V.size() > std::numeric_limits<std::int32_t>::max()) {
+            std::cerr << "Error: Too many vertices: " << name << std::endl;
+            return false;
+        }
+        for (const auto &f : F) {
+            if (f.minCoeff() < 0 || static_cast<std::size_t>(f.maxCoeff()) >= V.size()) {
+                std::cerr << "Error: Bad vertex index: " << name << std::endl;
+                return false;
+            }
+        }
+        positionBits = std::clamp(positionBits, 1, 24);
+        normalBits = std::clamp(normalBits, 2, 16);
+        const bool hasNormals(N.size() == V.size() && !V.empty());
+
+        // 三角形を並べ替え，初めて使う順に頂点の番号を付け直す (使われない頂点は最後に回す)
+        const std::vector<std::uint32_t> triangleOrder(optimizeOrder(F, V.size()));
+        std::vector<std::int32_t> remap(V.size(), -1);
+        std::vector<std::uint32_t> order;
+        order.reserve(V.size());
+        std::vector<Eigen::Vector3i> R(F.size());
+        std::vector<std::uint32_t> chunkEnd;
+        for (std::size_t t = 0; t < F.size(); ++t) {
+            for (int k = 0; k < 3; ++k) {
+                const int i(F[triangleOrder[t]](k));
+                if (remap[i] < 0) {
+                    remap[i] = static_cast<std::int32_t>(order.size());
+                    order.push_back(static_cast<std::uint32_t>(i));
+                }
+                R[t](k) = remap[i];
+            }
+            if ((t + 1) % chunkTriangles == 0) chunkEnd.push_back(static_cast<std::uint32_t>(order.size()));
+        }
+        for (std::size_t i = 0; i < V.size(); ++i) {
+            if (remap[i] < 0) {
+                remap[i] = static_cast<std::int32_t>(order.size());
+                order.push_back(static_cast<std::uint32_t>(i));
+            }
+        }
+
+        // 量子化の格子
+        Header header{};
+        std::memcpy(header.magic, signature, sizeof signature);
+        header.vertexCount = V.size();
+        header.triangleCount = F.size();
+        header.positionBits = static_cast<std::uint8_t>(positionBits);
+        header.normalBits = static_cast<std::uint8_t>(normalBits);
+        header.hasNormals = hasNormals;
+        Eigen::Vector3f lower(Eigen::Vector3f::Zero()), upper(Eigen::Vector3f::Zero());
+        if (!V.empty()) {
+            lower = upper = V[0];
+            for (const auto &v : V) {
+                lower = lower.cwiseMin(v);
+                upper = upper.cwiseMax(v);
+            }
+        }
+        const std::int32_t levels(static_cast<std::int32_t>((1u << positionBits) - 1));
+        const std::int32_t normalLevels(static_cast<std::int32_t>((1u << normalBits) - 1));
+        for (int c = 0; c < 3; ++c) {
+            header.lower[c] = lower(c);
+            header.step[c] = std::max(upper(c) - lower(c), 1e-20f) / static_cast<float>(levels);
+        }
+
+        std::ofstream of(name, std::ios::binary);
+        if (of.fail()) {
+            std::cerr << "Error: Can't create file: " << name << std::endl;
+            return false;
+        }
+        of.write(reinterpret_cast<const char *>(&header), sizeof header);
+
+        // チャンクごとに符号化する (頂点は三角形の範囲で初めて使うもの，最後のチャンクは残りすべて)
+        const std::size_t chunkCount(std::max<std::size_t>(1, (F.size() + chunkTriangles - 1) / chunkTriangles));
+        std::vector<Chunk> directory(chunkCount);
+        std::vector<std::vector<std::uint8_t>> data(chunkCount);
+        parallelFor(0, chunkCount, [&](std::size_t first, std::size_t last){
+            std::vector<std::uint32_t> values;
+            std::vector<std::int32_t> q;
+            for (std::size_t c = first; c < last; ++c) {
+                Chunk &chunk(directory[c]);
+                chunk.firstVertex = c == 0 ? 0 : chunkEnd[c - 1];
+                chunk.vertexCount = static_cast<std::uint32_t>((c + 1 < chunkCount ? chunkEnd[c] : order.size()) - chunk.firstVertex);
+                chunk.firstTriangle = static_cast<std::uint32_t>(c * chunkTriangles);
+                chunk.triangleCount = static_cast<std::uint32_t>(std::min<std::size_t>(chunkTriangles, F.size() - chunk.firstTriangle));
+                const std::int64_t base(chunk.firstVertex);
+
+                values.clear();
+                std::uint32_t next(chunk.firstVertex);
+                for (std::uint32_t t = 0; t < chunk.triangleCount; ++t) {
+                    for (int k = 0; k < 3; ++k) {
+                        const std::uint32_t i(static_cast<std::uint32_t>(R[chunk.firstTriangle + t](k)));
+                        values.push_back(i == next ? 0 : next - i);
+                        if (i == next) ++next;
+                    }
+                }
+                encodeStream(values, data[c]);
+
+                // 位置と法線は復号と同じ順に頂点をたどって予測との差を書く
+                q.resize(std::size_t(chunk.vertexCount) * 3);
+                for (std::uint32_t k = 0; k < chunk.vertexCount; ++k) {
+                    const Eigen::Vector3f &v(V[order[chunk.firstVertex + k]]);
+                    for (int j = 0; j < 3; ++j)
+                        q[k * 3 + j] = static_cast<std::int32_t>(std::clamp(std::round((v(j) - header.lower[j]) / header.step[j]), 0.0f, static_cast<float>(levels)));
+                }
+                values.assign(q.size(), 0);
+                walk(R.data(), chunk, [&](std::int64_t v, std::int64_t a, std::int64_t b, std::int64_t c){
+                    v -= base, a -= a >= 0 ? base : 0, b -= b >= 0 ? base : 0, c -= c >= 0 ? base : 0;
+                    for (int j = 0; j < 3; ++j) values[v * 3 + j] = zigzag(q[v * 3 + j] - predict(q.data(), 3, j, v, a, b, c, levels));
+                });
+                encodeStream(values, data[c]);
+
+                if (hasNormals) {
+                    q.resize(std::size_t(chunk.vertexCount) * 2);
+                    for (std::uint32_t k = 0; k < chunk.vertexCount; ++k) {
+                        std::uint32_t o[2];
+                        octEncode(N[order[chunk.firstVertex + k]], normalBits, o);
+                        q[k * 2] = static_cast<std::int32_t>(o[0]);
+                        q[k * 2 + 1] = static_cast<std::int32_t>(o[1]);
+                    }
+                    values.assign(q.size(), 0);
+                    walk(R.data(), chunk, [&](std::int64_t v, std::int64_t a, std::int64_t b, std::int64_t){
+                        v -= base, a -= a >= 0 ? base : 0, b -= b >= 0 ? base : 0;
+                        for (int j = 0; j < 2; ++j) values[v * 2 + j] = zigzag(q[v * 2 + j] - predict(q.data(), 2, j, v, a, b, -1, normalLevels));
+                    });
+                    encodeStream(values, data[c]);
+                }
+            }
+        });
+
+        std::uint64_t offset(sizeof header);
+        for (std::size_t c = 0; c < chunkCount; ++c) {
+            directory[c].offset = offset;
+            directory[c].bytes = data[c].size();
+            of.write(reinterpret_cast<const char *>(data[c].data()), static_cast<std::streamsize>(data[c].size()));
+            offset += data[c].size();
+        }
+        header.chunkCount = static_cast<std::uint32_t>(chunkCount);
+        header.directoryOffset = offset;
+        of.write(reinterpret_cast<const char *>(directory.data()), static_cast<std::streamsize>(chunkCount * sizeof(Chunk)));
+        of.seekp(0);
+        of.write(reinterpret_cast<const char *>(&header), sizeof header);
+        of.close();
+
+        if (of.fail()) {
+            std::cerr << "Error: Could not write file: " << name << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 読み込んで展開する
+    // name : write() で書き出したファイル名
+    // V, F, N : 展開した頂点，三角形，頂点の法線 (法線がなければ空)
+    // stats : 復号の統計 (NULL なら求めない)
+    static bool read(const char *name, std::vector<Eigen::Vector3f> &V, std::vector<Eigen::Vector3i> &F,
+                     std::vector<Eigen::Vector3f> &N, Stats *stats = NULL){
+        MappedFile file(name);
+        if (!file || file.size() < sizeof(Header)) return false;
+
+        Header header;
+        std::memcpy(&header, file.data(), sizeof header);
+        if (std::memcmp(header.magic, signature, sizeof signature) != 0
+            || header.directoryOffset > file.size()
+            || std::uint64_t(header.chunkCount) * sizeof(Chunk) > file.size() - header.directoryOffset
+            || header.vertexCount > std::numeric_limits<std::int32_t>::max()
+            || header.triangleCount > std::uint64_t(header.chunkCount) * chunkTriangles
+            || header.positionBits < 1 || header.positionBits > 24
+            || header.normalBits < 2 || header.normalBits > 16) {
+            std::cerr << "Error: Not a compressed mesh: " << name << std::endl;
+            return false;
+        }
+        std::vector<Chunk> directory(header.chunkCount);
+        std::memcpy(directory.data(), file.data() + header.directoryOffset, directory.size() * sizeof(Chunk));
+        // チャンクは並列に同じ配列へ展開するので，頂点と三角形の範囲が重なっていてはいけない
+        const auto disjoint = [&](auto first, auto count){
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+            ranges.reserve(directory.size());
+            for (const Chunk &chunk : directory) if (chunk.*count > 0) ranges.emplace_back(chunk.*first, chunk.*first + chunk.*count);
+            std::sort(ranges.begin(), ranges.end());
+            for (std::size_t k = 1; k < ranges.size(); ++k) if (ranges[k].first < ranges[k - 1].second) return false;
+            return true;
+        };
+        for (const Chunk &chunk : directory) {
+            if (chunk.bytes > header.directoryOffset || chunk.offset > header.directoryOffset - chunk.bytes
+                || std::uint64_t(chunk.firstVertex) + chunk.vertexCount > header.vertexCount
+                || std::uint64_t(chunk.firstTriangle) + chunk.triangleCount > header.triangleCount) {
+                std::cerr << "Error: Broken compressed mesh: " << name << std::endl;
+                return false;
+            }
+        }
+        if (!disjoint(&Chunk::firstVertex, &Chunk::vertexCount) || !disjoint(&Chunk::firstTriangle, &Chunk::triangleCount)) {
+            std::cerr << "Error: Broken compressed mesh: " << name << std::endl;
+            return false;
+        }
+
+        // 展開先を確保して，チャンクごとに並列に復号する
+        const auto start(std::chrono::steady_clock::now());
+        V.resize(header.vertexCount);
+        N.resize(header.hasNormals ? header.vertexCount : 0);
+        F.resize(header.triangleCount);
+        std::atomic<bool> valid(true);
+        parallelFor(0, directory.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t c = first; c < last; ++c) {
+                const std::uint8_t *const p(file.data() + directory[c].offset);
+                if (!decodeChunk(header, directory[c], p, p + directory[c].bytes, V.data(), N.data(), F.data())) valid = false;
+            }
+        });
+        if (!valid) {
+            std::cerr << "Error: Broken compressed mesh: " << name << std::endl;
+            return false;
+        }
+
+        if (stats) {
+            stats->compressedBytes = file.size();
+            stats->rawBytes = (V.size() + N.size()) * sizeof(Eigen::Vector3f) + F.size() * sizeof(Eigen::Vector3i);
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return true;
+    }
+};
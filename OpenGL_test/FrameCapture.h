@@ -0,0 +1,420 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include "GLState.h"
+#include "JobSystem.h"
+
+// フレームの画像を描画を止めずに書き出す
+//
+// 読み出しはピクセルバッファオブジェクトに非同期に行い，フェンスで完了が分かったものから取り出す．
+// 使い回すバッファがすべて読み出し中のときだけ最も古いものを待つので，結果はおおむね数フレーム後に受け取る．
+// 取り出した画像は書き出しのスレッドプールで上下を反転して RGB にし，PNG ファイルにするか，
+// 外部のエンコーダのプロセスの標準入力にフレームの順に生の RGB を流す
+class FrameCapture {
+public:
+
+    // 統計情報
+    struct Stats {
+        // 書き出したフレームの数
+        std::size_t frames;
+
+        // 書き出したバイト数
+        std::size_t bytes;
+
+        // 最初の読み出しから最後の書き出しまでの時間 (秒)
+        double seconds;
+
+        // 読み出しの完了を待って CPU が止まっていた時間 (秒)
+        double waitSeconds;
+
+        // 書き出しのスレッドでの処理時間の合計 (秒)
+        double writeSeconds;
+    };
+
+    // 使い回すピクセルバッファオブジェクトの数
+    static constexpr int ringSize = 4;
+
+private:
+
+    // 読み出し中のフレーム
+    struct Slot {
+        // ピクセルバッファオブジェクト名
+        GLuint pbo;
+
+        // 読み出しの完了を待つフェンス
+        GLsync fence;
+
+        // 書き出すフレームの番号 (読み出していなければ -1)
+        long frame;
+    };
+
+    // 画像のサイズ
+    const GLsizei width, height;
+
+    // 書き出すファイル名の書式 (フレームの番号を printf の書式で埋め込む，パイプに流すなら空)
+    const std::string pattern;
+
+    // 生の RGB を流すエンコーダのプロセス (ファイルに書き出すなら NULL)
+    FILE *pipe;
+
+    // エンコーダが終了してパイプに書けなくなったら true
+    bool broken;
+
+    // ピクセルバッファオブジェクト
+    Slot slots[ringSize];
+
+    // 次に使うピクセルバッファオブジェクト
+    int next;
+
+    // 次に読み出すフレームの番号
+    long captured;
+
+    // 書き出しのスレッドプールと書き出し中の仕事
+    JobSystem writers;
+    JobSystem::Counter writing;
+
+    // 書き出し中の画像の数と，その上限 (これを超えたら書き出しを待ってメモリを抑える)
+    // パイプに流すときは順番を待っている画像も数えるので，ordered もこの上限を超えない
+    int inflight;
+    const int maxInflight;
+    std::mutex inflightMutex;
+    std::condition_variable written;
+
+    // パイプに流す順番を待っている画像と，次に流すフレームの番号
+    std::map<long, std::shared_ptr<std::vector<std::uint8_t>>> ordered;
+    long nextPiped;
+    std::mutex pipeMutex;
+
+    // 統計情報 (書き出しのスレッドからも加える)
+    Stats stats;
+    std::mutex statsMutex;
+
+    // 最初の読み出しの時刻
+    std::chrono::steady_clock::time_point start;
+
+public:
+
+    // コンストラクタ
+    // width, height : 画像のサイズ
+    // pattern : 書き出すファイル名の書式 (例 "frame%05d.png"，NULL ならパイプに流す)
+    // command : 生の RGB を標準入力から読むエンコーダのコマンド (pattern が NULL のときに使う)
+    // threads : 書き出しのスレッドの数
+    FrameCapture(GLsizei width, GLsizei height, const char *pattern, const char *command, unsigned int threads = threadCount())
+    : width(width)
+    , height(height)
+    , pattern(pattern && validPattern(pattern) ? pattern : "")
+    , pipe(NULL)
+    , broken(false)
+    , next(0)
+    , captured(0)
+    , writers(std::max(threads, 1u) + 1)
+    , inflight(0)
+    , maxInflight(static_cast<int>(std::max(threads, 1u)) * 2)
+    , nextPiped(0)
+    , stats()
+    {
+        if (pattern && this->pattern.empty()) {
+            std::cerr << "Error: The file name pattern needs exactly one integer conversion like %05d: " << pattern << std::endl;
+        }
+        else if (!pattern && command) {
+            // エンコーダが先に終了してもシグナルで止まらずに書き込みのエラーとして受け取る
+            std::signal(SIGPIPE, SIG_IGN);
+            pipe = popen(command, "w");
+            if (!pipe) std::cerr << "Error: Can't start encoder: " << command << std::endl;
+        }
+
+        for (Slot &s : slots) {
+            glGenBuffers(1, &s.pbo);
+            GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 4, NULL, GL_STREAM_READ);
+            s.fence = 0;
+            s.frame = -1;
+        }
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // デストラクタ
+    virtual ~FrameCapture(){
+        finish();
+        for (Slot &s : slots) GLState::get().deleteBuffers(1, &s.pbo);
+        if (pipe) pclose(pipe);
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    FrameCapture(const FrameCapture &c);
+
+    // 代入によるコピー禁止
+    FrameCapture &operator=(const FrameCapture &c);
+
+    // ファイル名の書式がフレームの番号を埋め込む整数の変換をちょうど一つだけ含むかどうか
+    // pattern : 書き出すファイル名の書式 (snprintf に int をひとつ渡して使う)
+    static bool validPattern(const char *pattern){
+        int conversions(0);
+        for (const char *p = pattern; *p; ++p) {
+            if (*p != '%') continue;
+            if (*++p == '%') continue;
+            while (*p && std::strchr("-+ #0", *p)) ++p;
+            while (*p >= '0' && *p <= '9') ++p;
+            if (*p == '.') for (++p; *p >= '0' && *p <= '9'; ++p) {}
+            if (!*p || !std::strchr("diouxX", *p)) return false;
+            ++conversions;
+        }
+        return conversions == 1;
+    }
+
+    // 読み出しの終わったフレームを取り出して書き出しに回す
+    // wait : 読み出しが終わっていなければ待つなら true
+    // 戻り値 : 取り出したら true
+    bool retire(Slot &s, bool wait){
+        if (s.frame < 0) return false;
+        if (s.fence) {
+            const auto waitStart(std::chrono::steady_clock::now());
+            const GLenum result(glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0));
+            stats.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+            if (result == GL_TIMEOUT_EXPIRED) return false;
+            glDeleteSync(s.fence);
+            s.fence = 0;
+        }
+
+        // 書き出しが追いつくまで待ってメモリを抑える
+        {
+            const auto waitStart(std::chrono::steady_clock::now());
+            std::unique_lock<std::mutex> lock(inflightMutex);
+            written.wait(lock, [this]{ return inflight < maxInflight; });
+            ++inflight;
+            stats.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+        }
+
+        // 書き出しのスレッドに渡すために写す
+        const std::size_t bytes(static_cast<std::size_t>(width) * height * 4);
+        std::shared_ptr<std::vector<std::uint8_t>> image(new std::vector<std::uint8_t>(bytes));
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+        if (const void *const p = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), GL_MAP_READ_BIT)) {
+            std::memcpy(image->data(), p, bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        const long frame(s.frame);
+        s.frame = -1;
+        writers.submit("capture", [this, image, frame]{ write(image, frame); }, writing);
+        return true;
+    }
+
+    // 画像を RGB に直して書き出す (書き出しのスレッドで実行する)
+    void write(std::shared_ptr<std::vector<std::uint8_t>> image, long frame){
+        const auto writeStart(std::chrono::steady_clock::now());
+
+        // 下の行から並んだ RGBA を上の行からの RGB にする
+        std::vector<std::uint8_t> &pixels(*image);
+        const std::size_t row(static_cast<std::size_t>(width) * 3);
+        std::vector<std::uint8_t> rgb(row * height);
+        for (GLsizei y = 0; y < height; ++y) {
+            const std::uint8_t *src(pixels.data() + static_cast<std::size_t>(height - 1 - y) * width * 4);
+            std::uint8_t *dst(rgb.data() + y * row);
+            for (GLsizei x = 0; x < width; ++x, src += 4, dst += 3) {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+            }
+        }
+        rgb.swap(pixels);
+        pixels.resize(row * height);
+
+        std::size_t bytes(0), frames(1);
+        int released(1);
+        if (pipe) {
+            // フレームの順に流す (順番を待つ画像は流すまで書き出し中に数える)
+            std::lock_guard<std::mutex> lock(pipeMutex);
+            ordered[frame] = image;
+            released = 0;
+            frames = 0;
+            for (auto i = ordered.begin(); i != ordered.end() && i->first == nextPiped; i = ordered.erase(i), ++nextPiped, ++released) {
+                if (broken) continue;
+                if (std::fwrite(i->second->data(), 1, i->second->size(), pipe) == i->second->size()) {
+                    bytes += i->second->size();
+                    ++frames;
+                }
+                else {
+                    std::cerr << "Error: The encoder stopped reading frame " << i->first << std::endl;
+                    broken = true;
+                }
+            }
+        }
+        else {
+            std::vector<char> name(pattern.size() + 32);
+            std::snprintf(name.data(), name.size(), pattern.c_str(), static_cast<int>(frame));
+            std::ofstream file(name.data(), std::ios::binary);
+            if (file) bytes = writePng(file, width, height, pixels.data());
+            else std::cerr << "Error: Can't create file: " << name.data() << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.frames += frames;
+            stats.bytes += bytes;
+            stats.writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - writeStart).count();
+        }
+        {
+            std::lock_guard<std::mutex> lock(inflightMutex);
+            inflight -= released;
+        }
+        written.notify_all();
+    }
+
+    // CRC-32 (PNG のチャンク)
+    static std::uint32_t crc32(std::uint32_t crc, const std::uint8_t *data, std::size_t size){
+        static const auto table([]{
+            std::vector<std::uint32_t> t(256);
+            for (std::uint32_t n = 0; n < 256; ++n) {
+                std::uint32_t c(n);
+                for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ c >> 1 : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }());
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ crc >> 8;
+        return ~crc;
+    }
+
+    // 上の行から並んだ RGB を PNG で書き出す
+    // 圧縮はせずに無圧縮の deflate ブロックに分けて格納する (外部のライブラリを使わず，速さを優先する)
+    // 戻り値 : 書き出したバイト数
+    static std::size_t writePng(std::ostream &out, GLsizei width, GLsizei height, const std::uint8_t *rgb){
+        // 行ごとにフィルタの種類 (0 : なし) を付ける
+        const std::size_t row(static_cast<std::size_t>(width) * 3);
+        std::vector<std::uint8_t> raw(height * (row + 1));
+        for (GLsizei y = 0; y < height; ++y) {
+            raw[y * (row + 1)] = 0;
+            std::memcpy(&raw[y * (row + 1) + 1], rgb + y * row, row);
+        }
+
+        // zlib の形式で無圧縮のブロックに分ける
+        std::vector<std::uint8_t> idat = { 0x78, 0x01 };
+        idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        for (std::size_t first = 0; first < raw.size() || first == 0; first += 65535) {
+            const std::size_t n(std::min<std::size_t>(65535, raw.size() - first));
+            idat.push_back(first + n == raw.size() ? 1 : 0);
+            idat.push_back(n & 0xff);
+            idat.push_back(n >> 8);
+            idat.push_back(~n & 0xff);
+            idat.push_back((~n >> 8) & 0xff);
+            idat.insert(idat.end(), raw.begin() + first, raw.begin() + first + n);
+            if (n == 0) break;
+        }
+        std::uint32_t a(1), b(0);
+        for (std::size_t i = 0; i < raw.size(); ) {
+            // 5552 バイトまでは剰余を取らなくても桁あふれしない
+            const std::size_t end(std::min(raw.size(), i + 5552));
+            for (; i < end; ++i) {
+                a += raw[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        const std::uint32_t adler(b << 16 | a);
+        for (int k = 3; k >= 0; --k) idat.push_back(adler >> (k * 8) & 0xff);
+
+        // チャンクを書き出す
+        std::size_t bytes(0);
+        const auto chunk = [&](const char *type, const std::uint8_t *data, std::size_t size){
+            std::uint8_t head[8];
+            for (int k = 0; k < 4; ++k) head[k] = static_cast<std::uint8_t>(size >> ((3 - k) * 8));
+            std::memcpy(head + 4, type, 4);
+            std::uint32_t crc(crc32(0, head + 4, 4));
+            crc = crc32(crc, data, size);
+            std::uint8_t tail[4];
+            for (int k = 0; k < 4; ++k) tail[k] = static_cast<std::uint8_t>(crc >> ((3 - k) * 8));
+            out.write(reinterpret_cast<const char *>(head), 8);
+            out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+            out.write(reinterpret_cast<const char *>(tail), 4);
+            bytes += size + 12;
+        };
+        static const std::uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        out.write(reinterpret_cast<const char *>(signature), 8);
+        std::uint8_t header[13] = {};
+        for (int k = 0; k < 4; ++k) {
+            header[k] = static_cast<std::uint8_t>(width >> ((3 - k) * 8));
+            header[4 + k] = static_cast<std::uint8_t>(height >> ((3 - k) * 8));
+        }
+        header[8] = 8;
+        header[9] = 2;
+        chunk("IHDR", header, sizeof header);
+        chunk("IDAT", idat.data(), idat.size());
+        chunk("IEND", NULL, 0);
+        return bytes + 8;
+    }
+
+public:
+
+    // 書き出しの準備ができたかどうか
+    explicit operator bool() const { return !pattern.empty() || pipe != NULL; }
+
+    // 画像のサイズ
+    GLsizei getWidth() const { return width; }
+    GLsizei getHeight() const { return height; }
+
+    // フレームの読み出しを始める
+    // 空いているピクセルバッファオブジェクトがなければ最も古い読み出しの完了を待つ
+    void begin(){
+        if (captured == 0) start = std::chrono::steady_clock::now();
+        poll();
+        retire(slots[next], true);
+        slots[next].frame = captured++;
+    }
+
+    // 読み出し用に結合しているフレームバッファの (0, 0) から w × h を画像の (x, y) の位置に読み出す
+    // 画像がフレームバッファより大きいときはタイルごとに描いて読み出す
+    void read(GLint x, GLint y, GLsizei w, GLsizei h){
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, slots[next].pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_PACK_ROW_LENGTH, width);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE,
+                     reinterpret_cast<void *>((static_cast<std::size_t>(y) * width + x) * 4));
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // フレームの読み出しを終える
+    void end(){
+        Slot &s(slots[next]);
+        s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % ringSize;
+    }
+
+    // 読み出しの終わったフレームを古いものから書き出しに回す (待たない)
+    void poll(){
+        for (int k = 0; k < ringSize; ++k) {
+            Slot &s(slots[(next + k) % ringSize]);
+            if (s.frame >= 0 && !retire(s, false)) break;
+        }
+    }
+
+    // すべてのフレームを書き出し終わるまで待つ
+    void finish(){
+        for (int k = 0; k < ringSize; ++k) retire(slots[(next + k) % ringSize], true);
+        writers.wait(writing);
+        if (pipe && !broken) std::fflush(pipe);
+        if (captured > 0) stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 統計情報
+    const Stats &getStats() const { return stats; }
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+
+// オフスクリーンのフレームバッファオブジェクト
+// カラーバッファは RGBA8 のテクスチャ，デプスバッファはレンダーバッファにする
+class Framebuffer {
+    // フレームバッファオブジェクト名
+    GLuint fbo;
+
+    // カラーバッファのテクスチャ名
+    GLuint color;
+
+    // デプスバッファのレンダーバッファ名
+    GLuint depth;
+
+    // サイズ
+    GLsizei width, height;
+
+public:
+
+    // コンストラクタ
+    // width, height : フレームバッファのサイズ
+    Framebuffer(GLsizei width, GLsizei height)
+    : fbo(0), color(0), depth(0), width(0), height(0)
+    {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &color);
+        glGenRenderbuffers(1, &depth);
+        resize(width, height);
+    }
+
+    // デストラクタ
+    virtual ~Framebuffer(){
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    Framebuffer(const Framebuffer &f);
+
+    // 代入によるコピー禁止
+    Framebuffer &operator=(const Framebuffer &f);
+
+public:
+
+    // サイズを変える (同じサイズなら何もしない)
+    void resize(GLsizei w, GLsizei h){
+        if (w == width && h == height) return;
+        width = w;
+        height = h;
+
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Framebuffer " << width << "x" << height << " is incomplete." << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // 描画先にしてビューポートを全体に合わせる
+    void bind() const{
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+    }
+
+    // 描画先をウィンドウに戻す
+    static void unbind(){
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // カラーバッファの内容を読み出す (RGBA8，下の行から)
+    void readPixels(std::vector<std::uint8_t> &pixels) const{
+        pixels.resize(static_cast<std::size_t>(width) * height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+    // フレームバッファオブジェクト名
+    GLuint getName() const { return fbo; }
+
+    // カラーバッファのテクスチャ名
+    GLuint getTexture() const { return color; }
+
+    // サイズ
+    GLsizei getWidth() const { return width; }
+    GLsizei getHeight() const { return height; }
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cmath>
+#include "Matrix.h"
+
+// 視錐台
+class Frustum {
+    // 左右下上前後の六つの平面 (ax + by + cz + d = 0)
+    GLfloat plane[6][4];
+
+public:
+
+    // コンストラクタ
+    // m : 投影変換行列とモデルビュー変換行列の積
+    Frustum(const Matrix &m){
+        for (int i = 0; i < 6; ++i) {
+            // 行列の i / 2 行目を第 4 行に加える，あるいは引く
+            const int row(i / 2);
+            const GLfloat sign(i % 2 == 0 ? 1.0f : -1.0f);
+            for (int j = 0; j < 4; ++j) plane[i][j] = m[j * 4 + 3] + sign * m[j * 4 + row];
+
+            // 距離が求められるように法線を正規化する
+            const GLfloat l(sqrt(plane[i][0] * plane[i][0] + plane[i][1] * plane[i][1] + plane[i][2] * plane[i][2]));
+            if (l > 0.0f) for (int j = 0; j < 4; ++j) plane[i][j] /= l;
+        }
+    }
+
+    // 球が視錐台と交差しているかどうか
+    // c : 中心の位置
+    // r : 半径
+    bool intersects(const GLfloat *c, GLfloat r) const{
+        for (int i = 0; i < 6; ++i) {
+            if (plane[i][0] * c[0] + plane[i][1] * c[1] + plane[i][2] * c[2] + plane[i][3] < -r) return false;
+        }
+        return true;
+    }
+
+    // 平面を取り出す
+    const GLfloat *getPlane(int i) const { return plane[i]; }
+};
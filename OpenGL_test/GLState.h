@@ -0,0 +1,242 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <iostream>
+
+// OpenGL の状態の写し
+//
+// 使用中のプログラム，頂点配列オブジェクト，バッファオブジェクトの結合，有効化の状態を覚えておき，
+// 状態を変えない呼び出しを省く．状態を変える呼び出しはすべてこのクラスを通すこと．
+// コンテキストは一つだけとし，DEBUG が定義されていれば呼び出しのたびに glGet*() で写しを確かめる
+class GLState {
+public:
+
+    // 呼び出しの種類
+    enum Kind { Program, VertexArray, Buffer, Capability, kindCount };
+
+    // 呼び出しの記録
+    struct Counters {
+        // 実際に OpenGL を呼び出した回数
+        std::size_t issued;
+
+        // 状態が変わらないので省いた回数
+        std::size_t elided;
+    };
+
+private:
+
+    // 分からない状態を表す値
+    static constexpr GLuint unknown = 0xffffffffu;
+
+    // 使用中のプログラム
+    GLuint program;
+
+    // 結合している頂点配列オブジェクト
+    GLuint vertexArray;
+
+    // 結合しているバッファオブジェクト
+    // GL_ELEMENT_ARRAY_BUFFER は頂点配列オブジェクトの状態なので，頂点配列オブジェクトを変えると分からなくなる
+    struct Binding {
+        GLenum target, query;
+        GLuint buffer;
+    };
+    Binding buffers[7] = {
+        { GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING, unknown },
+        { GL_ELEMENT_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER_BINDING, unknown },
+        { GL_PIXEL_PACK_BUFFER, GL_PIXEL_PACK_BUFFER_BINDING, unknown },
+        { GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING, unknown },
+        { GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING, unknown },
+        { GL_COPY_READ_BUFFER, GL_COPY_READ_BUFFER_BINDING, unknown },
+        { GL_COPY_WRITE_BUFFER, GL_COPY_WRITE_BUFFER_BINDING, unknown },
+    };
+
+    // 有効化の状態 (-1 は分からない)
+    struct Flag {
+        GLenum cap;
+        int state;
+    };
+    Flag flags[8] = {
+        { GL_DEPTH_TEST, -1 },
+        { GL_CULL_FACE, -1 },
+        { GL_BLEND, -1 },
+        { GL_SCISSOR_TEST, -1 },
+        { GL_STENCIL_TEST, -1 },
+        { GL_POLYGON_OFFSET_FILL, -1 },
+        { GL_PROGRAM_POINT_SIZE, -1 },
+        { GL_FRAMEBUFFER_SRGB, -1 },
+    };
+
+    // 種類ごとの呼び出しの記録
+    Counters counters[kindCount];
+
+    // 写しと実際の状態が食い違った回数
+    std::size_t mismatches;
+
+    // 呼び出しのたびに写しを確かめるかどうか
+    bool debug;
+
+    // コンストラクタ
+    GLState()
+    : program(unknown)
+    , vertexArray(unknown)
+    , counters()
+    , mismatches(0)
+#if defined(DEBUG)
+    , debug(true)
+#else
+    , debug(false)
+#endif
+    {
+    }
+
+    // コピーコンストラクタによるコピー禁止
+    GLState(const GLState &s);
+
+    // 代入によるコピー禁止
+    GLState &operator=(const GLState &s);
+
+    // 呼び出しを記録し，呼び出すなら true を返す
+    bool count(Kind kind, bool changed){
+        if (changed) ++counters[kind].issued;
+        else ++counters[kind].elided;
+        return changed;
+    }
+
+    // target のバッファの結合の写し (なければ NULL)
+    Binding *binding(GLenum target){
+        for (auto &b : buffers) if (b.target == target) return &b;
+        return NULL;
+    }
+
+    // cap の有効化の写し (なければ NULL)
+    Flag *flag(GLenum cap){
+        for (auto &f : flags) if (f.cap == cap) return &f;
+        return NULL;
+    }
+
+    // 写しと実際の値を比べる
+    void compare(const char *name, GLenum what, GLuint expected, GLint actual){
+        if (expected == unknown || static_cast<GLuint>(actual) == expected) return;
+        ++mismatches;
+        std::cerr << "GLState: " << name << " 0x" << std::hex << what << std::dec
+        << " is " << actual << " but the cache says " << expected << std::endl;
+    }
+
+public:
+
+    // 唯一の状態の写しを取り出す
+    static GLState &get(){
+        static GLState state;
+        return state;
+    }
+
+    // プログラムを使用する
+    void useProgram(GLuint p){
+        if (count(Program, p != program)) {
+            glUseProgram(p);
+            program = p;
+        }
+        if (debug) check();
+    }
+
+    // 頂点配列オブジェクトを結合する
+    void bindVertexArray(GLuint v){
+        if (count(VertexArray, v != vertexArray)) {
+            glBindVertexArray(v);
+            vertexArray = v;
+            binding(GL_ELEMENT_ARRAY_BUFFER)->buffer = unknown;
+        }
+        if (debug) check();
+    }
+
+    // バッファオブジェクトを結合する
+    void bindBuffer(GLenum target, GLuint buffer){
+        Binding *const b(binding(target));
+        if (count(Buffer, b == NULL || b->buffer != buffer)) {
+            glBindBuffer(target, buffer);
+            if (b) b->buffer = buffer;
+        }
+        if (debug) check();
+    }
+
+    // 機能を有効あるいは無効にする
+    void set(GLenum cap, bool enabled){
+        Flag *const f(flag(cap));
+        if (count(Capability, f == NULL || f->state != static_cast<int>(enabled))) {
+            if (enabled) glEnable(cap);
+            else glDisable(cap);
+            if (f) f->state = enabled;
+        }
+        if (debug) check();
+    }
+    void enable(GLenum cap) { set(cap, true); }
+    void disable(GLenum cap) { set(cap, false); }
+
+    // バッファオブジェクトを削除する (結合していたものは 0 に戻る)
+    void deleteBuffers(GLsizei n, const GLuint *buffer){
+        glDeleteBuffers(n, buffer);
+        for (GLsizei i = 0; i < n; ++i)
+            for (auto &b : buffers) if (b.buffer == buffer[i]) b.buffer = 0;
+    }
+
+    // 頂点配列オブジェクトを削除する (結合していたものは 0 に戻る)
+    void deleteVertexArrays(GLsizei n, const GLuint *array){
+        glDeleteVertexArrays(n, array);
+        for (GLsizei i = 0; i < n; ++i) {
+            if (array[i] == vertexArray) {
+                vertexArray = 0;
+                binding(GL_ELEMENT_ARRAY_BUFFER)->buffer = unknown;
+            }
+        }
+    }
+
+    // 他から状態を変えられたときに写しを捨てる
+    void invalidate(){
+        program = vertexArray = unknown;
+        for (auto &b : buffers) b.buffer = unknown;
+        for (auto &f : flags) f.state = -1;
+    }
+
+    // 写しを実際の状態と比べて，食い違いがなければ true を返す
+    bool check(){
+        const std::size_t before(mismatches);
+        GLint value;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+        compare("program", GL_CURRENT_PROGRAM, program, value);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+        compare("vertex array", GL_VERTEX_ARRAY_BINDING, vertexArray, value);
+        for (const auto &b : buffers) {
+            glGetIntegerv(b.query, &value);
+            compare("buffer", b.target, b.buffer, value);
+        }
+        for (const auto &f : flags) {
+            if (f.state < 0) continue;
+            compare("capability", f.cap, static_cast<GLuint>(f.state), glIsEnabled(f.cap));
+        }
+        return mismatches == before;
+    }
+
+    // 呼び出しのたびに写しを確かめるかどうかを設定する
+    void setDebug(bool d) { debug = d; }
+
+    // 種類ごとの呼び出しの記録
+    const Counters &getCounters(Kind kind) const { return counters[kind]; }
+
+    // すべての種類の呼び出しの記録
+    Counters getTotal() const{
+        Counters total = { 0, 0 };
+        for (const auto &c : counters) {
+            total.issued += c.issued;
+            total.elided += c.elided;
+        }
+        return total;
+    }
+
+    // 写しと実際の状態が食い違った回数
+    std::size_t getMismatches() const { return mismatches; }
+
+    // 呼び出しの記録を消す
+    void resetCounters(){
+        for (auto &c : counters) c = Counters();
+    }
+};
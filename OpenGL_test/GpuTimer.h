@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <GL/glew.h>
+
+// GPU の処理時間の計測
+// GL_TIME_ELAPSED のクエリを数フレーム分使い回し，一フレーム以上前に終えて結果が出たものから読み出すので CPU は待たない
+// 使い回すクエリの結果がまだ出ていなければ，そのフレームは計測しない
+class GpuTimer {
+public:
+
+    // 使い回すクエリの数 (これだけ前のフレームの結果を読む)
+    static constexpr int latency = 4;
+
+private:
+
+    // クエリオブジェクト名
+    GLuint query[latency];
+
+    // クエリで計測したフレームの番号 (計測していなければ -1)
+    long frame[latency];
+
+    // 次に使うクエリ
+    int next;
+
+    // 計測中かどうか
+    bool running;
+
+    // GL_TIME_ELAPSED のクエリが使えるかどうか
+    const bool supported;
+
+public:
+
+    // コンストラクタ
+    GpuTimer()
+    : next(0)
+    , running(false)
+    , supported(GLEW_VERSION_3_3 || GLEW_ARB_timer_query)
+    {
+        if (supported) glGenQueries(latency, query);
+        for (int i = 0; i < latency; ++i) frame[i] = -1;
+    }
+
+    // デストラクタ
+    virtual ~GpuTimer(){
+        if (supported) glDeleteQueries(latency, query);
+    }
+
+    // 計測できるかどうか
+    explicit operator bool() const { return supported; }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    GpuTimer(const GpuTimer &t);
+
+    // 代入によるコピー禁止
+    GpuTimer &operator=(const GpuTimer &t);
+
+public:
+
+    // 計測を始める
+    // n : フレームの番号
+    // 先に collect() を呼んで使い回すクエリの結果を読み出しておく (まだ出ていなければこのフレームは計測しない)
+    void begin(long n){
+        if (!supported || frame[next] >= 0) return;
+        frame[next] = n;
+        glBeginQuery(GL_TIME_ELAPSED, query[next]);
+        running = true;
+    }
+
+    // 計測を終える
+    void end(){
+        if (!running) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        next = (next + 1) % latency;
+        running = false;
+    }
+
+    // 結果が出ているクエリを読み出す
+    // 待たないときは最後に終えたクエリ (前のフレーム) は GPU がまだ処理しているはずなので調べない
+    // callback(frame, milliseconds) : 読み出した結果を受け取る関数
+    // wait : すべての結果が出るまで待つなら true (終了時に使う)
+    template <typename Callback>
+    void collect(Callback callback, bool wait = false){
+        for (int k = 0; k < latency; ++k) {
+            const int i((next + k) % latency);
+            if (frame[i] < 0 || (running && i == next) || (!wait && k == latency - 1)) continue;
+            GLint available(GL_FALSE);
+            if (!wait) glGetQueryObjectiv(query[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!wait && !available) continue;
+            GLuint64 ns(0);
+            glGetQueryObjectui64v(query[i], GL_QUERY_RESULT, &ns);
+            callback(frame[i], ns * 1.0e-6);
+            frame[i] = -1;
+        }
+    }
+};
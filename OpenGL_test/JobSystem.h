@@ -0,0 +1,316 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Parallel.h"
+
+// ワークスティーリングのスレッドプール
+//
+// ワーカーはそれぞれ自分のキューを持ち，自分のキューの末尾から仕事を取り出す．
+// 自分のキューが空になったら他のキューの先頭 (古くて大きい仕事) を盗む．
+// ワーカー以外のスレッドが投入した仕事は 0 番のキューに入り，待っている間はそのスレッドも仕事をする．
+// 計測を有効にすると仕事ごとに名前・実行したスレッド・開始時刻・処理時間を記録する
+class JobSystem {
+public:
+
+    // 投入した仕事の残りの数 (wait() で 0 になるまで待つ)
+    class Counter {
+        friend class JobSystem;
+        std::atomic<int> count;
+
+    public:
+
+        Counter() : count(0) {}
+
+        // 残りの仕事があるかどうか
+        bool busy() const { return count.load(std::memory_order_acquire) > 0; }
+    };
+
+    // 仕事の処理時間の記録
+    struct Timing {
+        // 仕事の名前
+        const char *name;
+
+        // 実行したスレッドの番号 (0 はワーカー以外のスレッド)
+        unsigned int thread;
+
+        // プールを作ってからの開始時刻と処理時間 (秒)
+        double start, seconds;
+    };
+
+private:
+
+    // 仕事
+    struct Job {
+        std::function<void()> func;
+        Counter *counter;
+        const char *name;
+    };
+
+    // 仕事のキューとそのキューのスレッドが実行した仕事の記録
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::vector<Timing> timings;
+    };
+
+    // キュー (0 番はワーカー以外のスレッド用)
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    // ワーカーのスレッド
+    std::vector<std::thread> workers;
+
+    // キューに入っている仕事の数
+    std::atomic<int> pending;
+
+    // 終了の要求
+    std::atomic<bool> quit;
+
+    // 仕事の処理時間を記録するかどうか
+    std::atomic<bool> profiling;
+
+    // 時刻の基準
+    const std::chrono::steady_clock::time_point epoch;
+
+    // 仕事がないときにワーカーを眠らせる
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    // このスレッドが属するプールとキューの番号
+    static const JobSystem *&owner() { static thread_local const JobSystem *o(nullptr); return o; }
+    static std::size_t &index() { static thread_local std::size_t i(0); return i; }
+
+public:
+
+    // コンストラクタ
+    // threads : 呼び出し側のスレッドを含めたスレッドの数
+    explicit JobSystem(unsigned int threads = threadCount())
+    : pending(0)
+    , quit(false)
+    , profiling(false)
+    , epoch(std::chrono::steady_clock::now())
+    {
+        if (threads == 0) threads = 1;
+        for (unsigned int i = 0; i < threads; ++i) queues.emplace_back(new Queue);
+        for (unsigned int i = 1; i < threads; ++i) workers.emplace_back([this, i]{ work(i); });
+    }
+
+    // デストラクタ
+    ~JobSystem(){
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto &w : workers) w.join();
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    JobSystem(const JobSystem &j);
+
+    // 代入によるコピー禁止
+    JobSystem &operator=(const JobSystem &j);
+
+    // このスレッドのキューの番号
+    std::size_t self() const { return owner() == this ? index() : 0; }
+
+    // 仕事を一つ取り出す (自分のキューの末尾，なければ他のキューの先頭)
+    bool take(Job &job){
+        const std::size_t me(self());
+        {
+            Queue &q(*queues[me]);
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.jobs.empty()) {
+                job = std::move(q.jobs.back());
+                q.jobs.pop_back();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        for (std::size_t k = 1; k < queues.size(); ++k) {
+            Queue &q(*queues[(me + k) % queues.size()]);
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.jobs.empty()) {
+                job = std::move(q.jobs.front());
+                q.jobs.pop_front();
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 仕事を実行して残りの数を減らす
+    void run(Job &job){
+        if (profiling.load(std::memory_order_relaxed)) {
+            const auto start(std::chrono::steady_clock::now());
+            job.func();
+            const auto end(std::chrono::steady_clock::now());
+            const std::size_t me(self());
+            const Timing t = { job.name, static_cast<unsigned int>(me),
+                std::chrono::duration<double>(start - epoch).count(), std::chrono::duration<double>(end - start).count() };
+            Queue &q(*queues[me]);
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.timings.push_back(t);
+        }
+        else {
+            job.func();
+        }
+        job.counter->count.fetch_sub(1, std::memory_order_release);
+    }
+
+    // ワーカーの処理
+    void work(std::size_t i){
+        owner() = this;
+        index() = i;
+        Job job;
+        while (!quit) {
+            if (take(job)) {
+                run(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]{ return quit || pending.load(std::memory_order_relaxed) > 0; });
+        }
+    }
+
+public:
+
+    // 仕事を投入する (fork)
+    // name : 計測に使う仕事の名前 (文字列リテラルなど仕事の記録より長く残るもの)
+    // func : 仕事の関数
+    // counter : 仕事の完了を待つためのカウンタ
+    void submit(const char *name, std::function<void()> func, Counter &counter){
+        counter.count.fetch_add(1, std::memory_order_relaxed);
+        {
+            Queue &q(*queues[self()]);
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.jobs.push_back({ std::move(func), &counter, name });
+        }
+        pending.fetch_add(1, std::memory_order_relaxed);
+        if (!workers.empty()) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wake.notify_one();
+        }
+    }
+
+    void submit(std::function<void()> func, Counter &counter){
+        submit("job", std::move(func), counter);
+    }
+
+    // counter の仕事が終わるまで他の仕事を手伝いながら待つ (join)
+    void wait(Counter &counter){
+        Job job;
+        while (counter.busy()) {
+            if (take(job)) run(job);
+            else std::this_thread::yield();
+        }
+    }
+
+    // a と b を並列に実行して両方の終わりを待つ
+    // b を仕事にして盗めるようにし，a はこのスレッドで実行する
+    template <typename A, typename B>
+    void invoke(const char *nameA, const A &a, const char *nameB, const B &b){
+        Counter counter;
+        submit(nameB, [&b]{ b(); }, counter);
+        if (profiling.load(std::memory_order_relaxed)) {
+            Job job = { [&a]{ a(); }, &counter, nameA };
+            counter.count.fetch_add(1, std::memory_order_relaxed);
+            run(job);
+        }
+        else {
+            a();
+        }
+        wait(counter);
+    }
+
+    // [begin, end) を二分しながら仕事にして並列に処理する
+    // grain : これ以下の範囲は分割しない
+    // func : 分割した範囲 [first, last) を処理する関数
+    // name : 計測に使う仕事の名前
+    template <typename Func>
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, const Func &func, const char *name = "parallelFor"){
+        if (end <= begin) return;
+        if (grain == 0) grain = 1;
+        Counter counter;
+        std::function<void(std::size_t, std::size_t)> split = [&](std::size_t first, std::size_t last){
+            // 後半を仕事にして盗めるようにし，前半は自分で続ける
+            while (last - first > grain) {
+                const std::size_t middle(first + (last - first) / 2);
+                submit(name, [&split, middle, last]{ split(middle, last); }, counter);
+                last = middle;
+            }
+            func(first, last);
+        };
+        split(begin, end);
+        wait(counter);
+    }
+
+    // スレッドの数
+    unsigned int getThreadCount() const { return static_cast<unsigned int>(queues.size()); }
+
+    // 仕事の処理時間を記録するかどうかを設定する
+    void setProfiling(bool p) { profiling = p; }
+
+    // 記録した仕事の処理時間を取り出して消す
+    // timings : 取り出した記録を末尾に追加する
+    void takeTimings(std::vector<Timing> &timings){
+        for (auto &q : queues) {
+            std::lock_guard<std::mutex> lock(q->mutex);
+            timings.insert(timings.end(), q->timings.begin(), q->timings.end());
+            q->timings.clear();
+        }
+    }
+};
+
+// 仕事の名前ごとの処理時間の集計
+class JobProfile {
+    // 名前ごとの回数と処理時間の合計と最大
+    struct Entry {
+        std::string name;
+        std::size_t count;
+        double total, max;
+        std::vector<std::size_t> threads;
+    };
+    std::vector<Entry> entries;
+
+public:
+
+    // 仕事の記録を加える
+    void add(const std::vector<JobSystem::Timing> &timings){
+        for (const auto &t : timings) {
+            auto e(std::find_if(entries.begin(), entries.end(), [&t](const Entry &e){ return e.name == t.name; }));
+            if (e == entries.end()) e = entries.insert(entries.end(), Entry{ t.name, 0, 0.0, 0.0, {} });
+            ++e->count;
+            e->total += t.seconds;
+            e->max = std::max(e->max, t.seconds);
+            if (e->threads.size() <= t.thread) e->threads.resize(t.thread + 1);
+            ++e->threads[t.thread];
+        }
+    }
+
+    // 名前ごとの回数・平均・最大の処理時間と，各スレッドで実行した回数を表示する
+    void print(std::ostream &out, const char *title) const{
+        const std::streamsize precision(out.precision());
+        out << title << '\n' << std::fixed << std::setprecision(3);
+        for (const auto &e : entries) {
+            out << "  " << std::setw(16) << std::left << e.name << std::right << std::setw(8) << e.count
+            << " jobs, mean " << e.total / e.count * 1000.0 << " ms, max " << e.max * 1000.0 << " ms, per thread";
+            for (const std::size_t n : e.threads) out << ' ' << n;
+            out << '\n';
+        }
+        out << std::flush << std::defaultfloat << std::setprecision(precision);
+    }
+};
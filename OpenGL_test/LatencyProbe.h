@@ -0,0 +1,107 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "CameraPath.h"
+
+// 入力から表示までの遅れの計測と，処理中のフレーム数の制限
+// フレームごとに swap の後にフェンスを置き，そのフレームに反映した最も古い入力の時刻からフェンスが通るまでの時間を測る
+// フェンスが通ったかどうかは collect() を呼んだときに調べるので，待たないときはその間隔だけ長めに出る
+// フェンスが通るのは GPU が swap までの処理を終えたときで，画面に出るのは次の垂直同期になる
+class LatencyProbe {
+public:
+
+    // 使い回すフェンスの数 (ドライバが先に溜めるフレームよりも多くする)
+    static constexpr int ringSize = 8;
+
+private:
+
+    // 一フレーム分のフェンス
+    struct Slot {
+        // フェンス (使っていなければ NULL)
+        GLsync fence;
+
+        // このフレームに反映した最も古い入力の時刻 (入力がなければ負)
+        double input;
+    };
+    Slot slots[ringSize];
+
+    // 次に使うフェンス
+    int next;
+
+    // 計測した遅れ (ミリ秒)
+    std::vector<double> latency;
+
+public:
+
+    // コンストラクタ
+    LatencyProbe()
+    : next(0)
+    {
+        for (Slot &s : slots) s = Slot{ NULL, -1.0 };
+    }
+
+    // デストラクタ
+    virtual ~LatencyProbe(){
+        for (Slot &s : slots) if (s.fence) glDeleteSync(s.fence);
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    LatencyProbe(const LatencyProbe &p);
+
+    // 代入によるコピー禁止
+    LatencyProbe &operator=(const LatencyProbe &p);
+
+    // フェンスが通っていれば (wait なら通るまで待って) 遅れを記録して空ける
+    bool retire(Slot &s, bool wait){
+        if (s.fence == NULL) return true;
+        const GLenum status(glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0));
+        if (status == GL_TIMEOUT_EXPIRED) return false;
+        if (s.input >= 0.0) latency.push_back((glfwGetTime() - s.input) * 1000.0);
+        glDeleteSync(s.fence);
+        s = Slot{ NULL, -1.0 };
+        return true;
+    }
+
+public:
+
+    // フレームを送り出した (swap の後に呼ぶ)
+    // input : このフレームに反映した最も古い入力の時刻 (glfwGetTime() の値，入力がなければ負)
+    void swapped(double input){
+        // 使い回すフェンスがまだ通っていなければ待つ
+        retire(slots[next], true);
+        slots[next] = Slot{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), input };
+        next = (next + 1) % ringSize;
+    }
+
+    // 通ったフェンスを調べる
+    // wait : すべて通るまで待つなら true (終了時に使う)
+    void collect(bool wait = false){
+        for (int k = 0; k < ringSize; ++k) retire(slots[(next + k) % ringSize], wait);
+    }
+
+    // 処理中のフレームが frames 以下になるまで待つ
+    // 0 なら送り出したフレームが終わってから次の入力を読むので，ドライバがフレームを溜めなくなる
+    void limit(int frames){
+        int pending(0);
+        for (int k = ringSize; --k >= 0;) {
+            Slot &s(slots[(next + k) % ringSize]);
+            if (s.fence == NULL) continue;
+            if (pending < frames && !retire(s, false)) ++pending;
+            else if (pending >= frames) retire(s, true);
+        }
+    }
+
+    // 計測した遅れの数
+    std::size_t size() const { return latency.size(); }
+
+    // 遅れの分布を表示する
+    void print(std::ostream &out, const char *title) const{
+        out << title << " (" << latency.size() << " inputs)\n";
+        FrameLog::printRow(out, "input to swap", latency);
+        out << std::flush;
+    }
+};
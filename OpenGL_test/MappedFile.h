@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 読み出し専用でメモリにマップしたファイル
+class MappedFile {
+    // マップした領域の先頭
+    const std::uint8_t *address;
+
+    // ファイルのサイズ
+    std::size_t length;
+
+public:
+
+    // コンストラクタ
+    // name : マップするファイル名
+    MappedFile(const char *name)
+    : address(nullptr), length(0)
+    {
+        const int fd(open(name, O_RDONLY));
+        if (fd < 0) {
+            std::cerr << "Error: Can't open file: " << name << std::endl;
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *const p(mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0));
+            if (p != MAP_FAILED) {
+                address = static_cast<const std::uint8_t *>(p);
+                length = static_cast<std::size_t>(st.st_size);
+            }
+            else {
+                std::cerr << "Error: Can't map file: " << name << std::endl;
+            }
+        }
+
+        // マップした後はファイル記述子は不要
+        close(fd);
+    }
+
+    // デストラクタ
+    virtual ~MappedFile(){
+        if (address != nullptr) munmap(const_cast<std::uint8_t *>(address), length);
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    MappedFile(const MappedFile &m);
+
+    // 代入によるコピー禁止
+    MappedFile &operator=(const MappedFile &m);
+
+    // [offset, offset + size) を含むページ境界に揃えた範囲に madvise を適用する
+    void advise(std::size_t offset, std::size_t size, int advice) const{
+        if (address == nullptr || size == 0) return;
+        const std::size_t page(static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+        const std::size_t first(offset / page * page);
+        const std::size_t last(std::min(length, offset + size));
+        madvise(const_cast<std::uint8_t *>(address) + first, last - first, advice);
+    }
+
+public:
+
+    // マップに成功したかどうか
+    explicit operator bool() const { return address != nullptr; }
+
+    // マップした領域の先頭を取り出す
+    const std::uint8_t *data() const { return address; }
+
+    // ファイルのサイズを取り出す
+    std::size_t size() const { return length; }
+
+    // 指定した範囲を先読みしてページキャッシュに載せる
+    // 戻り値はページに触れた数
+    std::size_t prefetch(std::size_t offset, std::size_t size) const{
+        advise(offset, size, MADV_WILLNEED);
+
+        // 実際にページに触れて読み込みを完了させておく
+        const std::size_t page(static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+        const std::size_t last(std::min(length, offset + size));
+        volatile std::uint8_t sink(0);
+        std::size_t touched(0);
+        for (std::size_t i = offset / page * page; i < last; i += page, ++touched) sink = sink + address[i];
+        return touched;
+    }
+
+    // 指定した範囲のページをこのプロセスから切り離す
+    // 読み出し専用のマップなので再度アクセスすればファイルから読み直される
+    void release(std::size_t offset, std::size_t size) const{
+        advise(offset, size, MADV_DONTNEED);
+    }
+};
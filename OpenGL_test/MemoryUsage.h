@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <fstream>
+#include <unistd.h>
+#endif
+
+// 処理ごとの使用メモリの集計
+class MemoryUsage {
+    // 項目の名前とバイト数
+    std::vector<std::pair<std::string, std::size_t>> items;
+
+public:
+
+    // 項目のバイト数を設定する (同じ名前の項目があれば置き換える)
+    // name : 項目の名前
+    // bytes : バイト数
+    void set(const std::string &name, std::size_t bytes){
+        for (auto &item : items) {
+            if (item.first == name) {
+                item.second = bytes;
+                return;
+            }
+        }
+        items.emplace_back(name, bytes);
+    }
+
+    // 項目のバイト数の合計
+    std::size_t total() const{
+        std::size_t sum(0);
+        for (const auto &item : items) sum += item.second;
+        return sum;
+    }
+
+    // 現在の常駐メモリのバイト数
+    static std::size_t residentBytes(){
+#if defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count(MACH_TASK_BASIC_INFO_COUNT);
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+            return 0;
+        return info.resident_size;
+#else
+        std::ifstream statm("/proc/self/statm");
+        std::size_t size(0), resident(0);
+        statm >> size >> resident;
+        return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    // 起動してからの常駐メモリの最大のバイト数
+    static std::size_t peakResidentBytes(){
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        // macOS はバイト単位
+        return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+        // Linux はキロバイト単位
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+
+    // 項目ごとのバイト数と常駐メモリを表示する
+    // title : 表の見出し
+    void print(std::ostream &out, const char *title) const{
+        const auto mb = [](std::size_t bytes){ return bytes / 1048576.0; };
+        const std::streamsize precision(out.precision());
+        out << title << '\n' << std::fixed << std::setprecision(1);
+        for (const auto &item : items)
+            out << "  " << std::setw(24) << std::left << item.first << std::right << std::setw(10) << mb(item.second) << " MB\n";
+        out << "  " << std::setw(24) << std::left << "total" << std::right << std::setw(10) << mb(total()) << " MB\n"
+        << "  resident " << mb(residentBytes()) << " MB, peak " << mb(peakResidentBytes()) << " MB" << std::endl;
+        out << std::defaultfloat << std::setprecision(precision);
+    }
+};
@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <Eigen/Core>
+#include <GL/glew.h>
+#include "Parallel.h"
+
+// 三角形メッシュの重複のない辺 (GL_LINES で描くインデックス)
+//
+// 辺を (小さい番号, 大きい番号) のキーとして並べて隣り合う同じものを除く．並べ方は上位の桁を
+// 小さい番号そのものにした二段の基数ソートで，一段目は頂点ごとの計数ソートで大きい番号 (32 ビット) だけを
+// 振り分け，二段目は頂点ごとの数個を挿入ソートする (扇の中心のように辺の多い頂点だけは std::sort で並べる)．
+// 64 ビットのキーを LSD 基数ソートで何パスも並べるより読み書きが少なく，作業領域も三角形あたり 12 バイトと
+// 頂点あたり 8 バイトで済む (結果の辺は別に 8 バイトずつ)
+class MeshEdges {
+    // これより多くの辺を持つ頂点は挿入ソートでなく std::sort で並べる
+    static constexpr std::size_t insertionLimit = 16;
+
+    // 辺の両端の頂点の番号 (二つずつ)
+    std::vector<GLuint> index;
+
+    // 抽出にかかった時間 (秒)
+    double seconds;
+
+    // 抽出中に使ったメモリの最大値 (バイト)
+    std::size_t peakBytes;
+
+public:
+
+    // コンストラクタ
+    // vertexCount : 頂点の数
+    // F : 面の頂点のインデックス
+    MeshEdges(std::size_t vertexCount, const std::vector<Eigen::Vector3i> &F)
+    : seconds(0.0)
+    , peakBytes(0)
+    {
+        const auto start(std::chrono::steady_clock::now());
+        const std::size_t faceCount(F.size());
+
+        // 面 f の j 番目の辺の両端
+        const auto ends = [&F](std::size_t f, int j){
+            const std::uint32_t a(static_cast<std::uint32_t>(F[f](j))), b(static_cast<std::uint32_t>(F[f]((j + 1) % 3)));
+            return std::make_pair(std::min(a, b), std::max(a, b));
+        };
+
+        // 小さいほうの番号ごとに辺の数を数える
+        std::unique_ptr<std::atomic<std::uint32_t>[]> count(new std::atomic<std::uint32_t>[vertexCount + 1]);
+        parallelFor(0, vertexCount + 1, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) count[v].store(0, std::memory_order_relaxed);
+        });
+        parallelFor(0, faceCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t f = first; f < last; ++f)
+                for (int j = 0; j < 3; ++j) count[ends(f, j).first].fetch_add(1, std::memory_order_relaxed);
+        });
+
+        // 累積和が各頂点の辺の並びの先頭になる
+        std::vector<std::uint32_t> offset(vertexCount + 1);
+        parallelFor(0, vertexCount + 1, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) offset[v] = count[v].load(std::memory_order_relaxed);
+        });
+        exclusiveScan(offset.data(), offset.size());
+
+        // 大きいほうの番号を振り分ける
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) count[v].store(offset[v], std::memory_order_relaxed);
+        });
+        std::vector<std::uint32_t> other(faceCount * 3);
+        parallelFor(0, faceCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t f = first; f < last; ++f) {
+                for (int j = 0; j < 3; ++j) {
+                    const auto e(ends(f, j));
+                    other[count[e.first].fetch_add(1, std::memory_order_relaxed)] = e.second;
+                }
+            }
+        });
+        count.reset();
+
+        // 頂点ごとに並べて重複と縮退した辺を除き，残った数を数える
+        std::vector<std::uint32_t> unique(vertexCount + 1, 0);
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) {
+                std::uint32_t *const begin(other.data() + offset[v]), *const end(other.data() + offset[v + 1]);
+                if (static_cast<std::size_t>(end - begin) > insertionLimit) std::sort(begin, end);
+                else {
+                    for (std::uint32_t *i = begin + 1; i < end; ++i) {
+                        const std::uint32_t u(*i);
+                        std::uint32_t *j(i);
+                        for (; j > begin && j[-1] > u; --j) *j = j[-1];
+                        *j = u;
+                    }
+                }
+                std::uint32_t n(0), previous(static_cast<std::uint32_t>(v));
+                for (std::uint32_t *i = begin; i < end; ++i)
+                    if (*i != previous) previous = begin[n++] = *i;
+                unique[v] = n;
+            }
+        });
+        const std::size_t edges(exclusiveScan(unique.data(), unique.size()));
+        peakBytes = (offset.size() + unique.size() + other.size() + edges * 2) * sizeof(std::uint32_t);
+
+        // 辺の両端を書き出す
+        index.resize(edges * 2);
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) {
+                GLuint *p(index.data() + std::size_t(unique[v]) * 2);
+                for (std::uint32_t k = 0; k < unique[v + 1] - unique[v]; ++k) {
+                    *p++ = static_cast<GLuint>(v);
+                    *p++ = other[offset[v] + k];
+                }
+            }
+        });
+
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 辺の両端の頂点の番号
+    const GLuint *getIndices() const { return index.data(); }
+
+    // インデックスの数 (辺の数の二倍)
+    GLsizei getIndexSize() const { return static_cast<GLsizei>(index.size()); }
+
+    // 辺の数
+    std::size_t size() const { return index.size() / 2; }
+
+    // 抽出にかかった時間 (秒)
+    double getSeconds() const { return seconds; }
+
+    // 抽出中に使ったメモリの最大値 (バイト)
+    std::size_t getPeakBytes() const { return peakBytes; }
+
+    // 保持しているメモリ (バイト)
+    std::size_t memoryBytes() const { return index.capacity() * sizeof(GLuint); }
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+#include "Object.h"
+#include "Parallel.h"
+#include "MeshTopology.h"
+
+// メッシュの形状処理
+// 頂点の位置と法線を成分ごとの配列 (SoA) に複製して並列に処理する
+class MeshKernels {
+    // 頂点の位置
+    std::vector<float> x, y, z;
+
+    // 頂点の法線
+    std::vector<float> nx, ny, nz;
+
+    // 作業用の頂点の位置
+    std::vector<float> tx, ty, tz;
+
+    // 面の頂点のインデックス
+    std::vector<std::uint32_t> index;
+
+    // 接続関係
+    MeshTopology topology;
+
+    // 境界上の頂点
+    std::vector<std::uint8_t> onBoundary;
+
+    // 余接重みのラプラシアン (行優先，対角成分は重みの和の符号を反転したもの)
+    Eigen::SparseMatrix<float, Eigen::RowMajor> cotan;
+
+    // 頂点の面積 (接する三角形の面積の 1/3 の和)
+    std::vector<float> area;
+
+public:
+
+    // コンストラクタ
+    // V : 頂点の位置
+    // F : 面の頂点のインデックス
+    MeshKernels(const std::vector<Eigen::Vector3f> &V, const std::vector<Eigen::Vector3i> &F)
+    : x(V.size()), y(V.size()), z(V.size())
+    , nx(V.size()), ny(V.size()), nz(V.size())
+    , tx(V.size()), ty(V.size()), tz(V.size())
+    , index(F.size() * 3)
+    , topology(V.size(), F)
+    , onBoundary(V.size(), 0)
+    , cotan(static_cast<Eigen::Index>(V.size()), static_cast<Eigen::Index>(V.size()))
+    , area(V.size())
+    {
+        parallelFor(0, V.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) {
+                x[i] = V[i](0);
+                y[i] = V[i](1);
+                z[i] = V[i](2);
+            }
+        });
+        parallelFor(0, F.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t f = first; f < last; ++f)
+                for (int j = 0; j < 3; ++j) index[3 * f + j] = F[f](j);
+        });
+        for (const std::uint32_t h : topology.getBoundary()) onBoundary[index[h]] = 1;
+
+        // ラプラシアンの非零要素の配置は隣接する頂点と対角成分で決まる
+        std::vector<int> size(V.size());
+        for (std::uint32_t i = 0; i < V.size(); ++i) size[i] = topology.degree(i) + 1;
+        cotan.reserve(size);
+        for (std::uint32_t i = 0; i < V.size(); ++i) {
+            const std::uint32_t *const n(topology.neighbors(i));
+            bool diagonal(false);
+            for (std::uint32_t k = 0; k < topology.degree(i); ++k) {
+                if (!diagonal && n[k] > i) {
+                    cotan.insert(i, i) = 0.0f;
+                    diagonal = true;
+                }
+                cotan.insert(i, n[k]) = 0.0f;
+            }
+            if (!diagonal) cotan.insert(i, i) = 0.0f;
+        }
+        cotan.makeCompressed();
+
+        computeNormals();
+    }
+
+private:
+
+    // 行 i の列 j の要素の位置
+    float &entry(std::uint32_t i, std::uint32_t j){
+        const int *const begin(cotan.innerIndexPtr() + cotan.outerIndexPtr()[i]);
+        const int *const end(cotan.innerIndexPtr() + cotan.outerIndexPtr()[i + 1]);
+        return cotan.valuePtr()[std::lower_bound(begin, end, static_cast<int>(j)) - cotan.innerIndexPtr()];
+    }
+
+    // 頂点 a の角の余接
+    float cot(std::uint32_t a, std::uint32_t b, std::uint32_t c) const{
+        const float ux(x[b] - x[a]), uy(y[b] - y[a]), uz(z[b] - z[a]);
+        const float vx(x[c] - x[a]), vy(y[c] - y[a]), vz(z[c] - z[a]);
+        const float d(ux * vx + uy * vy + uz * vz);
+        const float cx(uy * vz - uz * vy), cy(uz * vx - ux * vz), cz(ux * vy - uy * vx);
+        return d / std::max(std::sqrt(cx * cx + cy * cy + cz * cz), 1e-20f);
+    }
+
+    // 頂点 a の角の大きさ
+    float angle(std::uint32_t a, std::uint32_t b, std::uint32_t c) const{
+        const float ux(x[b] - x[a]), uy(y[b] - y[a]), uz(z[b] - z[a]);
+        const float vx(x[c] - x[a]), vy(y[c] - y[a]), vz(z[c] - z[a]);
+        const float cx(uy * vz - uz * vy), cy(uz * vx - ux * vz), cz(ux * vy - uy * vx);
+        return std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), ux * vx + uy * vy + uz * vz);
+    }
+
+    // 三角形 f の面積
+    float triangleArea(std::uint32_t f) const{
+        const std::uint32_t a(index[3 * f]), b(index[3 * f + 1]), c(index[3 * f + 2]);
+        const float ux(x[b] - x[a]), uy(y[b] - y[a]), uz(z[b] - z[a]);
+        const float vx(x[c] - x[a]), vy(y[c] - y[a]), vz(z[c] - z[a]);
+        const float cx(uy * vz - uz * vy), cy(uz * vx - ux * vz), cz(ux * vy - uy * vx);
+        return 0.5f * std::sqrt(cx * cx + cy * cy + cz * cz);
+    }
+
+public:
+
+    // 現在の形状から余接重みと頂点の面積を求め直す
+    void updateCotanWeights(){
+        // 頂点ごとに自分の行だけを書き込むので排他制御は要らない
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) {
+                const std::uint32_t i(static_cast<std::uint32_t>(v));
+                float *const row(cotan.valuePtr() + cotan.outerIndexPtr()[i]);
+                std::fill(row, row + topology.degree(i) + 1, 0.0f);
+
+                float sum(0.0f), a(0.0f);
+                for (std::uint32_t k = 0; k < topology.faceDegree(i); ++k) {
+                    const std::uint32_t f(topology.faces(i)[k]);
+                    const int c(index[3 * f] == i ? 0 : index[3 * f + 1] == i ? 1 : 2);
+                    const std::uint32_t j(index[3 * f + (c + 1) % 3]), l(index[3 * f + (c + 2) % 3]);
+
+                    // 辺 ij の向かいの角は l，辺 il の向かいの角は j
+                    const float wj(0.5f * cot(l, i, j)), wl(0.5f * cot(j, l, i));
+                    entry(i, j) += wj;
+                    entry(i, l) += wl;
+                    sum += wj + wl;
+                    a += triangleArea(f) / 3.0f;
+                }
+                entry(i, i) = -sum;
+                area[i] = a;
+            }
+        });
+    }
+
+    // ラプラシアン平滑化を一回適用する
+    // lambda : 移動量の係数 (0 から 1)
+    // useCotan : 余接重みを使うかどうか (使わなければ一様な重み)
+    void smooth(float lambda, bool useCotan){
+        if (useCotan) updateCotanWeights();
+
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) {
+                const std::uint32_t i(static_cast<std::uint32_t>(v));
+                float sx(0.0f), sy(0.0f), sz(0.0f), sw(0.0f);
+                if (useCotan) {
+                    // (L p)_i = Σ w_ij (p_j - p_i)
+                    for (int k = cotan.outerIndexPtr()[i]; k < cotan.outerIndexPtr()[i + 1]; ++k) {
+                        const int j(cotan.innerIndexPtr()[k]);
+                        const float w(cotan.valuePtr()[k]);
+                        sx += w * x[j];
+                        sy += w * y[j];
+                        sz += w * z[j];
+                        if (j != static_cast<int>(i)) sw += w;
+                    }
+                }
+                else {
+                    const std::uint32_t *const n(topology.neighbors(i));
+                    for (std::uint32_t k = 0; k < topology.degree(i); ++k) {
+                        sx += x[n[k]] - x[i];
+                        sy += y[n[k]] - y[i];
+                        sz += z[n[k]] - z[i];
+                    }
+                    sw = static_cast<float>(topology.degree(i));
+                }
+
+                // 境界の頂点は動かさない
+                const float s(onBoundary[i] || sw <= 1e-12f ? 0.0f : lambda / sw);
+                tx[i] = x[i] + s * sx;
+                ty[i] = y[i] + s * sy;
+                tz[i] = z[i] + s * sz;
+            }
+        });
+        x.swap(tx);
+        y.swap(ty);
+        z.swap(tz);
+    }
+
+    // 面積で重み付けした頂点の法線を求め直す
+    void computeNormals(){
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) {
+                const std::uint32_t i(static_cast<std::uint32_t>(v));
+                float sx(0.0f), sy(0.0f), sz(0.0f);
+                for (std::uint32_t k = 0; k < topology.faceDegree(i); ++k) {
+                    const std::uint32_t f(topology.faces(i)[k]);
+                    const std::uint32_t a(index[3 * f]), b(index[3 * f + 1]), c(index[3 * f + 2]);
+                    const float ux(x[b] - x[a]), uy(y[b] - y[a]), uz(z[b] - z[a]);
+                    const float wx(x[c] - x[a]), wy(y[c] - y[a]), wz(z[c] - z[a]);
+                    sx += uy * wz - uz * wy;
+                    sy += uz * wx - ux * wz;
+                    sz += ux * wy - uy * wx;
+                }
+                const float l(std::sqrt(sx * sx + sy * sy + sz * sz));
+                const float s(l > 0.0f ? 1.0f / l : 0.0f);
+                nx[i] = sx * s;
+                ny[i] = sy * s;
+                nz[i] = sz * s;
+            }
+        });
+    }
+
+    // 離散平均曲率 H = -(Δp · n) / 2 を求める
+    void meanCurvature(std::vector<float> &H){
+        updateCotanWeights();
+        H.resize(x.size());
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) {
+                const std::uint32_t i(static_cast<std::uint32_t>(v));
+                float sx(0.0f), sy(0.0f), sz(0.0f);
+                for (int k = cotan.outerIndexPtr()[i]; k < cotan.outerIndexPtr()[i + 1]; ++k) {
+                    const int j(cotan.innerIndexPtr()[k]);
+                    const float w(cotan.valuePtr()[k]);
+                    sx += w * x[j];
+                    sy += w * y[j];
+                    sz += w * z[j];
+                }
+                const float a(std::max(area[i], 1e-20f));
+                H[i] = onBoundary[i] ? 0.0f : -0.5f * (sx * nx[i] + sy * ny[i] + sz * nz[i]) / a;
+            }
+        });
+    }
+
+    // 離散ガウス曲率 (角度欠損を頂点の面積で割ったもの) を求める
+    void gaussianCurvature(std::vector<float> &K) const{
+        K.resize(x.size());
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) {
+                const std::uint32_t i(static_cast<std::uint32_t>(v));
+                float sum(0.0f), a(0.0f);
+                for (std::uint32_t k = 0; k < topology.faceDegree(i); ++k) {
+                    const std::uint32_t f(topology.faces(i)[k]);
+                    const int c(index[3 * f] == i ? 0 : index[3 * f + 1] == i ? 1 : 2);
+                    sum += angle(i, index[3 * f + (c + 1) % 3], index[3 * f + (c + 2) % 3]);
+                    a += triangleArea(f) / 3.0f;
+                }
+                const float defect((onBoundary[i] ? 3.14159265f : 6.28318531f) - sum);
+                K[i] = defect / std::max(a, 1e-20f);
+            }
+        });
+    }
+
+    // 頂点属性の配列に詰める
+    // vertex : 頂点の数の要素を持つ配列
+    void pack(Object::Vertex *vertex) const{
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) vertex[i] = { x[i], y[i], z[i], nx[i], ny[i], nz[i] };
+        });
+    }
+
+    // 頂点の位置と値を青・白・赤の色に変換したものを頂点属性の配列に詰める
+    // vertex : 頂点の数の要素を持つ配列
+    // value : 頂点ごとの値
+    // range : 色が飽和する値の絶対値
+    void pack(Object::Vertex *vertex, const std::vector<float> &value, float range) const{
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) {
+                const float t(std::clamp(value[i] / range, -1.0f, 1.0f));
+                const float r(t > 0.0f ? 1.0f : 1.0f + t), b(t < 0.0f ? 1.0f : 1.0f - t);
+                vertex[i] = { x[i], y[i], z[i], r, std::min(r, b), b };
+            }
+        });
+    }
+
+    // 頂点の位置と法線を取り出す
+    // V : 頂点の位置
+    // N : 頂点の法線
+    void unpack(std::vector<Eigen::Vector3f> &V, std::vector<Eigen::Vector3f> &N) const{
+        V.resize(x.size());
+        N.resize(x.size());
+        parallelFor(0, x.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) {
+                V[i] = Eigen::Vector3f(x[i], y[i], z[i]);
+                N[i] = Eigen::Vector3f(nx[i], ny[i], nz[i]);
+            }
+        });
+    }
+
+    // 頂点の数
+    std::size_t getVertexCount() const { return x.size(); }
+
+    // 接続関係を取り出す
+    const MeshTopology &getTopology() const { return topology; }
+
+    // 使用しているメモリのバイト数
+    std::size_t memoryBytes() const{
+        return (x.capacity() + y.capacity() + z.capacity() + nx.capacity() + ny.capacity() + nz.capacity()
+                + tx.capacity() + ty.capacity() + tz.capacity() + area.capacity()) * sizeof(float)
+        + index.capacity() * sizeof(std::uint32_t) + onBoundary.capacity() + topology.memoryBytes()
+        + static_cast<std::size_t>(cotan.nonZeros()) * (sizeof(float) + sizeof(Eigen::SparseMatrix<float>::StorageIndex))
+        + static_cast<std::size_t>(cotan.outerSize() + 1) * sizeof(Eigen::SparseMatrix<float>::StorageIndex);
+    }
+};
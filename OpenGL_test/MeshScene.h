@@ -0,0 +1,348 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "SolidShapeIndex.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+
+// 複数のメッシュを並べて描く場面
+//
+// ファイルはスレッドプールで並行に読み込んで正規化し，読み終わったものを一つのキューに入れる．
+// OpenGL の呼び出しは描画のスレッドでしかできないので，キューからの転送は upload() でフレームごとに
+// 予算のバイト数までにして，大きなファイルが届いても操作が止まらないようにする．
+// メッシュはファイルの順に画面に沿った格子に並べ，それぞれの境界球がます目に収まるように縮める
+class MeshScene {
+public:
+
+    // ファイルごとの記録
+    struct Entry {
+        // ファイル名
+        std::string filename;
+
+        // 図形 (転送が終わるまでは NULL)
+        std::unique_ptr<Shape> shape;
+
+        // 境界球をます目に合わせる変換
+        Matrix placement;
+
+        // 頂点と三角形の数
+        GLuint vertices, triangles;
+
+        // 読み込みにかかった時間 (秒)
+        double parseSeconds;
+
+        // 読み込みが終わった時刻，転送を始めた時刻，転送が終わった時刻 (場面を作ってからの秒，まだなら負)
+        double parsed, started, uploaded;
+
+        // 転送したフレームの数
+        std::size_t uploadFrames;
+    };
+
+private:
+
+    // 読み込みの終わったメッシュ
+    struct Ready {
+        // ファイルの番号
+        std::size_t index;
+
+        // 正規化したメッシュ (読み込めなかったら NULL)
+        std::unique_ptr<Mesh> mesh;
+
+        // 境界球の中心と半径
+        Eigen::Vector3f center;
+        float radius;
+
+        // 読み込みにかかった時間と，終わった時刻 (秒)
+        double seconds, finished;
+    };
+
+    // ファイルごとの記録
+    std::vector<Entry> entries;
+
+    // 格子の列と行の数
+    const int columns, rows;
+
+    // 一フレームに転送するバイト数の上限
+    const std::size_t budget;
+
+    // 読み込みに使うスレッドの数
+    const unsigned int threads;
+
+    // 時刻の基準
+    const std::chrono::steady_clock::time_point start;
+
+    // 読み込みの終わったメッシュのキュー (読み込みのスレッドが入れて描画のスレッドが取り出す)
+    std::mutex mutex;
+    std::deque<Ready> queue;
+
+    // 転送中のメッシュと，転送の終わったインデックスと頂点の数
+    Ready current;
+    std::size_t sentIndices, sent;
+
+    // 頂点を GPU の並びに直す作業領域
+    std::vector<Object::Vertex> staging;
+
+    // 転送の終わったメッシュの数
+    std::size_t completed;
+
+    // 転送したフレームの数と，一フレームの転送にかかった時間の最大値 (秒)
+    std::size_t uploadFrames;
+    double maxUploadSeconds;
+
+    // 転送したバイト数
+    std::size_t uploadedBytes;
+
+    // 読み込みの仕事の残り
+    JobSystem::Counter loading;
+
+    // 読み込みのスレッドプール (仕事がこのオブジェクトを参照するので最初に破棄する)
+    std::unique_ptr<JobSystem> loaders;
+
+    // 場面を作ってからの時間 (秒)
+    double now() const{
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // ファイル index を読み込んでキューに入れる (読み込みのスレッドで実行する)
+    void load(std::size_t index){
+        const auto begin(std::chrono::steady_clock::now());
+        Ready r;
+        r.index = index;
+        r.mesh.reset(new Mesh);
+        if (!r.mesh->readMesh(entries[index].filename)) {
+            // 読み込めなかったことを描画のスレッドに知らせて残りのファイルは読み続ける
+            std::cerr << "Error: Can't load " << entries[index].filename << std::endl;
+            r.mesh.reset();
+            r.center = Eigen::Vector3f::Zero();
+            r.radius = 1.0f;
+            r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            r.finished = now();
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(r));
+            return;
+        }
+
+        // 正規化した後の境界球 (軸に沿った境界箱の中心から最も遠い頂点まで)
+        const std::vector<Eigen::Vector3f> &V(r.mesh->getVertices());
+        Eigen::Vector3f lower(Eigen::Vector3f::Constant(0.0f)), upper(Eigen::Vector3f::Constant(0.0f));
+        if (!V.empty()) lower = upper = V[0];
+        for (const Eigen::Vector3f &v : V) {
+            lower = lower.cwiseMin(v);
+            upper = upper.cwiseMax(v);
+        }
+        r.center = (lower + upper) * 0.5f;
+        r.radius = 0.0f;
+        for (const Eigen::Vector3f &v : V) r.radius = std::max(r.radius, (v - r.center).squaredNorm());
+        r.radius = std::max(std::sqrt(r.radius), 1e-6f);
+
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        r.finished = now();
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(r));
+    }
+
+public:
+
+    // コンストラクタ
+    // filenames : 読み込むファイル
+    // budget : 一フレームに転送するバイト数の上限
+    // threads : 読み込みに使うスレッドの数 (1 ならファイルを一つずつ順に読む)
+    MeshScene(const std::vector<std::string> &filenames, std::size_t budget, unsigned int threads = threadCount())
+    : entries(filenames.size())
+    , columns(std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(filenames.size()))))))
+    , rows(std::max(1, static_cast<int>((filenames.size() + columns - 1) / columns)))
+    , budget(std::max<std::size_t>(budget, sizeof(Object::Vertex)))
+    , threads(std::max(1u, threads))
+    , start(std::chrono::steady_clock::now())
+    , current()
+    , sentIndices(0)
+    , sent(0)
+    , completed(0)
+    , uploadFrames(0)
+    , maxUploadSeconds(0.0)
+    , uploadedBytes(0)
+    {
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            Entry &e(entries[i]);
+            e.filename = filenames[i];
+            e.placement.loadIdentity();
+            e.vertices = e.triangles = 0;
+            e.parseSeconds = 0.0;
+            e.parsed = e.started = e.uploaded = -1.0;
+            e.uploadFrames = 0;
+        }
+
+        // 呼び出し側のスレッドは描画に使うので，読み込みはすべてワーカーで行う
+        loaders.reset(new JobSystem(this->threads + 1));
+        for (std::size_t i = 0; i < entries.size(); ++i)
+            loaders->submit("load", [this, i]{ load(i); }, loading);
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    MeshScene(const MeshScene &s);
+
+    // 代入によるコピー禁止
+    MeshScene &operator=(const MeshScene &s);
+
+public:
+
+    // 読み込みの終わったメッシュを予算の範囲で転送する (描画のスレッドでフレームごとに呼ぶ)
+    // 図形はインデックスの領域だけを確保して作り，インデックス，頂点の順に予算の残りずつ転送する
+    // 戻り値 : このフレームですべての転送が終わったら true
+    bool upload(){
+        if (completed == entries.size()) return false;
+        const auto begin(std::chrono::steady_clock::now());
+        std::size_t left(budget), bytes(0);
+        while (left > 0) {
+            // 次のメッシュをキューから取り出して図形を作る
+            if (!current.mesh) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (queue.empty()) break;
+                    current = std::move(queue.front());
+                    queue.pop_front();
+                }
+
+                // 読み込めなかったファイルは読み込んでいないものとして数えるだけにする
+                if (!current.mesh) {
+                    ++completed;
+                    continue;
+                }
+                Mesh &mesh(*current.mesh);
+                Entry &e(entries[current.index]);
+                e.vertices = mesh.getVertexSize();
+                e.triangles = mesh.getIndexSize() / 3;
+                e.parseSeconds = current.seconds;
+                e.parsed = current.finished;
+                e.started = now();
+                e.placement = Matrix::scale(1.0f / current.radius, 1.0f / current.radius, 1.0f / current.radius)
+                * Matrix::translate(-current.center.x(), -current.center.y(), -current.center.z());
+                e.shape.reset(new SolidShapeIndex(mesh.getVertexSize(), NULL, mesh.getIndexSize(), NULL));
+                sentIndices = sent = 0;
+            }
+
+            // インデックスを予算の残りの分だけ転送する (少なくとも一つは進める)
+            Mesh &mesh(*current.mesh);
+            Entry &e(entries[current.index]);
+            Object &object(e.shape->getObject());
+            const std::size_t indexTotal(mesh.getIndexSize());
+            bool progressed(false);
+            if (sentIndices < indexTotal) {
+                const std::size_t count(std::min(indexTotal - sentIndices, std::max<std::size_t>(left / sizeof(GLuint), 1)));
+                object.updateIndices(static_cast<GLint>(sentIndices), static_cast<GLsizei>(count), mesh.getIndices() + sentIndices);
+                sentIndices += count;
+                left -= std::min(left, count * sizeof(GLuint));
+                bytes += count * sizeof(GLuint);
+                progressed = true;
+            }
+
+            // インデックスを送り終わったら頂点を予算の残りの分だけ転送する (何も進めていなければ少なくとも一つは進める)
+            const std::size_t total(mesh.getVertexSize());
+            if (sentIndices == indexTotal && (left >= sizeof(Object::Vertex) || !progressed)) {
+                const std::size_t count(std::min(total - sent, std::max<std::size_t>(left / sizeof(Object::Vertex), 1)));
+                for (std::size_t done = 0; done < count;) {
+                    const std::size_t n(std::min<std::size_t>(count - done, 1 << 18));
+                    staging.resize(n);
+                    mesh.convertMeshData(staging.data(), sent + done, n);
+                    object.update(static_cast<GLint>(sent + done), static_cast<GLsizei>(n), staging.data());
+                    done += n;
+                }
+                sent += count;
+                left -= std::min(left, count * sizeof(Object::Vertex));
+                bytes += count * sizeof(Object::Vertex);
+            }
+            ++e.uploadFrames;
+
+            // 予算を使い切ったら続きは次のフレームに回す
+            if (sentIndices < indexTotal || sent < total) break;
+
+            // 転送し終わったら CPU 側の写しを捨てる
+            object.flush();
+            e.uploaded = now();
+            current.mesh.reset();
+            if (++completed == entries.size()) std::vector<Object::Vertex>().swap(staging);
+        }
+        if (bytes > 0) {
+            const double seconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+            ++uploadFrames;
+            uploadedBytes += bytes;
+            maxUploadSeconds = std::max(maxUploadSeconds, seconds);
+        }
+        return completed == entries.size();
+    }
+
+    // 転送の終わったメッシュを格子に並べて描く
+    // modelviewLoc : モデルビュー変換行列の uniform 変数の場所
+    // modelview : メッシュに共通のモデルビュー変換行列 (それぞれがます目の中でこの変換をする)
+    void draw(GLint modelviewLoc, const Matrix &modelview) const{
+        // 格子全体が一つのメッシュと同じ大きさになるように，ます目の大きさを格子の長いほうの辺で割る
+        const GLfloat cell(2.0f / std::max(columns, rows));
+        const Matrix shrink(Matrix::scale(cell * 0.45f, cell * 0.45f, cell * 0.45f));
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            const Entry &e(entries[i]);
+            if (e.uploaded < 0.0) continue;
+
+            // ます目の中心は視点座標系で上の行から並べる
+            const int column(static_cast<int>(i % columns)), row(static_cast<int>(i / columns));
+            const Matrix offset(Matrix::translate(cell * (column - 0.5f * (columns - 1)), cell * (0.5f * (rows - 1) - row), 0.0f));
+            glUniformMatrix4fv(modelviewLoc, 1, GL_FALSE, (offset * modelview * shrink * e.placement).data());
+            e.shape->draw();
+        }
+    }
+
+    // ファイルの数
+    std::size_t size() const { return entries.size(); }
+
+    // すべて転送し終わったかどうか
+    bool isComplete() const { return completed == entries.size(); }
+
+    // ファイルごとの記録
+    const Entry &operator[](std::size_t i) const { return entries[i]; }
+
+    // GPU のバッファのバイト数
+    std::size_t gpuBytes() const{
+        std::size_t bytes(0);
+        for (const Entry &e : entries) if (e.shape) bytes += e.shape->getObject().gpuBytes();
+        return bytes;
+    }
+
+    // ファイルごとと全体の読み込みの時間を，ファイルごとの読み込みの時間の和と比べて表示する
+    // 和は一つのスレッドで順に読み込んだときの時間にあたる (スレッドがコアを取り合うと個々の時間が延びるので，
+    // 正確に比べるには --load-threads 1 で実行した全体の時間を使う)
+    void print(std::ostream &out) const{
+        double sequential(0.0), parsed(0.0), uploaded(0.0);
+        for (const Entry &e : entries) {
+            out << "  " << e.filename << ": ";
+            if (e.parsed < 0.0) {
+                out << "not loaded\n";
+                continue;
+            }
+            out << e.vertices << " vertices, " << e.triangles << " triangles, parse " << e.parseSeconds * 1000.0
+            << " ms, queued " << (e.started - e.parsed) * 1000.0 << " ms";
+            if (e.uploaded >= 0.0)
+                out << ", upload " << (e.uploaded - e.started) * 1000.0 << " ms in " << e.uploadFrames
+                << " frames, ready at " << e.uploaded * 1000.0 << " ms";
+            out << "\n";
+            sequential += e.parseSeconds;
+            parsed = std::max(parsed, e.parsed);
+            uploaded = std::max(uploaded, e.uploaded);
+        }
+        out << completed << " of " << entries.size() << " meshes on " << threads << " threads: all parsed at "
+        << parsed * 1000.0 << " ms, all uploaded at " << uploaded * 1000.0 << " ms; parse times sum to "
+        << sequential * 1000.0 << " ms (" << (parsed > 0.0 ? sequential / parsed : 0.0) << "x overlap)\n"
+        << "uploaded " << (uploadedBytes >> 20) << " MB in " << uploadFrames << " frames (budget " << (budget >> 10)
+        << " KB), max " << maxUploadSeconds * 1000.0 << " ms per frame" << std::endl;
+    }
+};
@@ -0,0 +1,446 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Core>
+#include <GL/glew.h>
+#include "Object.h"
+#include "GLState.h"
+#include "MappedFile.h"
+#include "MeshTopology.h"
+#include "Parallel.h"
+
+// 時刻ごとに一つの OBJ ファイルになったメッシュの列の再生
+//
+// どの時刻も同じ接続関係を持つものとして，面のインデックスは最初の時刻から一度だけ転送する．
+// 先読みのスレッドが次の時刻のファイルをマップして頂点の位置だけを読み (面と法線の行は読み飛ばす)，
+// 描画のスレッドは表示する時刻になったものを二つの頂点バッファオブジェクトの描いていないほうに転送して入れ替える．
+// 位置は最初の時刻の境界球で正規化するので，時刻ごとの動きはそのまま見える．
+// 法線は面の vn の番号が頂点の番号と揃っているとは限らないので，ファイルの法線は使わずに時刻ごとに面から求める．
+// 表示する時刻に読み終わっていなければ前の時刻を表示し続け，追いついたら間の時刻を飛ばす
+class MeshSequence {
+public:
+
+    // 再生の記録
+    struct Stats {
+        // 表示した時刻の数と，読み込みが間に合わずに飛ばした時刻の数
+        std::size_t shown, dropped;
+
+        // 次の時刻を表示するはずのフレームで読み込みが終わっていなかった回数
+        std::size_t late;
+
+        // 先読みで読み込んだ時刻の数と，その時間の合計と最大値 (秒)
+        std::size_t parsed;
+        double parseSeconds, maxParseSeconds;
+
+        // 転送した時刻の数と時間の合計と最大値 (秒)，転送したバイト数
+        std::size_t uploads;
+        double uploadSeconds, maxUploadSeconds;
+        std::size_t bytes;
+
+        // GPU が使用中だったためにバッファを捨てて転送した回数
+        std::size_t orphans;
+
+        // 最初の時刻の読み込みと接続関係の転送にかかった時間 (秒)
+        double firstSeconds;
+    };
+
+    // 先読みして持っておく時刻の数
+    static constexpr std::size_t depth = 3;
+
+private:
+
+    // 先読みした時刻
+    struct Step {
+        // 時刻の番号 (ファイルの数を超えたら最初のファイルに戻る)
+        std::uint64_t step;
+
+        // 頂点属性 (読めなければ空)
+        std::vector<Object::Vertex> vertices;
+    };
+
+    // ファイル名
+    const std::vector<std::string> files;
+
+    // 一秒あたりの時刻の数
+    const double rate;
+
+    // 面のインデックス (法線を求めるときにも使う)
+    std::vector<Eigen::Vector3i> F;
+
+    // 頂点に接する面 (法線を求めるときに使う)
+    std::unique_ptr<MeshTopology> topology;
+
+    // 頂点の数
+    std::size_t vertexCount;
+
+    // 最初の時刻の境界球の中心と半径の逆数
+    Eigen::Vector3f center;
+    float scale;
+
+    // インデックスの頂点バッファオブジェクトと，交互に使う頂点バッファオブジェクトと頂点配列オブジェクト
+    GLuint ibo, vbo[2], vao[2];
+
+    // 頂点バッファオブジェクトを使う描画の終わりを調べるフェンス
+    GLsync fence[2];
+
+    // 描画に使っているほう
+    int front;
+
+    // 表示している時刻
+    std::uint64_t shownStep;
+
+    // 再生を始めた時刻 (update() に与えた時刻と実時間，始めていなければ負)
+    double startTime;
+    std::chrono::steady_clock::time_point wallStart, wallLast;
+
+    // 読み終わった時刻と使い終わった頂点属性の領域
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Step> ready;
+    std::vector<std::vector<Object::Vertex>> spare;
+
+    // 再生が求めている時刻 (先読みはこれより前を読まない)
+    std::uint64_t wanted;
+
+    // 読めなかったファイルの数 (最初の 10 個だけ報告する)
+    std::size_t failures;
+
+    // 先読みのスレッドの終了の要求
+    bool quit;
+
+    // 再生の記録 (先読みの記録は mutex で守る)
+    Stats stats;
+
+    // 先読みのスレッド
+    std::thread prefetcher;
+
+    // OBJ ファイルの頂点の位置を読む (faces があれば面も読み，多角形は最初の頂点を中心に扇形に三角形に分ける)
+    // 戻り値 : 読めたかどうか
+    static bool parse(const std::string &name, std::vector<Eigen::Vector3f> &V, std::vector<Eigen::Vector3i> *faces){
+        const MappedFile file(name.c_str());
+        if (!file) return false;
+        file.prefetch(0, file.size());
+        const char *p(reinterpret_cast<const char *>(file.data()));
+        const char *const end(p + file.size());
+        V.clear();
+
+        // 空白を飛ばして数を一つ読む
+        const auto number = [](const char *&q, const char *eol, auto &value){
+            while (q < eol && (*q == ' ' || *q == '\t')) ++q;
+            const std::from_chars_result r(std::from_chars(q, eol, value));
+            q = r.ptr;
+            return r.ec == std::errc();
+        };
+
+        while (p < end) {
+            const char *eol(static_cast<const char *>(std::memchr(p, '\n', end - p)));
+            if (eol == NULL) eol = end;
+            if (eol - p > 2 && p[0] == 'v' && p[1] == ' ') {
+                const char *q(p + 2);
+                Eigen::Vector3f v;
+                if (!number(q, eol, v(0)) || !number(q, eol, v(1)) || !number(q, eol, v(2))) return false;
+                V.push_back(v);
+            }
+            else if (faces && eol - p > 2 && p[0] == 'f' && p[1] == ' ') {
+                // "v", "v/vt", "v//vn", "v/vt/vn" の頂点の番号だけを使う
+                const char *q(p + 1);
+                int first(0), previous(0), count(0), index;
+                for (;;) {
+                    while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) ++q;
+                    if (q == eol) break;
+                    if (!number(q, eol, index)) return false;
+                    while (q < eol && *q != ' ' && *q != '\t') ++q;
+                    if (count == 0) first = index;
+                    else if (count >= 2) faces->emplace_back(first - 1, previous - 1, index - 1);
+                    previous = index;
+                    ++count;
+                }
+                if (count < 3) return false;
+            }
+            p = eol + 1;
+        }
+        return true;
+    }
+
+    // ファイルを読んで頂点属性を作る (最初の時刻の正規化を使う)
+    // 戻り値 : 読めて頂点の数が最初の時刻と同じかどうか
+    bool read(const std::string &name, std::vector<Object::Vertex> &vertices){
+        std::vector<Eigen::Vector3f> V;
+        V.reserve(vertexCount);
+        if (!parse(name, V, NULL) || V.size() != vertexCount) {
+            vertices.clear();
+            return false;
+        }
+        vertices.resize(vertexCount);
+        pack(V, vertices.data());
+        return true;
+    }
+
+    // 位置を正規化し，法線を接する面の法線の面積の重みつきの和から求めて頂点属性に詰める
+    void pack(const std::vector<Eigen::Vector3f> &V, Object::Vertex *vertices){
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) {
+                const Eigen::Vector3f p((V[i] - center) * scale);
+                Eigen::Vector3f n(Eigen::Vector3f::Zero());
+                const std::uint32_t v(static_cast<std::uint32_t>(i));
+                for (std::uint32_t k = 0; k < topology->faceDegree(v); ++k) {
+                    const Eigen::Vector3i &f(F[topology->faces(v)[k]]);
+                    n += (V[f(1)] - V[f(0)]).cross(V[f(2)] - V[f(0)]);
+                }
+                n.normalize();
+                vertices[i] = { p(0), p(1), p(2), n(0), n(1), n(2) };
+            }
+        });
+    }
+
+    // 先読みのスレッドの処理
+    void prefetchLoop(){
+        std::uint64_t next(1);
+        for (;;) {
+            Step s;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]{ return quit || ready.size() < depth; });
+                if (quit) return;
+
+                // 再生に遅れていたら間に合わない時刻は読まない
+                next = std::max(next, wanted);
+                if (!spare.empty()) {
+                    s.vertices.swap(spare.back());
+                    spare.pop_back();
+                }
+            }
+            s.step = next++;
+            const std::string &name(files[s.step % files.size()]);
+            const auto start(std::chrono::steady_clock::now());
+            const bool ok(read(name, s.vertices));
+            const double seconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ok && failures++ < 10) std::cerr << "Can't read " << name << " as a step of the sequence" << std::endl;
+            ++stats.parsed;
+            stats.parseSeconds += seconds;
+            stats.maxParseSeconds = std::max(stats.maxParseSeconds, seconds);
+            ready.push_back(std::move(s));
+        }
+    }
+
+public:
+
+    // コンストラクタ
+    // files : 時刻の順に並べた OBJ ファイル
+    // rate : 一秒あたりの時刻の数
+    MeshSequence(const std::vector<std::string> &files, double rate)
+    : files(files)
+    , rate(rate)
+    , vertexCount(0)
+    , center(Eigen::Vector3f::Zero())
+    , scale(1.0f)
+    , ibo(0), vbo{ 0, 0 }, vao{ 0, 0 }
+    , fence{ 0, 0 }
+    , front(0)
+    , shownStep(0)
+    , startTime(-1.0)
+    , wanted(0)
+    , failures(0)
+    , quit(false)
+    , stats()
+    {
+        // 最初の時刻は面も読んで接続関係を決める
+        const auto start(std::chrono::steady_clock::now());
+        std::vector<Eigen::Vector3f> V;
+        if (files.empty() || !parse(files[0], V, &F) || V.empty() || F.empty()) {
+            std::cerr << "Can't read " << (files.empty() ? std::string() : files[0]) << " as a mesh" << std::endl;
+            F.clear();
+            return;
+        }
+        vertexCount = V.size();
+        for (const Eigen::Vector3i &f : F) {
+            if (f.minCoeff() < 0 || static_cast<std::size_t>(f.maxCoeff()) >= vertexCount) {
+                std::cerr << files[0] << " has a face with a vertex out of range" << std::endl;
+                F.clear();
+                return;
+            }
+        }
+
+        // 最初の時刻の境界球 (軸に沿った境界箱の中心から最も遠い頂点まで) を単位球にする
+        Eigen::Vector3f lower(V[0]), upper(V[0]);
+        for (const Eigen::Vector3f &v : V) {
+            lower = lower.cwiseMin(v);
+            upper = upper.cwiseMax(v);
+        }
+        center = (lower + upper) * 0.5f;
+        float radius(0.0f);
+        for (const Eigen::Vector3f &v : V) radius = std::max(radius, (v - center).squaredNorm());
+        scale = 1.0f / std::max(std::sqrt(radius), 1e-6f);
+
+        topology.reset(new MeshTopology(vertexCount, F, false));
+        std::vector<Object::Vertex> vertices(vertexCount);
+        pack(V, vertices.data());
+
+        // インデックスは二つの頂点配列オブジェクトで共有して一度だけ転送する
+        glGenBuffers(1, &ibo);
+        glGenBuffers(2, vbo);
+        glGenVertexArrays(2, vao);
+        for (int i = 0; i < 2; ++i) {
+            GLState::get().bindVertexArray(vao[i]);
+            GLState::get().bindBuffer(GL_ARRAY_BUFFER, vbo[i]);
+            glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Object::Vertex), i == 0 ? vertices.data() : NULL, GL_STREAM_DRAW);
+            PositionNormal::setInterleaved();
+            GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+            if (i == 0) glBufferData(GL_ELEMENT_ARRAY_BUFFER, F.size() * sizeof(Eigen::Vector3i), F.data(), GL_STATIC_DRAW);
+        }
+        stats.firstSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.shown = 1;
+
+        // 使い終わった領域は先読みで使い回す
+        spare.push_back(std::move(vertices));
+        if (files.size() > 1) prefetcher = std::thread(&MeshSequence::prefetchLoop, this);
+    }
+
+    // デストラクタ
+    virtual ~MeshSequence(){
+        // 先読みのスレッドを止める
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_one();
+        if (prefetcher.joinable()) prefetcher.join();
+
+        for (int i = 0; i < 2; ++i) if (fence[i]) glDeleteSync(fence[i]);
+        if (ibo != 0) {
+            GLState::get().deleteVertexArrays(2, vao);
+            GLState::get().deleteBuffers(2, vbo);
+            GLState::get().deleteBuffers(1, &ibo);
+        }
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    MeshSequence(const MeshSequence &s);
+
+    // 代入によるコピー禁止
+    MeshSequence &operator=(const MeshSequence &s);
+
+public:
+
+    // 最初の時刻を読めたかどうか
+    explicit operator bool() const { return !F.empty(); }
+
+    // 時刻 time に表示する時刻が読み終わっていれば描いていないほうのバッファに転送して入れ替える
+    // 表示する時刻より前に読み終わったものは捨て，表示する時刻のものがなければ読み終わった中で最も新しいものを使う
+    // time : 経過時間 (秒，最初に呼んだときを最初の時刻にする)
+    void update(double time){
+        if (files.size() < 2) return;
+        const auto now(std::chrono::steady_clock::now());
+        if (startTime < 0.0) {
+            startTime = time;
+            wallStart = wallLast = now;
+        }
+        // 時刻は float の和のことがあるので，刻みのわずかな丸めで時刻を飛ばさないように少し進めてから切り捨てる
+        const std::uint64_t due(static_cast<std::uint64_t>((time - startTime) * rate + 1e-3));
+        if (due <= shownStep) return;
+
+        // 表示する時刻までに読み終わったもののうち最も新しいものを取り出す
+        Step s;
+        s.step = shownStep;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wanted = due;
+            while (!ready.empty() && ready.front().step <= due) {
+                if (s.step != shownStep) spare.push_back(std::move(s.vertices));
+                s = std::move(ready.front());
+                ready.pop_front();
+            }
+        }
+        wake.notify_one();
+        if (s.step != due) ++stats.late;
+        if (s.step == shownStep) return;
+
+        // 読めなかったファイルは飛ばす
+        stats.dropped += s.step - shownStep - 1;
+        shownStep = s.step;
+        if (s.vertices.empty()) {
+            ++stats.dropped;
+            return;
+        }
+
+        // 描いていないほうのバッファに転送する (まだ GPU が使っていれば領域を捨てて新しく確保する)
+        const auto start(std::chrono::steady_clock::now());
+        const int back(front ^ 1);
+        bool busy(false);
+        if (fence[back]) {
+            busy = glClientWaitSync(fence[back], 0, 0) == GL_TIMEOUT_EXPIRED;
+            glDeleteSync(fence[back]);
+            fence[back] = 0;
+        }
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, vbo[back]);
+        const GLsizeiptr bytes(static_cast<GLsizeiptr>(vertexCount * sizeof(Object::Vertex)));
+        if (busy) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            ++stats.orphans;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, s.vertices.data());
+        front = back;
+
+        const double seconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        ++stats.shown;
+        ++stats.uploads;
+        stats.uploadSeconds += seconds;
+        stats.maxUploadSeconds = std::max(stats.maxUploadSeconds, seconds);
+        stats.bytes += static_cast<std::size_t>(bytes);
+        wallLast = now;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        spare.push_back(std::move(s.vertices));
+    }
+
+    // 描画する (使ったバッファにはフェンスを置いて次に書き換えるときに調べる)
+    void draw(){
+        GLState::get().bindVertexArray(vao[front]);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(F.size() * 3), GL_UNSIGNED_INT, 0);
+        if (fence[front]) glDeleteSync(fence[front]);
+        fence[front] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // 時刻の数
+    std::size_t size() const { return files.size(); }
+
+    // 頂点の数と三角形の数
+    std::size_t getVertexCount() const { return vertexCount; }
+    std::size_t getTriangleCount() const { return F.size(); }
+
+    // 再生の記録を表示する
+    void print(std::ostream &out){
+        Stats s;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            s = stats;
+        }
+        const double wall(std::chrono::duration<double>(wallLast - wallStart).count());
+        out << "sequence of " << files.size() << " steps at " << rate << " steps/s: first step "
+        << s.firstSeconds * 1000.0 << " ms, " << s.shown << " steps shown";
+        if (wall > 0.0) out << " (" << (s.shown - 1) / wall << " steps/s sustained)";
+        out << ", " << s.dropped << " dropped, " << s.late << " late frames\n";
+        if (s.parsed > 0)
+            out << "  prefetch " << s.parsed << " steps, mean " << s.parseSeconds / s.parsed * 1000.0 << " ms, max "
+            << s.maxParseSeconds * 1000.0 << " ms (" << s.parsed / s.parseSeconds << " steps/s)\n";
+        if (s.uploads > 0)
+            out << "  upload " << (s.bytes >> 20) << " MB, mean " << s.uploadSeconds / s.uploads * 1000.0 << " ms, max "
+            << s.maxUploadSeconds * 1000.0 << " ms, " << s.orphans << " orphaned\n";
+        out << std::flush;
+    }
+};
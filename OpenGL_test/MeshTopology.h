@@ -0,0 +1,234 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <Eigen/Core>
+#include "Parallel.h"
+
+// 三角形メッシュの接続関係
+//
+// 頂点 v に接する面は faceIndex[faceOffset[v] .. faceOffset[v + 1]),
+// 隣接する頂点は vertexIndex[vertexOffset[v] .. vertexOffset[v + 1]) に昇順に格納する (CSR 形式)．
+// ハーフエッジ h = 3 * f + j は面 f の j 番目の頂点から次の頂点へ向かう辺で，
+// 次のハーフエッジは暗黙に 3 * f + (j + 1) % 3 になるので，向かい合うハーフエッジだけを持つ
+class MeshTopology {
+public:
+
+    // 向かい合うハーフエッジがないことを表す値
+    static constexpr std::uint32_t none = 0xffffffffu;
+
+    // 辺 (両端の頂点)
+    struct Edge {
+        std::uint32_t v0, v1;
+    };
+
+private:
+
+    // 頂点の数と面の数
+    std::uint32_t vertexCount;
+    std::uint32_t faceCount;
+
+    // 頂点に接する面
+    std::vector<std::uint32_t> faceOffset;
+    std::vector<std::uint32_t> faceIndex;
+
+    // 頂点に隣接する頂点
+    std::vector<std::uint32_t> vertexOffset;
+    std::vector<std::uint32_t> vertexIndex;
+
+    // 向かい合うハーフエッジ
+    std::vector<std::uint32_t> opposite;
+
+    // 境界の辺 (向かい合うハーフエッジのないハーフエッジ)
+    std::vector<std::uint32_t> boundary;
+
+    // 三つ以上の面が共有する辺，あるいは向きの揃っていない辺
+    std::vector<Edge> nonManifold;
+
+public:
+
+    // コンストラクタ
+    // vertexCount : 頂点の数
+    // F : 面の頂点のインデックス
+    // halfEdges : ハーフエッジの表を作るかどうか
+    MeshTopology(std::size_t vertexCount, const std::vector<Eigen::Vector3i> &F, bool halfEdges = true)
+    : vertexCount(static_cast<std::uint32_t>(vertexCount))
+    , faceCount(static_cast<std::uint32_t>(F.size()))
+    {
+        buildVertexFaces(F);
+        buildVertexVertices(F);
+        if (halfEdges) buildHalfEdges(F);
+    }
+
+private:
+
+    // 頂点に接する面を計数ソートで並べる
+    void buildVertexFaces(const std::vector<Eigen::Vector3i> &F){
+        // 頂点ごとに接する面の数を数える
+        std::unique_ptr<std::atomic<std::uint32_t>[]> count(new std::atomic<std::uint32_t>[vertexCount + 1]);
+        parallelFor(0, vertexCount + 1, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) count[v].store(0, std::memory_order_relaxed);
+        });
+        parallelFor(0, faceCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t f = first; f < last; ++f)
+                for (int j = 0; j < 3; ++j) count[F[f](j)].fetch_add(1, std::memory_order_relaxed);
+        });
+
+        // 累積和が各頂点の面の並びの先頭になる
+        faceOffset.resize(vertexCount + 1);
+        parallelFor(0, vertexCount + 1, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) faceOffset[v] = count[v].load(std::memory_order_relaxed);
+        });
+        exclusiveScan(faceOffset.data(), faceOffset.size());
+
+        // 面を振り分ける
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v) count[v].store(faceOffset[v], std::memory_order_relaxed);
+        });
+        faceIndex.resize(faceOffset[vertexCount]);
+        parallelFor(0, faceCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t f = first; f < last; ++f)
+                for (int j = 0; j < 3; ++j)
+                    faceIndex[count[F[f](j)].fetch_add(1, std::memory_order_relaxed)] = static_cast<std::uint32_t>(f);
+        });
+
+        // 振り分けの順序はスレッドの実行順で変わるので頂点ごとに並べ直す
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            for (std::size_t v = first; v < last; ++v)
+                std::sort(faceIndex.begin() + faceOffset[v], faceIndex.begin() + faceOffset[v + 1]);
+        });
+    }
+
+    // 頂点に隣接する頂点を接する面から求める
+    void buildVertexVertices(const std::vector<Eigen::Vector3i> &F){
+        vertexOffset.assign(vertexCount + 1, 0);
+
+        // 頂点 v に接する面の他の頂点を重複なく並べる
+        auto gather = [&](std::uint32_t v, std::vector<std::uint32_t> &n){
+            n.clear();
+            for (std::uint32_t k = faceOffset[v]; k < faceOffset[v + 1]; ++k) {
+                const Eigen::Vector3i &f(F[faceIndex[k]]);
+                for (int j = 0; j < 3; ++j) if (static_cast<std::uint32_t>(f(j)) != v) n.push_back(f(j));
+            }
+            std::sort(n.begin(), n.end());
+            n.erase(std::unique(n.begin(), n.end()), n.end());
+        };
+
+        // 数えてから詰める
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            std::vector<std::uint32_t> n;
+            for (std::size_t v = first; v < last; ++v) {
+                gather(static_cast<std::uint32_t>(v), n);
+                vertexOffset[v] = static_cast<std::uint32_t>(n.size());
+            }
+        });
+        vertexIndex.resize(exclusiveScan(vertexOffset.data(), vertexOffset.size()));
+        parallelFor(0, vertexCount, [&](std::size_t first, std::size_t last){
+            std::vector<std::uint32_t> n;
+            for (std::size_t v = first; v < last; ++v) {
+                gather(static_cast<std::uint32_t>(v), n);
+                std::copy(n.begin(), n.end(), vertexIndex.begin() + vertexOffset[v]);
+            }
+        });
+    }
+
+    // 向かい合うハーフエッジを求め，境界と非多様体の辺を調べる
+    void buildHalfEdges(const std::vector<Eigen::Vector3i> &F){
+        opposite.assign(static_cast<std::size_t>(faceCount) * 3, none);
+
+        const std::size_t chunks(std::max<std::size_t>(1, std::min<std::size_t>(faceCount, threadCount() * 4)));
+        std::vector<std::vector<std::uint32_t>> boundaries(chunks);
+        std::vector<std::vector<Edge>> singulars(chunks);
+        const std::size_t step((faceCount + chunks - 1) / chunks);
+
+        parallelFor(0, chunks, [&](std::size_t firstChunk, std::size_t lastChunk){
+            for (std::size_t c = firstChunk; c < lastChunk; ++c) {
+                const std::size_t lastFace(std::min<std::size_t>(faceCount, (c + 1) * step));
+                for (std::size_t f = c * step; f < lastFace; ++f) {
+                    for (int j = 0; j < 3; ++j) {
+                        const std::uint32_t h(static_cast<std::uint32_t>(3 * f + j));
+                        const std::uint32_t a(F[f](j)), b(F[f]((j + 1) % 3));
+
+                        // a に接する面のうち辺 ab を含むものを調べる
+                        std::uint32_t twin(none), twins(0), same(0), lowest(h);
+                        for (std::uint32_t k = faceOffset[a]; k < faceOffset[a + 1]; ++k) {
+                            const std::uint32_t g(faceIndex[k]);
+                            for (int i = 0; i < 3; ++i) {
+                                const std::uint32_t p(F[g](i)), q(F[g]((i + 1) % 3));
+                                if (p == b && q == a) {
+                                    twin = 3 * g + i;
+                                    ++twins;
+                                    lowest = std::min(lowest, twin);
+                                }
+                                else if (p == a && q == b) {
+                                    ++same;
+                                    lowest = std::min<std::uint32_t>(lowest, 3 * g + i);
+                                }
+                            }
+                        }
+
+                        if (twins == 1 && same == 1) opposite[h] = twin;
+                        else if (twins == 0 && same == 1) boundaries[c].push_back(h);
+
+                        // 辺を共有するハーフエッジのうち番号が最小のものが報告する
+                        if ((twins > 1 || same > 1) && lowest == h) singulars[c].push_back({ std::min(a, b), std::max(a, b) });
+                    }
+                }
+            }
+        });
+
+        for (const auto &b : boundaries) boundary.insert(boundary.end(), b.begin(), b.end());
+        for (const auto &s : singulars) nonManifold.insert(nonManifold.end(), s.begin(), s.end());
+    }
+
+public:
+
+    // 頂点の数
+    std::uint32_t getVertexCount() const { return vertexCount; }
+
+    // 面の数
+    std::uint32_t getFaceCount() const { return faceCount; }
+
+    // 頂点 v に接する面の数
+    std::uint32_t faceDegree(std::uint32_t v) const { return faceOffset[v + 1] - faceOffset[v]; }
+
+    // 頂点 v に接する面の並びの先頭
+    const std::uint32_t *faces(std::uint32_t v) const { return faceIndex.data() + faceOffset[v]; }
+
+    // 頂点 v の次数
+    std::uint32_t degree(std::uint32_t v) const { return vertexOffset[v + 1] - vertexOffset[v]; }
+
+    // 頂点 v に隣接する頂点の並びの先頭
+    const std::uint32_t *neighbors(std::uint32_t v) const { return vertexIndex.data() + vertexOffset[v]; }
+
+    // ハーフエッジの表を作ったかどうか
+    bool hasHalfEdges() const { return !opposite.empty(); }
+
+    // 向かい合うハーフエッジ (なければ none)
+    std::uint32_t twin(std::uint32_t h) const { return opposite[h]; }
+
+    // 面の中で次のハーフエッジ
+    static std::uint32_t next(std::uint32_t h) { return h - h % 3 + (h + 1) % 3; }
+
+    // ハーフエッジが属する面
+    static std::uint32_t face(std::uint32_t h) { return h / 3; }
+
+    // 境界のハーフエッジ
+    const std::vector<std::uint32_t> &getBoundary() const { return boundary; }
+
+    // 非多様体の辺
+    const std::vector<Edge> &getNonManifold() const { return nonManifold; }
+
+    // CSR の先頭の配列
+    const std::vector<std::uint32_t> &getFaceOffset() const { return faceOffset; }
+    const std::vector<std::uint32_t> &getVertexOffset() const { return vertexOffset; }
+
+    // 使用しているメモリのバイト数
+    std::size_t memoryBytes() const{
+        return (faceOffset.capacity() + faceIndex.capacity() + vertexOffset.capacity() + vertexIndex.capacity()
+                + opposite.capacity() + boundary.capacity()) * sizeof(std::uint32_t)
+        + nonManifold.capacity() * sizeof(Edge);
+    }
+};
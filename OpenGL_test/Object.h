@@ -1,19 +1,16 @@
 #pragma once
 #include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "GLState.h"
+#include "VertexFormat.h"
 
-// 図形データ
-class Object {
-    // 頂点配列オブジェクト名
-    GLuint vao;
-
-    // 頂点バッファオブジェクト名
-    GLuint vbo;
-
-    // インデックスの頂点バッファオブジェクト
-    GLuint ibo;
-
-public:
-
+// 位置と法線の頂点属性
+struct PositionNormal : VertexFormat<Attribute<"position", GLfloat, 3>, Attribute<"normal", GLfloat, 3>> {
     // 頂点属性
     struct Vertex {
         // 位置
@@ -22,61 +19,449 @@ public:
         // 色
         GLfloat normal[3];
     };
+};
+static_assert(sizeof(PositionNormal::Vertex) == PositionNormal::stride, "Vertex must match the format");
+static_assert(offsetof(PositionNormal::Vertex, normal) == PositionNormal::offset(1), "Vertex must match the format");
+
+// 図形データ
+// FormatType : 頂点属性の並びの記述 (VertexFormat から派生して Vertex を定義したもの)
+// storage : 頂点属性のバッファへの並べ方
+template <typename FormatType, VertexStorage storage = VertexStorage::Interleaved>
+class BasicObject {
+public:
+
+    // 頂点属性の並びの記述と一頂点の属性
+    using Format = FormatType;
+    using Vertex = typename Format::Vertex;
+    static_assert(sizeof(Vertex) == Format::stride, "Vertex must match the format");
+
+    // 頂点バッファオブジェクトへの転送の記録
+    struct UploadStats {
+        // 転送したバイト数
+        std::size_t bytes;
+
+        // glBufferSubData() / glBufferData() の呼び出し回数
+        std::size_t calls;
+
+        // GPU が使用中だったためにバッファを捨てて丸ごと転送した回数
+        std::size_t orphans;
+
+        // 転送の間 CPU が止まっていた時間 (秒)
+        double stallSeconds;
+    };
+
+    // 動的な Object が使い回す頂点バッファオブジェクトの数
+    static constexpr int ringSize = 3;
+
+    // 環境遮蔽の attribute 変数の場所 (頂点属性の次)
+    static constexpr GLuint occlusionLocation = Format::count;
+
+private:
+
+    // 使い回す一組あたりの頂点バッファオブジェクトの数
+    static constexpr GLuint buffersPerCopy = storage == VertexStorage::Separate ? Format::count : 1;
+
+    // 頂点配列オブジェクト名 (動的ならバッファの組ごとに一つ)
+    GLuint vao[ringSize];
+
+    // 頂点バッファオブジェクト名 (組ごとに buffersPerCopy 個ずつ)
+    GLuint vbo[ringSize * buffersPerCopy];
+
+    // インデックスの頂点バッファオブジェクト
+    GLuint ibo;
+
+    // 環境遮蔽の頂点バッファオブジェクト (なければ 0，後から作るので mutable)
+    mutable GLuint aoBuffer;
+
+    // 重ねて描く辺のインデックスの頂点バッファオブジェクト (なければ 0) とインデックスの数
+    GLuint lineBuffer;
+    GLsizei linecount;
+
+    // 使用している頂点バッファオブジェクトの組の数 (静的なら 1)
+    int copies;
+
+    // 描画に使う頂点バッファオブジェクトの組
+    int current;
+
+    // 頂点の数とインデックスの数
+    GLsizei vertexcount;
+    GLsizei indexcount;
+
+    // 動的な Object の頂点属性の CPU 側の写し
+    std::vector<Vertex> shadow;
+
+    // 属性ごとのバッファに分けて転送するときの作業領域
+    std::vector<std::uint8_t> scratch;
+
+    // 頂点バッファオブジェクトの組ごとにまだ反映していない範囲 [first, last)
+    std::vector<std::pair<GLint, GLint>> dirty[ringSize];
+
+    // 頂点バッファオブジェクトの組ごとの描画の完了を待つフェンス
+    GLsync fence[ringSize];
+
+    // 今のフレーム，直前のフレーム，累計の転送の記録
+    UploadStats frameStats, lastStats, totalStats;
+
+    // これより間隔の狭い範囲は一つにまとめて転送する (頂点数)
+    static constexpr GLint mergeGap = 256;
+
+    // 属性ごとのバッファに分けて一度に転送する頂点の数
+    static constexpr GLsizei scratchVertices = 1 << 16;
+
+public:
 
     // コンストラクタ
-    // size : 頂点位置の次元
     // vertexcount : 頂点の数
-    // vertex : 頂点属性を格納した配列
+    // vertex : 頂点属性を格納した配列 (NULL なら領域だけ確保して後から update() で転送する)
     // indexcount: 頂点のインデックスの要素数
     // index: 頂点のインデックスを格納した配列
-    Object(GLint size, GLsizei vertexcount, const Vertex *vertex,
-           GLsizei indexcount = 0, const GLuint *index = NULL){
-        // 頂点配列オブジェクト
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
+    // dynamic : 頂点属性を部分的に書き換えるなら true
+    BasicObject(GLsizei vertexcount, const Vertex *vertex,
+                GLsizei indexcount = 0, const GLuint *index = NULL, bool dynamic = false)
+    : aoBuffer(0)
+    , lineBuffer(0)
+    , linecount(0)
+    , copies(dynamic ? ringSize : 1)
+    , current(0)
+    , vertexcount(vertexcount)
+    , indexcount(indexcount)
+    , frameStats()
+    , lastStats()
+    , totalStats()
+    {
+        // インデックスの頂点バッファオブジェクト
+        glGenBuffers(1, &ibo);
 
-        // 頂点バッファオブジェクト
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertexcount* sizeof(Vertex), vertex, GL_STATIC_DRAW);
+        // 動的なら書き換え中のバッファを GPU が使っていても待たずに済むように複数用意する
+        glGenVertexArrays(copies, vao);
+        glGenBuffers(copies * buffersPerCopy, vbo);
+        for (int i = 0; i < copies; ++i) {
+            setup(i, dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW, vertex);
 
-        // 結合されている頂点バッファオブジェクトを in 変数から参照できるようにする
-        glVertexAttribPointer(0, size, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex*>(0)->position);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex*>(0)->normal);
-        glEnableVertexAttribArray(1);
+            // インデックスの頂点バッファオブジェクトは共有する
+            if (i == 0) glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexcount * sizeof (GLuint), index, GL_STATIC_DRAW);
+        }
 
-        // インデックスの頂点バッファオブジェクト
-        glGenBuffers(1, &ibo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexcount * sizeof (GLuint), index, GL_STATIC_DRAW);
+        // 動的なら書き換えに使う写しを持っておく
+        if (dynamic) {
+            if (vertex) shadow.assign(vertex, vertex + vertexcount);
+            else shadow.resize(vertexcount);
+        }
     }
 
     // デストラクタ
-    virtual ~Object(){
+    virtual ~BasicObject(){
         // 頂点配列オブジェクトを削除する
-        glDeleteVertexArrays(1, &vao);
+        GLState::get().deleteVertexArrays(copies, vao);
 
         // 頂点バッファオブジェクトを削除する
-        glDeleteBuffers(1, &vbo);
+        GLState::get().deleteBuffers(copies * buffersPerCopy, vbo);
 
         // インデックスの頂点バッファオブジェクトを削除する
-        glDeleteBuffers(1, &ibo);
+        GLState::get().deleteBuffers(1, &ibo);
+
+        // 環境遮蔽の頂点バッファオブジェクトを削除する
+        if (aoBuffer != 0) GLState::get().deleteBuffers(1, &aoBuffer);
+
+        // 辺のインデックスの頂点バッファオブジェクトを削除する
+        if (lineBuffer != 0) GLState::get().deleteBuffers(1, &lineBuffer);
+
+        // フェンスを削除する
+        for (int i = 0; i < copies; ++i) if (fence[i]) glDeleteSync(fence[i]);
     }
 
 private:
 
     // コピーコンストラクタによるコピー禁止
-    Object(const Object &o);
+    BasicObject(const BasicObject &o);
 
     // 代入によるコピー禁止
-    Object &operator=(const Object &o);
+    BasicObject &operator=(const BasicObject &o);
+
+    // 組 c の頂点配列オブジェクトと頂点バッファオブジェクトを用意する
+    // vertex : 頂点属性を格納した配列 (NULL なら領域だけ確保する)
+    void setup(int c, GLenum usage, const Vertex *vertex){
+        // 頂点配列オブジェクト
+        GLState::get().bindVertexArray(vao[c]);
+
+        // 頂点バッファオブジェクトを確保して in 変数から参照できるようにする
+        allocate(c, usage);
+        for (GLuint k = 0; k < buffersPerCopy; ++k) {
+            GLState::get().bindBuffer(GL_ARRAY_BUFFER, vbo[c * buffersPerCopy + k]);
+            if (storage == VertexStorage::Separate) Format::setPointer(k, 0, 0);
+            else Format::setInterleaved();
+        }
+        if (vertex) transfer(c, 0, vertexcount, vertex);
+
+        // インデックスと環境遮蔽の頂点バッファオブジェクトは共有する
+        GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        if (aoBuffer != 0) {
+            GLState::get().bindBuffer(GL_ARRAY_BUFFER, aoBuffer);
+            glVertexAttribPointer(occlusionLocation, 1, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(occlusionLocation);
+        }
+
+        fence[c] = 0;
+    }
+
+    // 組 c の頂点バッファオブジェクトの領域を確保し直す (以前の内容は捨てる)
+    void allocate(int c, GLenum usage){
+        for (GLuint k = 0; k < buffersPerCopy; ++k) {
+            GLState::get().bindBuffer(GL_ARRAY_BUFFER, vbo[c * buffersPerCopy + k]);
+            glBufferData(GL_ARRAY_BUFFER, vertexcount * (storage == VertexStorage::Separate ? Format::bytes[k] : Format::stride),
+                         NULL, usage);
+        }
+    }
+
+    // 組 c の頂点バッファオブジェクトの頂点 [first, first + count) に転送する
+    // 属性ごとのバッファなら属性ごとに取り出して詰めてから転送する
+    void transfer(int c, GLint first, GLsizei count, const Vertex *vertex){
+        if (storage == VertexStorage::Interleaved) {
+            GLState::get().bindBuffer(GL_ARRAY_BUFFER, vbo[c]);
+            glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), vertex);
+            return;
+        }
+        const std::uint8_t *const source(reinterpret_cast<const std::uint8_t *>(vertex));
+        for (GLuint k = 0; k < buffersPerCopy; ++k) {
+            const std::size_t bytes(Format::bytes[k]), offset(Format::offset(k));
+            GLState::get().bindBuffer(GL_ARRAY_BUFFER, vbo[c * buffersPerCopy + k]);
+            for (GLsizei done = 0; done < count; done += scratchVertices) {
+                const GLsizei n(std::min(scratchVertices, count - done));
+                scratch.resize(n * bytes);
+                for (GLsizei v = 0; v < n; ++v) {
+                    const std::uint8_t *const p(source + (done + v) * sizeof(Vertex) + offset);
+                    std::copy(p, p + bytes, scratch.data() + v * bytes);
+                }
+                glBufferSubData(GL_ARRAY_BUFFER, (first + done) * bytes, n * bytes, scratch.data());
+            }
+        }
+    }
+
+    // 転送を記録する
+    void record(std::size_t bytes){
+        frameStats.bytes += bytes;
+        frameStats.calls += buffersPerCopy;
+    }
+
+    // フレームの転送の記録を締める
+    void endFrame(){
+        totalStats.bytes += frameStats.bytes;
+        totalStats.calls += frameStats.calls;
+        totalStats.orphans += frameStats.orphans;
+        totalStats.stallSeconds += frameStats.stallSeconds;
+        lastStats = frameStats;
+        frameStats = UploadStats();
+    }
 
 public:
 
     //頂点配列オブジェクトの結合
     void bind() const{
         // 頂点配列オブジェクトを指定する
-        glBindVertexArray(vao);
+        GLState::get().bindVertexArray(vao[current]);
+    }
+
+    // 頂点属性を部分的に書き換えられるかどうか
+    bool isDynamic() const { return copies > 1; }
+
+    // 静的な Object を初めて書き換える前に動的に切り替える
+    // 書き換えない間は頂点バッファオブジェクト一組だけで CPU 側の写しも持たずに済む
+    // 今の内容は GPU 上で残りの組に複写し，写しは一度だけ読み戻して作る
+    void makeDynamic(){
+        if (isDynamic()) return;
+        glGenVertexArrays(ringSize - 1, vao + 1);
+        glGenBuffers((ringSize - 1) * buffersPerCopy, vbo + buffersPerCopy);
+        for (int i = 1; i < ringSize; ++i) {
+            setup(i, GL_DYNAMIC_DRAW, NULL);
+            for (GLuint k = 0; k < buffersPerCopy; ++k) {
+                const GLsizeiptr bytes(vertexcount * (storage == VertexStorage::Separate ? Format::bytes[k] : Format::stride));
+                GLState::get().bindBuffer(GL_COPY_READ_BUFFER, vbo[k]);
+                GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, vbo[i * buffersPerCopy + k]);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+            }
+        }
+
+        // 属性ごとのバッファなら属性ごとに読み戻して頂点の並びに戻す
+        shadow.resize(vertexcount);
+        if (storage == VertexStorage::Interleaved) {
+            GLState::get().bindBuffer(GL_COPY_READ_BUFFER, vbo[0]);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vertexcount * sizeof(Vertex), shadow.data());
+        }
+        else {
+            std::uint8_t *const target(reinterpret_cast<std::uint8_t *>(shadow.data()));
+            for (GLuint k = 0; k < buffersPerCopy; ++k) {
+                const std::size_t bytes(Format::bytes[k]), offset(Format::offset(k));
+                GLState::get().bindBuffer(GL_COPY_READ_BUFFER, vbo[k]);
+                for (GLsizei done = 0; done < vertexcount; done += scratchVertices) {
+                    const GLsizei n(std::min(scratchVertices, vertexcount - done));
+                    scratch.resize(n * bytes);
+                    glGetBufferSubData(GL_COPY_READ_BUFFER, done * bytes, n * bytes, scratch.data());
+                    for (GLsizei v = 0; v < n; ++v)
+                        std::copy(scratch.data() + v * bytes, scratch.data() + (v + 1) * bytes,
+                                  target + (done + v) * sizeof(Vertex) + offset);
+                }
+            }
+        }
+        copies = ringSize;
+    }
+
+    // 頂点バッファオブジェクトの一部を書き換える
+    // 動的な Object では写しを書き換えて範囲を記録するだけで，転送は flush() で行う
+    // first : 書き換える最初の頂点の番号
+    // count : 書き換える頂点の数
+    // vertex : 頂点属性を格納した配列
+    void update(GLint first, GLsizei count, const Vertex *vertex){
+        if (isDynamic()) {
+            std::copy(vertex, vertex + count, modify(first, count));
+            return;
+        }
+        const auto start(std::chrono::steady_clock::now());
+        transfer(0, first, count, vertex);
+        record(count * sizeof(Vertex));
+        frameStats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // インデックスの一部を転送する (インデックスを NULL で確保した Object に後から少しずつ送るときに使う)
+    // first : 書き換える最初のインデックスの番号
+    // count : 書き換えるインデックスの要素数
+    // index : 頂点のインデックスを格納した配列
+    void updateIndices(GLint first, GLsizei count, const GLuint *index){
+        const auto start(std::chrono::steady_clock::now());
+        GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(GLuint), count * sizeof(GLuint), index);
+        frameStats.bytes += count * sizeof(GLuint);
+        ++frameStats.calls;
+        frameStats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 動的な Object の頂点属性の一部をその場で書き換えるために写しを取り出す
+    // 取り出した範囲は書き換えたものとして flush() で転送する
+    // first : 書き換える最初の頂点の番号
+    // count : 書き換える頂点の数
+    Vertex *modify(GLint first, GLsizei count){
+        if (count > 0)
+            for (int i = 0; i < copies; ++i) dirty[i].emplace_back(first, first + count);
+        return shadow.data() + first;
+    }
+
+    // 書き換えた範囲を次に描画する頂点バッファオブジェクトに転送する
+    // フレームごとに描画の前に一度呼ぶ．静的な Object では update() の記録を区切るだけ
+    void flush(){
+        // 次に使うバッファは最も前に書き換えたものなので，これが最新なら他もすべて最新になっている
+        if (!isDynamic() || dirty[(current + 1) % copies].empty()) {
+            endFrame();
+            return;
+        }
+
+        // 今のバッファを使う描画が終わったら分かるようにして次のバッファに移る
+        if (fence[current]) glDeleteSync(fence[current]);
+        fence[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current = (current + 1) % copies;
+
+        const auto start(std::chrono::steady_clock::now());
+        std::vector<std::pair<GLint, GLint>> &ranges(dirty[current]);
+
+        // 範囲を並べて重なるものや近いものをまとめる
+        std::sort(ranges.begin(), ranges.end());
+        std::size_t n(0);
+        GLsizei total(0);
+        for (std::size_t k = 1; k <= ranges.size(); ++k) {
+            if (k < ranges.size() && ranges[k].first <= ranges[n].second + mergeGap) {
+                ranges[n].second = std::max(ranges[n].second, ranges[k].second);
+                continue;
+            }
+            total += ranges[n].second - ranges[n].first;
+            if (k < ranges.size()) ranges[++n] = ranges[k];
+        }
+        ranges.resize(n + 1);
+
+        // このバッファを使う描画がまだ終わっていなければ待たずに新しい領域に丸ごと転送する
+        // 書き換える範囲が大半を占めるときも一度に送ったほうが速い
+        bool busy(false);
+        if (fence[current]) {
+            busy = glClientWaitSync(fence[current], 0, 0) == GL_TIMEOUT_EXPIRED;
+            glDeleteSync(fence[current]);
+            fence[current] = 0;
+        }
+        if (busy || total * 2 > vertexcount) {
+            allocate(current, GL_DYNAMIC_DRAW);
+            transfer(current, 0, vertexcount, shadow.data());
+            record(vertexcount * sizeof(Vertex));
+            if (busy) ++frameStats.orphans;
+        }
+        else {
+            for (const auto &r : ranges) {
+                transfer(current, r.first, r.second - r.first, shadow.data() + r.first);
+                record((r.second - r.first) * sizeof(Vertex));
+            }
+        }
+        ranges.clear();
+
+        frameStats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        endFrame();
+    }
+
+    // CPU 側に持っている写しのバイト数
+    std::size_t memoryBytes() const { return shadow.capacity() * sizeof(Vertex) + scratch.capacity(); }
+
+    // GPU 側のバッファのバイト数 (ドライバも同じ大きさの写しを持つことがある)
+    std::size_t gpuBytes() const{
+        return static_cast<std::size_t>(copies) * vertexcount * sizeof(Vertex) + (indexcount + linecount) * sizeof(GLuint)
+        + (aoBuffer != 0 ? vertexcount * sizeof(GLfloat) : 0);
+    }
+
+    // 直前のフレームの転送の記録
+    const UploadStats &getUploadStats() const { return lastStats; }
+
+    // 累計の転送の記録
+    const UploadStats &getTotalUploadStats() const { return totalStats; }
+
+    // 頂点ごとの環境遮蔽を occlusionLocation 番の attribute 変数に結合する
+    // 結合していない Object では glVertexAttrib1f(occlusionLocation, 1.0f) で設定した既定値が使われる
+    // count : 頂点の数
+    // occlusion : 頂点ごとの遮られなかった割合 (0〜1)
+    void setOcclusion(GLsizei count, const GLfloat *occlusion) const{
+        if (aoBuffer == 0) glGenBuffers(1, &aoBuffer);
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, aoBuffer);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(GLfloat), occlusion, GL_STATIC_DRAW);
+        for (int i = 0; i < copies; ++i) {
+            GLState::get().bindVertexArray(vao[i]);
+            glVertexAttribPointer(occlusionLocation, 1, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(occlusionLocation);
+        }
+    }
+
+    // 同じ頂点に重ねて GL_LINES で描く辺のインデックスを設定する
+    // 頂点バッファオブジェクトを共有するので，頂点を書き換えても辺の側には何も写さなくてよい
+    // count : インデックスの要素数
+    // index : 辺の両端の頂点の番号を格納した配列
+    void setLines(GLsizei count, const GLuint *index){
+        if (lineBuffer == 0) glGenBuffers(1, &lineBuffer);
+        GLState::get().bindBuffer(GL_COPY_WRITE_BUFFER, lineBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, count * sizeof(GLuint), index, GL_STATIC_DRAW);
+        linecount = count;
+    }
+
+    // 辺のインデックスを設定したかどうか
+    bool hasLines() const { return lineBuffer != 0; }
+
+    // 辺を描画する (頂点配列オブジェクトのインデックスを一時的に差し替える)
+    void drawLines() const{
+        if (lineBuffer == 0) return;
+        bind();
+        GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, lineBuffer);
+        glDrawElements(GL_LINES, linecount, GL_UNSIGNED_INT, 0);
+        GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
     }
 };
+
+// メッシュの頂点属性のバッファへの並べ方
+// OBJECT_SEPARATE_ATTRIBUTES を定義してビルドすると属性ごとのバッファにする (描画の速さを比べるため)
+#if defined(OBJECT_SEPARATE_ATTRIBUTES)
+constexpr VertexStorage objectStorage = VertexStorage::Separate;
+#else
+constexpr VertexStorage objectStorage = VertexStorage::Interleaved;
+#endif
+
+// メッシュの図形データ
+using Object = BasicObject<PositionNormal, objectStorage>;
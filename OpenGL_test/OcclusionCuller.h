@@ -0,0 +1,326 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Matrix.h"
+#include "JobSystem.h"
+#include "Simd.h"
+
+// 低解像度の深度バッファによるオクルージョンカリング
+//
+// 大きな遮蔽物の三角形を CPU で小さな深度バッファに描き，2x2 の最大値を取りながら縮小した階層を作る．
+// 物体のバウンディングスフィアの最も手前の深度が，画面上で覆う範囲の最も奥の深度より奥なら隠れている．
+// 遮蔽物は実際の面の一部だけでよい (描かなかった部分は何も隠さないだけなので見えるものは消えない)．
+// ただし画素の中心で塗るので，遮蔽物の縁の 1 画素未満の隙間からしか見えないものは消えることがある
+class OcclusionCuller {
+public:
+
+    // 統計情報
+    struct Stats {
+        // 描いた遮蔽物の三角形の数
+        std::size_t triangles;
+
+        // 調べた物体の数
+        std::size_t tested;
+
+        // 隠れていた物体の数
+        std::size_t culled;
+
+        // 遮蔽物を描いて判定するまでの時間 (秒)
+        double seconds;
+    };
+
+private:
+
+    // 深度バッファの階層の一段
+    struct Level {
+        int width, height;
+
+        // 深度 ([0, 1] で 1 が最も奥)
+        std::vector<float> depth;
+    };
+
+    // 塗るための三角形の設定
+    struct Setup {
+        // 辺の関数 (ex * x + ey * y + ec，内側で正)
+        float ex[3], ey[3], ec[3];
+
+        // 深度の平面 (dzdx * x + dzdy * y + zc)
+        float dzdx, dzdy, zc;
+
+        // 三角形を囲む画素の範囲 (minX は 4 の倍数)
+        int minX, maxX, minY, maxY;
+    };
+
+    // 深度バッファのサイズ (幅は 4 の倍数)
+    const int width, height;
+
+    // 遮蔽物を塗る深度バッファ ([0, 1] で 1 が最も奥)
+    std::vector<float> raster;
+
+    // 判定に使う深度バッファの階層 (0 番が元の解像度で，上の段は下の段の 2x2 の最大値)
+    std::vector<Level> levels;
+
+    // 投影変換行列とモデルビュー変換行列
+    Matrix projection, modelview;
+
+    // 深度バッファの座標に変換した遮蔽物の三角形 (頂点ごとに x, y, z)
+    std::vector<float> screen;
+
+    // 一つの仕事で塗る行数
+    static constexpr int band = 8;
+
+    // 三角形の設定と，帯ごとのかかる三角形の番号
+    std::vector<Setup> setups;
+    std::vector<std::vector<std::uint32_t>> bins;
+
+    // 統計情報
+    Stats stats;
+
+    // 計測の開始時刻
+    std::chrono::steady_clock::time_point start;
+
+    // 経過時間を統計情報に加える
+    void lap(){
+        const auto now(std::chrono::steady_clock::now());
+        stats.seconds += std::chrono::duration<double>(now - start).count();
+        start = now;
+    }
+
+    // 三角形の設定を求める (画面外や潰れた三角形なら false)
+    bool setup(const float *v0, const float *v1, const float *v2, Setup &s) const{
+        float area((v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]));
+        if (std::abs(area) < 1e-8f) return false;
+        if (area < 0.0f) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+        s.minY = std::max(0, static_cast<int>(std::floor(std::min({ v0[1], v1[1], v2[1] }))));
+        s.maxY = std::min(height - 1, static_cast<int>(std::ceil(std::max({ v0[1], v1[1], v2[1] }))));
+        s.minX = std::max(0, static_cast<int>(std::floor(std::min({ v0[0], v1[0], v2[0] })))) & ~3;
+        s.maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max({ v0[0], v1[0], v2[0] }))));
+        if (s.minY > s.maxY || s.minX > s.maxX) return false;
+
+        const float *const a[3] = { v0, v1, v2 }, *const b[3] = { v1, v2, v0 };
+        for (int i = 0; i < 3; ++i) {
+            s.ex[i] = a[i][1] - b[i][1];
+            s.ey[i] = b[i][0] - a[i][0];
+            s.ec[i] = -(s.ex[i] * a[i][0] + s.ey[i] * a[i][1]);
+        }
+        s.dzdx = ((v1[2] - v0[2]) * (v2[1] - v0[1]) - (v2[2] - v0[2]) * (v1[1] - v0[1])) / area;
+        s.dzdy = ((v2[2] - v0[2]) * (v1[0] - v0[0]) - (v1[2] - v0[2]) * (v2[0] - v0[0])) / area;
+        s.zc = v0[2] - s.dzdx * v0[0] - s.dzdy * v0[1];
+        return true;
+    }
+
+    // 帯 k にかかる三角形を塗る
+    void rasterize(std::size_t k){
+        const int y0(static_cast<int>(k) * band), y1(std::min(height, y0 + band));
+        const Float4 offset(0.5f, 1.5f, 2.5f, 3.5f), zero(0.0f);
+        for (const std::uint32_t t : bins[k]) {
+            const Setup &s(setups[t]);
+
+            // 4 画素ずつ塗る
+            for (int y = std::max(y0, s.minY); y <= std::min(y1 - 1, s.maxY); ++y) {
+                const float py(y + 0.5f);
+                const Float4 e0(s.ey[0] * py + s.ec[0]), e1(s.ey[1] * py + s.ec[1]), e2(s.ey[2] * py + s.ec[2]);
+                const Float4 zy(s.dzdy * py + s.zc);
+                float *const row(raster.data() + static_cast<std::size_t>(y) * width);
+                for (int x = s.minX; x <= s.maxX; x += 4) {
+                    const Float4 px(Float4(static_cast<float>(x)) + offset);
+                    const Float4 inside((Float4(s.ex[0]) * px + e0 >= zero)
+                                        & (Float4(s.ex[1]) * px + e1 >= zero)
+                                        & (Float4(s.ex[2]) * px + e2 >= zero));
+                    if (mask(inside) == 0) continue;
+                    const Float4 z(Float4(s.dzdx) * px + zy);
+                    const Float4 d(Float4::load(row + x));
+                    select(inside, min(z, d), d).store(row + x);
+                }
+            }
+        }
+    }
+
+    // 階層を作る
+    // 塗った深度バッファは 3x3 の最大値を取って遮蔽物を 1 画素ずつ細らせてから 0 段目にする
+    void buildPyramid(){
+        const std::vector<float> &painted(raster);
+        Level &base(levels[0]);
+        for (int y = 0; y < height; ++y) {
+            const int y0(std::max(y - 1, 0)), y1(std::min(y + 1, height - 1));
+            for (int x = 0; x < width; ++x) {
+                const int x0(std::max(x - 1, 0)), x1(std::min(x + 1, width - 1));
+                float d(0.0f);
+                for (int yy = y0; yy <= y1; ++yy)
+                    for (int xx = x0; xx <= x1; ++xx) d = std::max(d, painted[yy * width + xx]);
+                base.depth[y * width + x] = d;
+            }
+        }
+        for (std::size_t l = 1; l < levels.size(); ++l) {
+            const Level &below(levels[l - 1]);
+            Level &level(levels[l]);
+            for (int y = 0; y < level.height; ++y) {
+                const int y0(std::min(y * 2, below.height - 1)), y1(std::min(y * 2 + 1, below.height - 1));
+                for (int x = 0; x < level.width; ++x) {
+                    const int x0(std::min(x * 2, below.width - 1)), x1(std::min(x * 2 + 1, below.width - 1));
+                    level.depth[y * level.width + x] = std::max(
+                        std::max(below.depth[y0 * below.width + x0], below.depth[y0 * below.width + x1]),
+                        std::max(below.depth[y1 * below.width + x0], below.depth[y1 * below.width + x1]));
+                }
+            }
+        }
+    }
+
+public:
+
+    // コンストラクタ
+    // width, height : 深度バッファのサイズ (幅は 4 の倍数に切り上げる)
+    OcclusionCuller(int width = 256, int height = 128)
+    : width((std::max(width, 4) + 3) & ~3)
+    , height(std::max(height, 1))
+    , raster(static_cast<std::size_t>(this->width) * this->height, 1.0f)
+    , bins((this->height + band - 1) / band)
+    , stats()
+    {
+        int w(this->width), h(this->height);
+        for (;;) {
+            levels.push_back(Level{ w, h, std::vector<float>(static_cast<std::size_t>(w) * h, 1.0f) });
+            if (w == 1 && h == 1) break;
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+    }
+
+    // フレームの遮蔽物を描き始める
+    // projection : 投影変換行列
+    // modelview : モデルビュー変換行列
+    void begin(const Matrix &projection, const Matrix &modelview){
+        start = std::chrono::steady_clock::now();
+        this->projection = projection;
+        this->modelview = modelview;
+        screen.clear();
+        std::fill(raster.begin(), raster.end(), 1.0f);
+    }
+
+    // 遮蔽物の三角形を加える
+    // position : 三角形ごとに三つの頂点の位置を並べた配列
+    // count : 三角形の数
+    // depthBias : 頂点を視線に沿って視点から遠ざける距離 (遮蔽物が元の面からずれている大きさ，モデルビュー変換は長さを変えないものとする)
+    // 前方のクリッピング面より手前にかかる三角形は描かない
+    // 頂点を視線に沿って動かしても画面上の位置は変わらないので，覆う範囲はそのままで深度だけが奥になる
+    void addOccluders(const GLfloat *position, std::size_t count, GLfloat depthBias = 0.0f){
+        for (std::size_t t = 0; t < count; ++t) {
+            float v[9];
+            bool front(true);
+            for (int k = 0; k < 3 && front; ++k) {
+                const GLfloat *const p(position + (t * 3 + k) * 3);
+                GLfloat e[3], c[4];
+                for (int i = 0; i < 3; ++i) e[i] = modelview[i] * p[0] + modelview[4 + i] * p[1] + modelview[8 + i] * p[2] + modelview[12 + i];
+                const GLfloat s(1.0f + depthBias / std::max(std::sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]), 1e-6f));
+                for (int i = 0; i < 4; ++i) c[i] = (projection[i] * e[0] + projection[4 + i] * e[1] + projection[8 + i] * e[2]) * s + projection[12 + i];
+                if (c[2] < -c[3] || c[3] <= 0.0f) {
+                    front = false;
+                    break;
+                }
+                v[k * 3] = (c[0] / c[3] * 0.5f + 0.5f) * width;
+                v[k * 3 + 1] = (c[1] / c[3] * 0.5f + 0.5f) * height;
+                v[k * 3 + 2] = c[2] / c[3] * 0.5f + 0.5f;
+            }
+            if (front) screen.insert(screen.end(), v, v + 9);
+        }
+    }
+
+    // 加えた遮蔽物を描いて階層を作る
+    // jobs : 行の帯ごとに並列に塗るスレッドプール
+    void rasterize(JobSystem &jobs){
+        // 三角形を設定して，かかる帯に振り分ける
+        setups.resize(screen.size() / 9);
+        for (auto &b : bins) b.clear();
+        std::uint32_t n(0);
+        for (std::size_t t = 0; t < screen.size(); t += 9) {
+            Setup &s(setups[n]);
+            if (!setup(&screen[t], &screen[t + 3], &screen[t + 6], s)) continue;
+            for (int k = s.minY / band; k <= s.maxY / band; ++k) bins[k].push_back(n);
+            ++n;
+        }
+
+        // 帯ごとに並列に塗る
+        jobs.parallelFor(0, bins.size(), 1, [this](std::size_t first, std::size_t last){
+            for (std::size_t k = first; k < last; ++k) rasterize(k);
+        }, "occlusion");
+        buildPyramid();
+        stats.triangles += screen.size() / 9;
+        lap();
+    }
+
+    // 球が遮蔽物に隠れずに見えるかどうか
+    // c : 中心の位置
+    // r : 半径
+    bool visible(const GLfloat *c, GLfloat r){
+        start = std::chrono::steady_clock::now();
+        ++stats.tested;
+        const bool result(test(c, r));
+        if (!result) ++stats.culled;
+        lap();
+        return result;
+    }
+
+    // 統計情報を取り出す
+    const Stats &getStats() const { return stats; }
+
+    // 統計情報を消す
+    void resetStats() { stats = Stats(); }
+
+    // 深度バッファのサイズ
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // 判定に使う深度バッファ ([0, 1] で 1 が最も奥，下の行から)
+    const float *getDepth() const { return levels[0].depth.data(); }
+
+private:
+
+    // 球が見えるかどうかを判定する
+    bool test(const GLfloat *c, GLfloat r) const{
+        // 視点座標系での中心
+        GLfloat e[3];
+        for (int i = 0; i < 3; ++i) e[i] = modelview[i] * c[0] + modelview[4 + i] * c[1] + modelview[8 + i] * c[2] + modelview[12 + i];
+
+        // 最も手前の点が前方のクリッピング面より手前なら見えるものとする
+        const GLfloat nz(e[2] + r);
+        if (nz >= 0.0f) return true;
+        const GLfloat cz(projection[2] * e[0] + projection[6] * e[1] + projection[10] * nz + projection[14]);
+        const GLfloat cw(projection[3] * e[0] + projection[7] * e[1] + projection[11] * nz + projection[15]);
+        if (cw <= 0.0f || cz < -cw) return true;
+        const float nearest(cz / cw * 0.5f + 0.5f);
+
+        // 球を囲む箱の八つの頂点を投影して画面上の範囲を求める
+        float minX(static_cast<float>(width)), maxX(0.0f), minY(static_cast<float>(height)), maxY(0.0f);
+        for (int k = 0; k < 8; ++k) {
+            const GLfloat p[3] = { e[0] + (k & 1 ? r : -r), e[1] + (k & 2 ? r : -r), e[2] + (k & 4 ? r : -r) };
+            const GLfloat x(projection[0] * p[0] + projection[4] * p[1] + projection[8] * p[2] + projection[12]);
+            const GLfloat y(projection[1] * p[0] + projection[5] * p[1] + projection[9] * p[2] + projection[13]);
+            const GLfloat w(projection[3] * p[0] + projection[7] * p[1] + projection[11] * p[2] + projection[15]);
+            const float sx((x / w * 0.5f + 0.5f) * width), sy((y / w * 0.5f + 0.5f) * height);
+            minX = std::min(minX, sx);
+            maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy);
+            maxY = std::max(maxY, sy);
+        }
+        const int x0(std::max(0, static_cast<int>(std::floor(minX)))), x1(std::min(width - 1, static_cast<int>(std::floor(maxX))));
+        const int y0(std::max(0, static_cast<int>(std::floor(minY)))), y1(std::min(height - 1, static_cast<int>(std::floor(maxY))));
+        if (x0 > x1 || y0 > y1) return true;
+
+        // 範囲が 2x2 以下の画素に収まる段で最も奥の深度を求める
+        std::size_t l(0);
+        while (l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1)) ++l;
+        const Level &level(levels[l]);
+        float farthest(0.0f);
+        for (int y = y0 >> l; y <= (y1 >> l); ++y)
+            for (int x = x0 >> l; x <= (x1 >> l); ++x)
+                farthest = std::max(farthest, level.depth[y * level.width + x]);
+        return nearest <= farthest;
+    }
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// 使用するスレッドの数
+// hardware_concurrency() はシステムコールになることがあるので最初の一回だけ問い合わせる
+inline unsigned int threadCount(){
+    static const unsigned int n(std::max(1u, std::thread::hardware_concurrency()));
+    return n;
+}
+
+// [begin, end) をスレッドの数に分割して並列に処理する
+// func : 分割した範囲 [first, last) を処理する関数
+template <typename Func>
+void parallelFor(std::size_t begin, std::size_t end, Func func){
+    if (end <= begin) return;
+    const std::size_t count(std::min<std::size_t>(threadCount(), end - begin));
+    if (count == 1) {
+        func(begin, end);
+        return;
+    }
+
+    // 最後の範囲はこのスレッドで処理する
+    std::vector<std::thread> workers;
+    const std::size_t step((end - begin + count - 1) / count);
+    for (std::size_t first = begin; first < end; first += step) {
+        const std::size_t last(std::min(end, first + step));
+        if (last == end) func(first, last);
+        else workers.emplace_back(func, first, last);
+    }
+    for (auto &w : workers) w.join();
+}
+
+// 配列を並列に累積和 (自身を含まない) に置き換えて総和を返す
+// values : 値を格納した配列 (結果で上書きされる)
+// count : 要素の数
+template <typename T>
+T exclusiveScan(T *values, std::size_t count){
+    if (count == 0) return T(0);
+
+    // 範囲ごとの総和を求める
+    const std::size_t blocks(std::min<std::size_t>(threadCount() * 4, count));
+    const std::size_t step((count + blocks - 1) / blocks);
+    std::vector<T> sums(blocks + 1, T(0));
+    parallelFor(0, blocks, [&](std::size_t first, std::size_t last){
+        for (std::size_t b = first; b < last; ++b) {
+            T s(0);
+            for (std::size_t i = b * step; i < std::min(count, (b + 1) * step); ++i) s += values[i];
+            sums[b + 1] = s;
+        }
+    });
+    for (std::size_t b = 0; b < blocks; ++b) sums[b + 1] += sums[b];
+
+    // 範囲ごとに先頭の値から累積する
+    parallelFor(0, blocks, [&](std::size_t first, std::size_t last){
+        for (std::size_t b = first; b < last; ++b) {
+            T s(sums[b]);
+            for (std::size_t i = b * step; i < std::min(count, (b + 1) * step); ++i) {
+                const T v(values[i]);
+                values[i] = s;
+                s += v;
+            }
+        }
+    });
+    return sums[blocks];
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "Object.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "ChunkedMesh.h"
+#include "Parallel.h"
+
+// 先頭からどこで切っても一様に間引いた点群になるように並べた点群
+//
+// 点をモートン順に並べてから，並びの番号をビット反転した順に取り出す．
+// 先頭の 2^k 個の点はモートン順の並びを 2^k 個の等しい区間に分けた各区間から一点ずつ取ったものになる．
+// 点の法線の代わりに色を持つ (法線があればメッシュと同じく法線を，なければ位置を色にする)
+//
+// ファイルの構成
+//   Header
+//   並べ替えた点 (Object::Vertex)
+class PointCloud {
+public:
+
+    // ファイルの先頭に置くヘッダ
+    struct Header {
+        // 識別子
+        char magic[8];
+
+        // 点の数
+        std::uint64_t pointCount;
+
+        // すべての点を描くときの点の間隔
+        float spacing;
+
+        // 予約
+        std::uint32_t reserved[3];
+    };
+
+    // ファイルの識別子
+    static constexpr char signature[8] = { 'G', 'L', 'P', 'O', 'I', 'N', 'T', '1' };
+
+private:
+
+    // 読み込んだファイル (メッシュから作ったときは持たない)
+    std::unique_ptr<MappedFile> file;
+
+    // メッシュから作った点
+    std::vector<Object::Vertex> built;
+
+    // 点の並び
+    const Object::Vertex *points;
+
+    // 点の数
+    std::uint64_t count;
+
+    // すべての点を描くときの点の間隔
+    float spacing;
+
+    // 間隔を見積もるときに面積を数える格子の分割数
+    static constexpr int areaGrid = 128;
+
+public:
+
+    // コンストラクタ
+    // mesh : 正規化済みのメッシュ (頂点だけを使う)
+    explicit PointCloud(const Mesh &mesh)
+    : points(nullptr), count(0), spacing(0.0f)
+    {
+        const std::vector<Eigen::Vector3f> &V(mesh.getVertices());
+        const std::vector<Eigen::Vector3f> &N(mesh.getNormals());
+        if (V.empty() || V.size() > std::numeric_limits<std::uint32_t>::max()) return;
+
+        // 立方体の格子で量子化して，点の分布の向きによらず同じ大きさの区間にする
+        Eigen::Vector3f lower(Eigen::Vector3f::Constant(std::numeric_limits<float>::max()));
+        Eigen::Vector3f upper(-lower);
+        for (const auto &v : V) {
+            lower = lower.cwiseMin(v);
+            upper = upper.cwiseMax(v);
+        }
+        const float extent(std::max((upper - lower).maxCoeff(), 1e-20f));
+
+        // モートン符号で並べる
+        std::vector<std::uint64_t> order(V.size());
+        parallelFor(0, V.size(), [&](std::size_t first, std::size_t last){
+            for (std::size_t i = first; i < last; ++i) {
+                const Eigen::Vector3f q(((V[i] - lower) / extent * 1023.0f).cwiseMax(0.0f).cwiseMin(1023.0f));
+                order[i] = ChunkedMesh::morton(static_cast<std::uint32_t>(q(0)),
+                                               static_cast<std::uint32_t>(q(1)),
+                                               static_cast<std::uint32_t>(q(2))) << 32 | i;
+            }
+        });
+        std::sort(order.begin(), order.end());
+
+        // 点のある格子の数から表面積を見積もり，すべての点を描くときの間隔を求める
+        const int shift(32 + 3 * (10 - std::countr_zero(static_cast<unsigned>(areaGrid))));
+        std::size_t occupied(0);
+        for (std::size_t k = 0; k < order.size(); ++k)
+            if (k == 0 || order[k] >> shift != order[k - 1] >> shift) ++occupied;
+        const float cell(extent / areaGrid);
+        spacing = std::sqrt(occupied * cell * cell / V.size());
+
+        // ビット反転した順に取り出す
+        const std::size_t n(std::bit_ceil(V.size()));
+        const int bits(std::countr_zero(n));
+        built.reserve(V.size());
+        for (std::size_t j = 0; j < n; ++j) {
+            const std::size_t k(reverse(j, bits));
+            if (k >= order.size()) continue;
+            const std::size_t i(order[k] & 0xffffffffu);
+            const Eigen::Vector3f &p(V[i]);
+            Eigen::Vector3f c(i < N.size() ? N[i] : Eigen::Vector3f::Zero());
+            if (c.squaredNorm() == 0.0f) c = ((p - lower) / extent);
+            built.push_back({ p(0), p(1), p(2), c(0), c(1), c(2) });
+        }
+        points = built.data();
+        count = built.size();
+    }
+
+    // コンストラクタ
+    // name : write() で書き出したファイル名
+    explicit PointCloud(const char *name)
+    : file(new MappedFile(name)), points(nullptr), count(0), spacing(0.0f)
+    {
+        if (!*file || file->size() < sizeof(Header)) return;
+
+        Header header;
+        std::memcpy(&header, file->data(), sizeof header);
+        if (std::memcmp(header.magic, signature, sizeof signature) != 0
+            || header.pointCount > (file->size() - sizeof header) / sizeof(Object::Vertex)) {
+            std::cerr << "Error: Not a point cloud: " << name << std::endl;
+            return;
+        }
+
+        // 点はファイル中の配列をそのまま参照する
+        points = reinterpret_cast<const Object::Vertex *>(file->data() + sizeof header);
+        count = header.pointCount;
+        spacing = header.spacing;
+    }
+
+private:
+
+    // コピーコンストラクタによるコピー禁止
+    PointCloud(const PointCloud &c);
+
+    // 代入によるコピー禁止
+    PointCloud &operator=(const PointCloud &c);
+
+    // 下位 bits ビットの並びを反転する
+    static std::size_t reverse(std::size_t x, int bits){
+        std::size_t r(0);
+        for (int b = 0; b < bits; ++b, x >>= 1) r = r << 1 | (x & 1);
+        return r;
+    }
+
+public:
+
+    // 点があるかどうか
+    explicit operator bool() const { return count > 0; }
+
+    // 点の数
+    std::uint64_t size() const { return count; }
+
+    // 並べ替えた点
+    const Object::Vertex *data() const { return points; }
+
+    // すべての点を描くときの点の間隔
+    float getSpacing() const { return spacing; }
+
+    // CPU 側に持っている点のバイト数 (マップしたファイルは含まない)
+    std::size_t memoryBytes() const { return built.capacity() * sizeof(Object::Vertex); }
+
+    // ファイルに書き出す
+    // name : 書き出すファイル名
+    bool write(const char *name) const{
+        std::ofstream of(name, std::ios::binary);
+        if (of.fail()) {
+            std::cerr << "Error: Can't create file: " << name << std::endl;
+            return false;
+        }
+
+        Header header{};
+        std::memcpy(header.magic, signature, sizeof signature);
+        header.pointCount = count;
+        header.spacing = spacing;
+        of.write(reinterpret_cast<const char *>(&header), sizeof header);
+        of.write(reinterpret_cast<const char *>(points), static_cast<std::streamsize>(count * sizeof(Object::Vertex)));
+        of.close();
+
+        if (of.fail()) {
+            std::cerr << "Error: Could not write file: " << name << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include "Shape.h"
+#include "Framebuffer.h"
+#include "GLState.h"
+
+// 点群の描画
+//
+// 先頭からどこで切っても一様に間引いた点群になるように並べた点 (PointCloud) を，一フレームに描く点の数を抑えて描く．
+// 視点が動いている間は先頭から予算の数だけの点を描き，止まっている間は点の数を倍にした画像を予算ずつ描き足していく．
+// 描き足している画像は表示している画像と別のフレームバッファに描き，描き終えたら入れ替えるので描きかけの画像は見せない．
+// 点の大きさは描く点の数に応じた間隔を画面上の大きさに直したものにする
+// GPU には先頭から決まった数の点だけを置く大きさの頂点バッファオブジェクトを確保し，先頭から一フレームに予算の数ずつ転送する．
+// 点の配列 (ファイルの写像) は先頭から触れた分しか読まれないので，点の数が多くても GPU と CPU の使用量は上限で抑えられる
+class PointShape : public Shape {
+    // 描画する点の範囲
+    mutable GLint first;
+    mutable GLsizei count;
+
+    // 並べ替えた点 (呼び出し側が描画の終わりまで持っておく) と点の数
+    const Object::Vertex *const source;
+    const GLsizei total;
+
+    // 転送した先頭からの点の数
+    GLsizei resident;
+
+    // すべての点を描くときの点の間隔
+    const GLfloat spacing;
+
+    // 一フレームに描く点の数
+    const GLsizei budget;
+
+    // 表示している画像と描き足している画像
+    std::unique_ptr<Framebuffer> display, work;
+
+    // 表示している画像の点の数
+    GLsizei shown;
+
+    // 描き足している画像の点の数と，そのうち描いた数
+    GLsizei goal, drawn;
+
+    // 点の範囲 [first, first + count) を，全体で total 個の点を描くときの大きさで描く
+    void drawRange(GLint first, GLsizei count, GLsizei total, GLsizei height, GLint pointSizeLoc) const{
+        // 点の間隔は点の数の平方根に反比例する (表面に散らばった点を仮定する)
+        const GLfloat size(spacing * std::sqrt(static_cast<GLfloat>(this->total) / total) * height * 0.5f);
+        glUniform1f(pointSizeLoc, size);
+        this->first = first;
+        this->count = count;
+        draw();
+    }
+
+    // 倍にした点の数 (GPU に置ける点の数まで)
+    GLsizei doubled(GLsizei n) const{
+        return static_cast<GLsizei>(std::min<long long>(2LL * n, vertexcount));
+    }
+
+    // まだ転送していない点を先頭から予算の数だけ転送する
+    void stream(){
+        if (resident >= vertexcount) return;
+        const GLsizei n(std::min(budget, vertexcount - resident));
+        getObject().update(resident, n, source + resident);
+        getObject().flush();
+        resident += n;
+    }
+
+public:
+
+    // コンストラクタ
+    // vertexcount : 点の数
+    // vertex : 並べ替えた点 (描画の終わりまで持っておく)
+    // spacing : すべての点を描くときの点の間隔
+    // budget : 一フレームに描いて転送する点の数
+    // capacity : GPU に置く点の数の上限
+    PointShape(GLsizei vertexcount, const Object::Vertex *vertex, GLfloat spacing, GLsizei budget, GLsizei capacity)
+    : Shape(std::max(1, std::min(vertexcount, capacity)), NULL)
+    , first(0)
+    , count(0)
+    , source(vertex)
+    , total(vertexcount)
+    , resident(0)
+    , spacing(spacing)
+    , budget(std::max(budget, 1))
+    , shown(0)
+    , goal(0)
+    , drawn(0)
+    {
+    }
+
+    // 表示している画像の点の数
+    GLsizei getShown() const { return shown; }
+
+    // GPU に置いている点の数
+    GLsizei getResident() const { return resident; }
+
+    // 描いて，表示する画像を描画先に写す
+    // moved : 前のフレームから視点か画面の大きさが変わったなら true
+    // pointSizeLoc : 点の大きさの uniform 変数の場所
+    // target : 描画先のフレームバッファオブジェクト名 (0 ならウィンドウ，ビューポートは設定してあるもの)
+    void render(bool moved, GLint pointSizeLoc, GLuint target){
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        const GLsizei width(viewport[2]), height(viewport[3]);
+        if (!display) {
+            display.reset(new Framebuffer(width, height));
+            work.reset(new Framebuffer(width, height));
+        }
+        if (width != display->getWidth() || height != display->getHeight()) {
+            display->resize(width, height);
+            work->resize(width, height);
+            moved = true;
+        }
+        GLState::get().enable(GL_PROGRAM_POINT_SIZE);
+        stream();
+
+        if (moved || shown == 0) {
+            // 先頭から予算の数だけ描いて表示する
+            shown = std::min(budget, resident);
+            display->bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            drawRange(0, shown, shown, height, pointSizeLoc);
+            goal = doubled(shown);
+            drawn = 0;
+        }
+        else if (shown < vertexcount && drawn < resident) {
+            // 点の数を倍にした画像を転送済みの点の範囲で予算の数だけ描き足し，描き終えたら表示する
+            work->bind();
+            if (drawn == 0) glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            const GLsizei n(std::min({ budget, goal - drawn, resident - drawn }));
+            drawRange(drawn, n, goal, height, pointSizeLoc);
+            drawn += n;
+            if (drawn == goal) {
+                std::swap(display, work);
+                shown = goal;
+                goal = doubled(goal);
+                drawn = 0;
+            }
+        }
+
+        // 表示する画像を描画先に写す
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, display->getName());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, viewport[0], viewport[1], viewport[0] + width, viewport[1] + height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // 描画の実行
+    virtual void execute() const{
+        // 点で描画する
+        glDrawArrays(GL_POINTS, first, count);
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+
+// 目標のフレーム時間を保つように描画の解像度を変える
+// 直近の時間の中央値が目標より少し長ければ縮小率をその比の平方根で下げ，十分に短ければ一段ずつ上げる
+// 変えた直後の時間は古い解像度のもの (GPU の時間は数フレーム遅れて届く) なので，しばらく読み捨てる
+class ResolutionScaler {
+public:
+
+    // 縮小率を変えた記録
+    struct Change {
+        // 変えたフレームの番号
+        long frame;
+
+        // 変える前と後の縮小率
+        float from, to;
+
+        // 変える理由になった時間の中央値 (ミリ秒)
+        double ms;
+    };
+
+    // 縮小率の刻み (フレームバッファを作り直す回数を抑える)
+    static constexpr float step = 1.0f / 16.0f;
+
+    // 縮小率を変えた後に読み捨てる時間の数
+    static constexpr int settleFrames = 6;
+
+    // 中央値を求める時間の数
+    static constexpr int window = 8;
+
+private:
+
+    // 目標のフレーム時間 (ミリ秒)
+    const double target;
+
+    // 縮小率の範囲
+    const float minScale, maxScale;
+
+    // 現在の縮小率
+    float scale;
+
+    // 直近の時間
+    std::vector<double> recent;
+
+    // 読み捨てる残りの時間の数
+    int skip;
+
+    // 縮小率を変えた記録
+    std::vector<Change> changes;
+
+public:
+
+    // コンストラクタ
+    // target : 目標のフレーム時間 (ミリ秒)
+    // minScale, maxScale : 縦横の縮小率の範囲
+    ResolutionScaler(double target, float minScale = 0.25f, float maxScale = 1.0f)
+    : target(target)
+    , minScale(std::min(minScale, maxScale)), maxScale(maxScale)
+    , scale(maxScale), skip(0)
+    {
+        recent.reserve(window);
+    }
+
+    // 計ったフレーム時間を加えて縮小率を決め直す
+    // frame : 時間を計ったフレームの番号
+    // ms : 時間 (ミリ秒，正でなければ使わない)
+    void add(long frame, double ms){
+        if (!(ms > 0.0)) return;
+        if (skip > 0) {
+            --skip;
+            return;
+        }
+        recent.push_back(ms);
+        if (recent.size() < static_cast<std::size_t>(window)) return;
+
+        // 読み込み直後などの飛び抜けた時間に振られないように中央値を使う
+        std::vector<double> sorted(recent);
+        std::nth_element(sorted.begin(), sorted.begin() + window / 2, sorted.end());
+        const double median(sorted[window / 2]);
+        recent.erase(recent.begin());
+
+        // 目標の 5% 以内なら下げず，80% を切るまでは上げない
+        float next(scale);
+        if (median > target * 1.05)
+            next = std::floor(scale * static_cast<float>(std::sqrt(target / median)) / step) * step;
+        else if (median < target * 0.8)
+            next = scale + step;
+        next = std::clamp(next, minScale, maxScale);
+        if (next == scale) return;
+
+        changes.push_back(Change{ frame, scale, next, median });
+        scale = next;
+        recent.clear();
+        skip = settleFrames;
+    }
+
+    // 現在の縮小率
+    float getScale() const { return scale; }
+
+    // 縮小した大きさ
+    GLsizei scaled(GLsizei size) const{
+        return std::max(1, static_cast<GLsizei>(std::lround(size * scale)));
+    }
+
+    // 縮小率を変えた記録
+    const std::vector<Change> &getChanges() const { return changes; }
+
+    // 縮小率の移り変わりを表示する
+    // frames : 描いたフレームの数
+    void print(std::ostream &out, long frames) const{
+        // フレームごとの縮小率の平均
+        double sum(0.0);
+        long begin(0);
+        float current(maxScale);
+        for (const Change &c : changes) {
+            sum += static_cast<double>(c.frame + 1 - begin) * current;
+            begin = c.frame + 1;
+            current = c.to;
+        }
+        sum += static_cast<double>(std::max(frames - begin, 0L)) * current;
+
+        out << "resolution scale (target " << target << " ms, " << minScale << " - " << maxScale << "): "
+        << changes.size() << " changes, mean " << (frames > 0 ? sum / frames : current) << ", final " << scale << "\n";
+        for (const Change &c : changes)
+            out << "  frame " << c.frame << ": " << c.from << " -> " << c.to << " (" << c.ms << " ms)\n";
+        out << std::flush;
+    }
+};
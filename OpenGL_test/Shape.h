@@ -3,9 +3,19 @@
 #include "Object.h"
 
 // 図形の描画
-class Shape {
+// Format : 頂点属性の並びの記述
+// storage : 頂点属性のバッファへの並べ方
+template <typename Format, VertexStorage storage = VertexStorage::Interleaved>
+class BasicShape {
+public:
+
+    // 図形データ
+    using ObjectType = BasicObject<Format, storage>;
+
+private:
+
     // 図形データ
-    std::shared_ptr<const Object> object;
+    std::shared_ptr<ObjectType> object;
 
 protected:
 
@@ -14,14 +24,14 @@ protected:
 
 public:
     // コンストラクタ
-    // size : 頂点の位置の次元
     // vertexcount : 頂点の数
     // vertex : 頂点属性を格納した配列
     // indexcount: 頂点のインデックスの要素数
     // index: 頂点のインデックスを格納した配列
-    Shape(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
-          GLsizei indexcount = 0, const GLuint *index = NULL)
-    : object(new Object(size, vertexcount, vertex, indexcount, index))
+    // dynamic : 頂点属性を部分的に書き換えるなら true
+    BasicShape(GLsizei vertexcount, const typename ObjectType::Vertex *vertex,
+               GLsizei indexcount = 0, const GLuint *index = NULL, bool dynamic = false)
+    : object(new ObjectType(vertexcount, vertex, indexcount, index, dynamic))
     , vertexcount(vertexcount)
     {
     }
@@ -35,9 +45,23 @@ public:
         execute();
     }
 
+    // 図形データを取り出す
+    const ObjectType &getObject() const{
+        return *object;
+    }
+    ObjectType &getObject(){
+        return *object;
+    }
+
+    // デストラクタ
+    virtual ~BasicShape(){}
+
     // 描画の実行
     virtual void execute() const{
         //折れ線で描画する
         glDrawArrays(GL_LINE_LOOP, 0, vertexcount);
     }
 };
+
+// メッシュの図形の描画
+using Shape = BasicShape<PositionNormal, objectStorage>;
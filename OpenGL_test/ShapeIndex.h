@@ -13,14 +13,14 @@ protected:
 public:
 
     // コンストラクタ
-    // size: 頂点の位置の次元
     // vertexcount: 頂点の数
     // vertex: 頂点属性を格納した配列
     // indexcount: 頂点のインデックスの要素数
     // index: 頂点のインデックスを格納した配列
-    ShapeIndex(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
-    GLsizei indexcount, const GLuint *index)
-    : Shape(size, vertexcount, vertex, indexcount, index)
+    // dynamic: 頂点属性を部分的に書き換えるなら true
+    ShapeIndex(GLsizei vertexcount, const Object::Vertex *vertex,
+    GLsizei indexcount, const GLuint *index, bool dynamic = false)
+    : Shape(vertexcount, vertex, indexcount, index, dynamic)
     , indexcount(indexcount)
     {
     }
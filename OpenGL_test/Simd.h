@@ -0,0 +1,166 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMD_NEON 1
+#endif
+
+// 4 要素の float のベクトル
+// SSE2 / NEON が使えなければスカラーの演算で代用する
+class Float4 {
+public:
+
+#if defined(SIMD_SSE)
+    __m128 v;
+    Float4(__m128 v) : v(v) {}
+#elif defined(SIMD_NEON)
+    float32x4_t v;
+    Float4(float32x4_t v) : v(v) {}
+#else
+    float v[4];
+#endif
+
+    // コンストラクタ
+    Float4(){}
+
+    // 全要素を s にする
+    Float4(float s){
+#if defined(SIMD_SSE)
+        v = _mm_set1_ps(s);
+#elif defined(SIMD_NEON)
+        v = vdupq_n_f32(s);
+#else
+        std::fill(v, v + 4, s);
+#endif
+    }
+
+    // 要素を個別に指定する
+    Float4(float a, float b, float c, float d){
+#if defined(SIMD_SSE)
+        v = _mm_setr_ps(a, b, c, d);
+#elif defined(SIMD_NEON)
+        const float t[4] = { a, b, c, d };
+        v = vld1q_f32(t);
+#else
+        v[0] = a; v[1] = b; v[2] = c; v[3] = d;
+#endif
+    }
+
+    // 配列から読み込む (整列していなくてよい)
+    static Float4 load(const float *p){
+#if defined(SIMD_SSE)
+        return _mm_loadu_ps(p);
+#elif defined(SIMD_NEON)
+        return vld1q_f32(p);
+#else
+        return Float4(p[0], p[1], p[2], p[3]);
+#endif
+    }
+
+    // 配列に書き出す
+    void store(float *p) const{
+#if defined(SIMD_SSE)
+        _mm_storeu_ps(p, v);
+#elif defined(SIMD_NEON)
+        vst1q_f32(p, v);
+#else
+        std::copy(v, v + 4, p);
+#endif
+    }
+
+    // 要素を取り出す
+    float operator[](int i) const{
+        float t[4];
+        store(t);
+        return t[i];
+    }
+
+#if defined(SIMD_SSE)
+    friend Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+    friend Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+    friend Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+    friend Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+    friend Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+    friend Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+    friend Float4 sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+    friend Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+    friend Float4 operator<=(Float4 a, Float4 b) { return _mm_cmple_ps(a.v, b.v); }
+    friend Float4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+    friend Float4 operator>=(Float4 a, Float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+    friend Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+    friend Float4 operator|(Float4 a, Float4 b) { return _mm_or_ps(a.v, b.v); }
+
+    // 比較結果の各要素の最上位ビットを 4 ビットの整数にまとめる
+    friend int mask(Float4 a) { return _mm_movemask_ps(a.v); }
+
+    // m の要素が真なら a，偽なら b を選ぶ
+    friend Float4 select(Float4 m, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+#elif defined(SIMD_NEON)
+    friend Float4 operator+(Float4 a, Float4 b) { return vaddq_f32(a.v, b.v); }
+    friend Float4 operator-(Float4 a, Float4 b) { return vsubq_f32(a.v, b.v); }
+    friend Float4 operator*(Float4 a, Float4 b) { return vmulq_f32(a.v, b.v); }
+    friend Float4 operator/(Float4 a, Float4 b) { return vdivq_f32(a.v, b.v); }
+    friend Float4 min(Float4 a, Float4 b) { return vminq_f32(a.v, b.v); }
+    friend Float4 max(Float4 a, Float4 b) { return vmaxq_f32(a.v, b.v); }
+    friend Float4 sqrt(Float4 a) { return vsqrtq_f32(a.v); }
+    friend Float4 operator<(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a.v, b.v)); }
+    friend Float4 operator<=(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcleq_f32(a.v, b.v)); }
+    friend Float4 operator>(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgtq_f32(a.v, b.v)); }
+    friend Float4 operator>=(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)); }
+    friend Float4 operator&(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+    friend Float4 operator|(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v))); }
+    friend int mask(Float4 a){
+        static const int32_t shift[4] = { 0, 1, 2, 3 };
+        const uint32x4_t bits(vshrq_n_u32(vreinterpretq_u32_f32(a.v), 31));
+        return static_cast<int>(vaddvq_u32(vshlq_u32(bits, vld1q_s32(shift))));
+    }
+    friend Float4 select(Float4 m, Float4 a, Float4 b) { return vbslq_f32(vreinterpretq_u32_f32(m.v), a.v, b.v); }
+#else
+    template <typename Op>
+    static Float4 apply(Float4 a, Float4 b, Op op){
+        Float4 t;
+        for (int i = 0; i < 4; ++i) t.v[i] = op(a.v[i], b.v[i]);
+        return t;
+    }
+    static float bits(bool b){
+        const std::uint32_t u(b ? 0xffffffffu : 0u);
+        float f;
+        std::copy(reinterpret_cast<const char *>(&u), reinterpret_cast<const char *>(&u) + 4, reinterpret_cast<char *>(&f));
+        return f;
+    }
+    static bool truth(float f){
+        std::uint32_t u;
+        std::copy(reinterpret_cast<const char *>(&f), reinterpret_cast<const char *>(&f) + 4, reinterpret_cast<char *>(&u));
+        return (u >> 31) != 0;
+    }
+    friend Float4 operator+(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return x + y; }); }
+    friend Float4 operator-(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return x - y; }); }
+    friend Float4 operator*(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return x * y; }); }
+    friend Float4 operator/(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return x / y; }); }
+    friend Float4 min(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return y < x ? y : x; }); }
+    friend Float4 max(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return x < y ? y : x; }); }
+    friend Float4 sqrt(Float4 a) { return apply(a, a, [](float x, float){ return std::sqrt(x); }); }
+    friend Float4 operator<(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return bits(x < y); }); }
+    friend Float4 operator<=(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return bits(x <= y); }); }
+    friend Float4 operator>(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return bits(x > y); }); }
+    friend Float4 operator>=(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return bits(x >= y); }); }
+    friend Float4 operator&(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return bits(truth(x) && truth(y)); }); }
+    friend Float4 operator|(Float4 a, Float4 b) { return apply(a, b, [](float x, float y){ return bits(truth(x) || truth(y)); }); }
+    friend int mask(Float4 a){
+        int m(0);
+        for (int i = 0; i < 4; ++i) if (truth(a.v[i])) m |= 1 << i;
+        return m;
+    }
+    friend Float4 select(Float4 m, Float4 a, Float4 b){
+        Float4 t;
+        for (int i = 0; i < 4; ++i) t.v[i] = truth(m.v[i]) ? a.v[i] : b.v[i];
+        return t;
+    }
+#endif
+};
@@ -9,11 +9,10 @@ class SolidShape : public Shape
 public:
 
     // コンストラクタ
-    // size: 頂点の位置の次元
     // vertexcount: 頂点の数
     // vertex: 頂点属性を格納した配列
-    SolidShape(GLint size, GLsizei vertexcount, const Object::Vertex *vertex)
-    : Shape(size, vertexcount, vertex)
+    SolidShape(GLsizei vertexcount, const Object::Vertex *vertex)
+    : Shape(vertexcount, vertex)
     {
     }
 
@@ -9,14 +9,14 @@ class SolidShapeIndex : public ShapeIndex
 public:
 
     // コンストラクタ
-    // size: 頂点の位置の次元
     // vertexcount: 頂点の数
     // vertex: 頂点属性を格納した配列
     // indexcount: 頂点のインデックスの要素数
     // index: 頂点のインデックスを格納した配列
-    SolidShapeIndex(GLint size, GLsizei vertexcount, const Object::Vertex *vertex,
-                    GLsizei indexcount, const GLuint *index)
-    : ShapeIndex(size, vertexcount, vertex, indexcount, index)
+    // dynamic: 頂点属性を部分的に書き換えるなら true
+    SolidShapeIndex(GLsizei vertexcount, const Object::Vertex *vertex,
+                    GLsizei indexcount, const GLuint *index, bool dynamic = false)
+    : ShapeIndex(vertexcount, vertex, indexcount, index, dynamic)
     {
     }
 
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <GL/glew.h>
+
+// 頂点属性の名前 (文字列をテンプレート引数に渡すための入れ物)
+template <std::size_t N>
+struct AttributeName {
+    char value[N];
+
+    constexpr AttributeName(const char (&s)[N]){
+        for (std::size_t i = 0; i < N; ++i) value[i] = s[i];
+    }
+};
+
+// C++ の型に対応する OpenGL の型
+template <typename T> struct GLTypeOf;
+template <> struct GLTypeOf<GLfloat> { static constexpr GLenum value = GL_FLOAT; };
+template <> struct GLTypeOf<GLbyte> { static constexpr GLenum value = GL_BYTE; };
+template <> struct GLTypeOf<GLubyte> { static constexpr GLenum value = GL_UNSIGNED_BYTE; };
+template <> struct GLTypeOf<GLshort> { static constexpr GLenum value = GL_SHORT; };
+template <> struct GLTypeOf<GLushort> { static constexpr GLenum value = GL_UNSIGNED_SHORT; };
+template <> struct GLTypeOf<GLint> { static constexpr GLenum value = GL_INT; };
+template <> struct GLTypeOf<GLuint> { static constexpr GLenum value = GL_UNSIGNED_INT; };
+
+// 頂点属性の一つの記述
+// Name : シェーダの in 変数の名前
+// T : 成分の型
+// Size : 成分の数
+// Normalized : 整数の成分を [0, 1] または [-1, 1] に直して読むなら true
+template <AttributeName Name, typename T, GLint Size, bool Normalized = false>
+struct Attribute {
+    static constexpr const char *name = Name.value;
+    static constexpr GLint size = Size;
+    static constexpr GLenum type = GLTypeOf<T>::value;
+    static constexpr GLboolean normalized = Normalized ? GL_TRUE : GL_FALSE;
+    static constexpr std::size_t bytes = sizeof(T) * Size;
+};
+
+// 頂点属性のバッファへの並べ方
+enum class VertexStorage {
+    // 一つのバッファに頂点ごとにすべての属性を並べる
+    Interleaved,
+
+    // 属性ごとに別のバッファに並べる
+    Separate
+};
+
+// 頂点属性の並びの記述
+// 並びの順番をそのまま attribute 変数の場所にし，一頂点の中では属性を詰めて並べる．
+// 派生したクラスで同じ並びの Vertex 構造体を定義し，CPU 側ではそれを使う
+template <typename... A>
+struct VertexFormat {
+    // 属性の数
+    static constexpr GLuint count = sizeof...(A);
+
+    // 属性ごとの名前・成分の数・型・正規化の有無・一頂点のバイト数
+    static constexpr const char *names[] = { A::name... };
+    static constexpr GLint sizes[] = { A::size... };
+    static constexpr GLenum types[] = { A::type... };
+    static constexpr GLboolean normalized[] = { A::normalized... };
+    static constexpr std::size_t bytes[] = { A::bytes... };
+
+    // 一頂点のバイト数
+    static constexpr std::size_t stride = (A::bytes + ...);
+
+    // 一頂点の中での i 番目の属性の位置
+    static constexpr std::size_t offset(GLuint i){
+        std::size_t o(0);
+        for (GLuint k = 0; k < i; ++k) o += bytes[k];
+        return o;
+    }
+
+    // プログラムオブジェクトの attribute 変数の場所を並びの順番にする (リンクする前に呼ぶ)
+    static void bindLocations(GLuint program){
+        for (GLuint i = 0; i < count; ++i) glBindAttribLocation(program, i, names[i]);
+    }
+
+    // 結合しているバッファを i 番目の属性に結合する
+    // stride : 頂点の間隔 (0 なら属性だけが詰めて並んでいる)
+    // offset : バッファの中での最初の頂点の属性の位置
+    static void setPointer(GLuint i, GLsizei stride, std::size_t offset){
+        glVertexAttribPointer(i, sizes[i], types[i], normalized[i], stride, reinterpret_cast<const void *>(offset));
+        glEnableVertexAttribArray(i);
+    }
+
+    // 結合しているバッファを頂点ごとにすべての属性を並べたものとして結合する
+    static void setInterleaved(){
+        for (GLuint i = 0; i < count; ++i) setPointer(i, static_cast<GLsizei>(stride), offset(i));
+    }
+};
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "CameraPath.h"
 
 // ウィンドウ関連の処理
 class Window {
@@ -20,12 +21,20 @@ class Window {
     // キーボードの状態
     int keyStatus;
 
+    // 左ボタンの状態と，このフレームで押されたかどうか
+    bool buttonDown;
+    bool clicked;
+
+    // まだフレームに渡していない最も古い入力のイベントの時刻 (なければ負)
+    double eventTime;
+
 public:
 
     // コンストラクタ
     Window(int width = 640, int height = 480, const char *title = "Hello!")
     : window(glfwCreateWindow(width, height, title, NULL, NULL))
     , scale(100.0f), location{ 0.0f, 0.0f }, keyStatus(GLFW_RELEASE)
+    , buttonDown(false), clicked(false), eventTime(-1.0)
     {
         if (window == NULL) {
             // ウィンドウが作成できなかった
@@ -56,6 +65,10 @@ public:
         // キーボード操作時に呼び出す処理の登録
         glfwSetKeyCallback(window, keyboard);
 
+        // マウスのボタンとカーソルの操作時に呼び出す処理の登録 (入力の時刻を記録する)
+        glfwSetMouseButtonCallback(window, button);
+        glfwSetCursorPosCallback(window, cursor);
+
         // このインスタンスの this ポインタを記録しておく
         glfwSetWindowUserPointer(window, this);
 
@@ -77,7 +90,8 @@ public:
 //            glfwPollEvents();
         glfwPollEvents();
 
-        // キーボードの状態を調べる
+        // キーボードの状態を調べる (押し続けている間はここで読んだ時刻を入力の時刻にする)
+        const GLfloat moved[] = { location[0], location[1] };
         if (glfwGetKey(window, GLFW_KEY_LEFT) != GLFW_RELEASE)
             location[0] -= 2.0f / size[0];
         else if (glfwGetKey(window, GLFW_KEY_RIGHT) != GLFW_RELEASE)
@@ -86,9 +100,13 @@ public:
             location[1] -= 2.0f / size[1];
         else if (glfwGetKey(window, GLFW_KEY_UP) != GLFW_RELEASE)
             location[1] += 2.0f / size[1];
+        if (location[0] != moved[0] || location[1] != moved[1]) event();
 
         // マウスの左ボタンの状態を調べる
-        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) != GLFW_RELEASE) {
+        const bool down(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) != GLFW_RELEASE);
+        clicked = down && !buttonDown;
+        buttonDown = down;
+        if (down) {
             // 左クリックされていたらマウスカーソルの位置を取得する
             double x, y;
             glfwGetCursorPos(window, &x, &y);
@@ -128,6 +146,30 @@ public:
         }
     }
 
+    // 入力のイベントの時刻を記録する
+    void event(){
+        if (eventTime < 0.0) eventTime = glfwGetTime();
+    }
+
+    // マウスのボタン操作時の処理
+    static void button(GLFWwindow *const window, int /* button */, int /* action */, int /* mods */){
+        // このインスタンスの this ポインタを得る
+        Window *const
+        instance(static_cast<Window *>(glfwGetWindowUserPointer(window)));
+
+        if (instance != NULL) instance->event();
+    }
+
+    // マウスカーソル移動時の処理
+    static void cursor(GLFWwindow *const window, double /* x */, double /* y */){
+        // このインスタンスの this ポインタを得る
+        Window *const
+        instance(static_cast<Window *>(glfwGetWindowUserPointer(window)));
+
+        // 位置を読むのは左ボタンを押している間だけ
+        if (instance != NULL && instance->buttonDown) instance->event();
+    }
+
     // マウスホイール操作時の処理
     static void wheel(GLFWwindow *const window, double x, double y){
         // このインスタンスの this ポインタを得る
@@ -137,6 +179,7 @@ public:
         if (instance != NULL) {
             // ワールド座標系に対するデバイス座標系の拡大率を更新する
             instance->scale += static_cast<GLfloat>(y);
+            instance->event();
         }
     }
 
@@ -149,9 +192,13 @@ public:
         if (instance != NULL) {
             // キーの状態を保存する
             instance->keyStatus = action;
+            instance->event();
         }
     }
 
+    // キーが押されているかどうか
+    bool getKey(int key) const { return glfwGetKey(window, key) != GLFW_RELEASE; }
+
     // ウィンドウのサイズを取り出す
     const GLfloat *getSize() const { return size; }
 
@@ -160,4 +207,24 @@ public:
 
     // 位置を取り出す
     const GLfloat *getLocation() const { return location; }
+
+    // このフレームで左ボタンが押されたかどうか
+    bool isClicked() const { return clicked; }
+
+    // まだフレームに渡していない最も古い入力の時刻を取り出して忘れる (なければ負)
+    double takeEventTime(){
+        const double t(eventTime);
+        eventTime = -1.0;
+        return t;
+    }
+
+    // このフレームの入力の状態を取り出す
+    // time : 経過時間
+    // keys, count : 記録するキーの並び (i 番目のキーが押されていればビット i を立てる)
+    InputState getInput(float time, const int *keys, int count) const{
+        InputState input = { time, { size[0], size[1] }, scale, { location[0], location[1] }, 0, clicked };
+        for (int i = 0; i < count; ++i)
+            if (getKey(keys[i])) input.keys |= 1u << i;
+        return input;
+    }
 };
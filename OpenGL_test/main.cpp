@@ -6,11 +6,20 @@
 //
 
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <sstream>
 #include <memory>
+#include <chrono>
+#include <future>
+#include <atomic>
+#include <cctype>
+#include <array>
+#include <glob.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "Window.h"
@@ -20,6 +29,26 @@
 #include "SolidShapeIndex.h"
 #include "SolidShape.h"
 #include "Mesh.h"
+#include "ChunkedMesh.h"
+#include "CompressedMesh.h"
+#include "ChunkStreamer.h"
+#include "PointCloud.h"
+#include "PointShape.h"
+#include "MeshTopology.h"
+#include "MeshEdges.h"
+#include "MeshKernels.h"
+#include "BVH.h"
+#include "AmbientOcclusion.h"
+#include "JobSystem.h"
+#include "MemoryUsage.h"
+#include "CameraPath.h"
+#include "Framebuffer.h"
+#include "GpuTimer.h"
+#include "FrameCapture.h"
+#include "LatencyProbe.h"
+#include "ResolutionScaler.h"
+#include "MeshScene.h"
+#include "MeshSequence.h"
 
 // シェーダオブジェクトのコンパイル結果を表示
 // shader : シェーダオブジェクト名
@@ -103,8 +132,8 @@ GLuint createProgram(const char *vsrc, const char *fsrc){
     }
 
     // プログラムオブジェクトをリンク
-    glBindAttribLocation(program, 0, "position");
-    glBindAttribLocation(program, 1, "normal");
+    Object::Format::bindLocations(program);
+    glBindAttribLocation(program, Object::occlusionLocation, "occlusion");
     glBindFragDataLocation(program, 0, "fragment");
     glLinkProgram(program);
 
@@ -169,6 +198,143 @@ GLuint loadProgram(const char *vert, const char *frag){
     return  vstat && fstat ? createProgram(vsrc.data(), fsrc.data()) : 0;
 }
 
+// ベンチマーク用に凹凸のある球面の格子状のメッシュを作る
+// count : おおよその頂点の数
+// V : 頂点の位置
+// F : 面の頂点のインデックス
+void makeTestMesh(std::size_t count, std::vector<Eigen::Vector3f> &V, std::vector<Eigen::Vector3i> &F){
+    const int rows(std::max(2, static_cast<int>(std::sqrt(count / 2.0))));
+    const int cols(rows * 2);
+    V.clear();
+    F.clear();
+    for (int i = 0; i < rows; ++i) {
+        const float t(3.14159265f * (i + 0.5f) / rows);
+        for (int j = 0; j < cols; ++j) {
+            const float p(6.28318531f * j / cols);
+            const float r(1.0f + 0.05f * std::sin(20.0f * t) * std::sin(20.0f * p));
+            V.emplace_back(r * std::sin(t) * std::cos(p), r * std::cos(t), r * std::sin(t) * std::sin(p));
+        }
+    }
+    for (int i = 0; i + 1 < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            const int a(i * cols + j), b(i * cols + (j + 1) % cols);
+            const int c(a + cols), d(b + cols);
+            F.emplace_back(a, b, d);
+            F.emplace_back(a, d, c);
+        }
+    }
+}
+
+// マウスカーソルの下の三角形と頂点を求めて表示する
+// bvh : メッシュの BVH
+// F : 面の頂点のインデックス
+// projection : 投影変換行列
+// modelview : モデルビュー変換行列
+// ndc : マウスカーソルの正規化デバイス座標系上での位置
+// 戻り値 : 選んだ頂点の番号 (なければ -1)
+int pick(const BVH &bvh, const std::vector<Eigen::Vector3i> &F,
+         const Matrix &projection, const Matrix &modelview, const GLfloat *ndc){
+    const auto start(std::chrono::steady_clock::now());
+
+    // 前後のクリッピング面上の点をモデル座標系に戻して光線を求める
+    const Matrix inverse((projection * modelview).inverse());
+    const GLfloat nearPoint[4] = { ndc[0], ndc[1], -1.0f, 1.0f }, farPoint[4] = { ndc[0], ndc[1], 1.0f, 1.0f };
+    GLfloat p[4], q[4];
+    inverse.transform(nearPoint, p);
+    inverse.transform(farPoint, q);
+    const float o[3] = { p[0] / p[3], p[1] / p[3], p[2] / p[3] };
+    const float d[3] = { q[0] / q[3] - o[0], q[1] / q[3] - o[1], q[2] / q[3] - o[2] };
+    const BVH::Hit hit(bvh.intersect(o, d, 1.0f));
+
+    const double usec(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    if (hit.triangle == BVH::none) {
+        std::cout << "pick: nothing (" << usec << " us)" << std::endl;
+        return -1;
+    }
+
+    // 重心座標の最も大きい頂点を選ぶ
+    const float w[3] = { 1.0f - hit.u - hit.v, hit.u, hit.v };
+    const int corner(static_cast<int>(std::max_element(w, w + 3) - w));
+    std::cout << "pick: triangle " << hit.triangle << " (u, v) = (" << hit.u << ", " << hit.v << "), vertex "
+    << F[hit.triangle](corner) << ", position (" << o[0] + hit.t * d[0] << ", " << o[1] + hit.t * d[1] << ", "
+    << o[2] + hit.t * d[2] << ") (" << usec << " us)" << std::endl;
+    return F[hit.triangle](corner);
+}
+
+// 記録するキー (InputState::keys のビットの順)
+constexpr int trackedKeys[] = { GLFW_KEY_S, GLFW_KEY_C, GLFW_KEY_H, GLFW_KEY_G, GLFW_KEY_D, GLFW_KEY_O, GLFW_KEY_P, GLFW_KEY_W };
+
+// 入力でキーが押されていたかどうか
+// key : trackedKeys のどれか
+bool isPressed(const InputState &input, int key){
+    const int bit(static_cast<int>(std::find(std::begin(trackedKeys), std::end(trackedKeys), key) - trackedKeys));
+    return (input.keys >> bit & 1u) != 0;
+}
+
+// 二つの入力が時刻のほかに違うかどうか
+bool isChanged(const InputState &a, const InputState &b){
+    return a.size[0] != b.size[0] || a.size[1] != b.size[1] || a.scale != b.scale
+    || a.location[0] != b.location[0] || a.location[1] != b.location[1] || a.keys != b.keys || a.clicked != b.clicked;
+}
+
+// ワイルドカードを含む名前を一致するファイルの名前の順に展開して加える (含まないか一致しなければそのまま加える)
+// pattern : ファイル名かワイルドカードを含む名前
+// files : 展開したファイル名を加える配列
+void expandFiles(const char *pattern, std::vector<std::string> &files){
+    glob_t found;
+    if (std::strpbrk(pattern, "*?[") && glob(pattern, 0, NULL, &found) == 0) {
+        files.insert(files.end(), found.gl_pathv, found.gl_pathv + found.gl_pathc);
+        globfree(&found);
+    }
+    else {
+        files.push_back(pattern);
+    }
+}
+
+// 名前に含まれる数字の並びを数として比べる (step2 が step10 より前になる)
+// 数として等しければ文字列として比べる (step01 と step1 の順を決める)
+bool naturalLess(const std::string &a, const std::string &b){
+    std::size_t i(0), j(0);
+    while (i < a.size() && j < b.size()) {
+        if (std::isdigit(static_cast<unsigned char>(a[i])) && std::isdigit(static_cast<unsigned char>(b[j]))) {
+            // 先頭の 0 を除いた桁数，次に上の桁から比べる
+            std::size_t ia(i), jb(j);
+            while (ia < a.size() && a[ia] == '0') ++ia;
+            while (jb < b.size() && b[jb] == '0') ++jb;
+            std::size_t ea(ia), eb(jb);
+            while (ea < a.size() && std::isdigit(static_cast<unsigned char>(a[ea]))) ++ea;
+            while (eb < b.size() && std::isdigit(static_cast<unsigned char>(b[eb]))) ++eb;
+            if (ea - ia != eb - jb) return ea - ia < eb - jb;
+            const int c(a.compare(ia, ea - ia, b, jb, eb - jb));
+            if (c != 0) return c < 0;
+            i = ea;
+            j = eb;
+        }
+        else {
+            if (a[i] != b[j]) return a[i] < b[j];
+            ++i;
+            ++j;
+        }
+    }
+    if (a.size() - i != b.size() - j) return a.size() - i < b.size() - j;
+    return a < b;
+}
+
+// 一フレームの描画に必要なもの (ワーカーで準備する)
+struct FramePlan {
+    // 準備に使った入力
+    InputState input;
+
+    // 投影変換行列とモデルビュー変換行列
+    Matrix projection, modelview;
+
+    // すべて置き換える頂点属性 (空なら置き換えない)
+    std::vector<Object::Vertex> vertices;
+
+    // 位置だけを置き換える頂点の番号と位置
+    std::vector<std::pair<GLuint, std::array<GLfloat, 3>>> positions;
+};
+
 // 六面体の頂点の位置
 //constexpr Object::Vertex cubeVertex[] =
 //{
@@ -259,6 +425,355 @@ GLuint loadProgram(const char *vert, const char *frag){
 
 int main(int argc, const char * argv[])
 {
+    // メッシュをブロックに分割したファイルに変換するだけならウィンドウは開かない
+    if (argc >= 4 && std::string(argv[1]) == "--make-chunks") {
+        Mesh mesh;
+        if (!mesh.readMesh(argv[2])) return 1;
+        const std::uint32_t trianglesPerBlock(argc > 4 ? static_cast<std::uint32_t>(std::stoul(argv[4])) : 32768);
+        return ChunkedMesh::write(mesh, argv[3], trianglesPerBlock) ? 0 : 1;
+    }
+
+    // メッシュの頂点を点群として並べ替えたファイルに変換する
+    if (argc == 4 && std::string(argv[1]) == "--make-points") {
+        Mesh mesh;
+        if (!mesh.readMesh(argv[2])) return 1;
+        const PointCloud cloud(mesh);
+        return cloud && cloud.write(argv[3]) ? 0 : 1;
+    }
+
+    // 正規化したメッシュを圧縮して書き出し，読み戻して圧縮率と展開の速さと誤差を表示する
+    if (argc >= 4 && std::string(argv[1]) == "--compress") {
+        Mesh mesh;
+        if (!mesh.readMesh(argv[2])) return 1;
+        const int bits(argc > 4 ? std::stoi(argv[4]) : 16);
+        if (!CompressedMesh::write(argv[3], mesh.getVertices(), mesh.getFaces(), mesh.getNormals(), bits)) return 1;
+
+        // 展開はファイルがキャッシュに載った状態で何回か繰り返して最も速いものを取る
+        std::vector<Eigen::Vector3f> V, N;
+        std::vector<Eigen::Vector3i> F;
+        CompressedMesh::Stats best{};
+        for (int k = 0; k < 5; ++k) {
+            CompressedMesh::Stats stats;
+            if (!CompressedMesh::read(argv[3], V, F, N, &stats)) return 1;
+            if (k == 0 || stats.seconds < best.seconds) best = stats;
+        }
+
+        // 三角形は並べ替えた順に書き出すので，同じ順に並べた元の三角形と角ごとに比べる
+        const std::vector<std::uint32_t> order(CompressedMesh::optimizeOrder(mesh.getFaces(), mesh.getVertexSize()));
+        float positionError(0.0f), normalError(0.0f);
+        for (std::size_t t = 0; t < F.size(); ++t) {
+            for (int k = 0; k < 3; ++k) {
+                const int a(mesh.getFaces()[order[t]](k)), b(F[t](k));
+                positionError = std::max(positionError, (mesh.getVertices()[a] - V[b]).cwiseAbs().maxCoeff());
+                if (!N.empty()) normalError = std::max(normalError, std::acos(std::clamp(mesh.getNormals()[a].dot(N[b]), -1.0f, 1.0f)));
+            }
+        }
+        std::cout << V.size() << " vertices, " << F.size() << " faces, " << threadCount() << " threads" << std::endl;
+        std::cout << "compressed " << best.rawBytes / 1.0e6 << " MB to " << best.compressedBytes / 1.0e6 << " MB ("
+        << static_cast<double>(best.rawBytes) / best.compressedBytes << ":1, "
+        << best.compressedBytes * 8.0 / std::max<std::size_t>(F.size(), 1) << " bits per triangle)" << std::endl;
+        std::cout << "decoded in " << best.seconds * 1000.0 << " ms (" << best.rawBytes / 1.0e6 / best.seconds << " MB/s output, "
+        << best.compressedBytes / 1.0e6 / best.seconds << " MB/s input)" << std::endl;
+        std::cout << "max position error " << positionError << ", max normal error " << normalError * 57.2957795f << " degrees" << std::endl;
+        return 0;
+    }
+
+    // 正規化したメッシュを各形式で書き出して書き出しの速度を表示する
+    if (argc == 3 && std::string(argv[1]) == "--export") {
+        Mesh mesh;
+        if (!mesh.readMesh(argv[2])) return 1;
+        mesh.exportOBJ(argv[2]);
+        mesh.exportPLY(argv[2]);
+        mesh.exportSTL(argv[2]);
+        return 0;
+    }
+
+    // 接続関係を構築して構築の速度と境界・非多様体の辺の数を表示する
+    if (argc == 3 && std::string(argv[1]) == "--topology") {
+        Mesh mesh;
+        if (!mesh.readMesh(argv[2])) return 1;
+        const auto start(std::chrono::steady_clock::now());
+        const MeshTopology topology(mesh.getVertexSize(), mesh.getFaces());
+        const double sec(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        std::cout << topology.getFaceCount() << " faces in " << sec * 1000.0 << " ms ("
+        << topology.getFaceCount() / sec / 1.0e6 << " M faces/s), "
+        << (topology.memoryBytes() >> 20) << " MB, "
+        << topology.getBoundary().size() << " boundary edges, "
+        << topology.getNonManifold().size() << " non-manifold edges" << std::endl;
+        return 0;
+    }
+
+    // 形状処理の 1 秒あたりの反復回数を表示する
+    if (argc >= 2 && std::string(argv[1]) == "--bench-kernels") {
+        std::vector<Eigen::Vector3f> V;
+        std::vector<Eigen::Vector3i> F;
+        makeTestMesh(argc > 2 ? std::stoul(argv[2]) : 1000000, V, F);
+        MeshKernels kernels(V, F);
+        std::vector<float> value;
+        std::vector<Object::Vertex> vertex(V.size());
+        auto bench = [](const char *name, int count, auto &&func){
+            const auto start(std::chrono::steady_clock::now());
+            for (int i = 0; i < count; ++i) func();
+            const double sec(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            std::cout << name << ": " << count / sec << " iterations/s" << std::endl;
+        };
+        std::cout << V.size() << " vertices, " << F.size() << " faces, " << threadCount() << " threads" << std::endl;
+        bench("uniform smoothing", 20, [&]{ kernels.smooth(0.5f, false); });
+        bench("cotangent smoothing", 10, [&]{ kernels.smooth(0.5f, true); });
+        bench("mean curvature", 10, [&]{ kernels.meanCurvature(value); });
+        bench("gaussian curvature", 10, [&]{ kernels.gaussianCurvature(value); });
+        bench("normals", 20, [&]{ kernels.computeNormals(); });
+        bench("pack", 20, [&]{ kernels.pack(vertex.data()); });
+        return 0;
+    }
+
+    // 重複のない辺の抽出の速さとメモリを測る (基数ソートと std::sort を比べる)
+    if (argc >= 3 && std::string(argv[1]) == "--bench-edges") {
+        Mesh mesh;
+        std::vector<Eigen::Vector3f> V;
+        std::vector<Eigen::Vector3i> F;
+        if (std::isdigit(static_cast<unsigned char>(argv[2][0]))) {
+            makeTestMesh(std::stoul(argv[2]) / 2, V, F);
+        }
+        else {
+            if (!mesh.readMesh(argv[2])) return 1;
+            V = mesh.getVertices();
+            F = mesh.getFaces();
+        }
+        std::cout << V.size() << " vertices, " << F.size() << " faces, " << threadCount() << " threads" << std::endl;
+
+        // 速いほうを使う
+        double best(0.0);
+        std::size_t count(0), peak(0);
+        for (int i = 0; i < 3; ++i) {
+            const MeshEdges edges(V.size(), F);
+            if (i == 0 || edges.getSeconds() < best) best = edges.getSeconds();
+            count = edges.size();
+            peak = edges.getPeakBytes();
+        }
+        std::cout << "MeshEdges: " << count << " edges in " << best * 1000.0 << " ms ("
+        << count / best / 1.0e6 << " M edges/s, " << F.size() / best / 1.0e6 << " M faces/s), peak "
+        << (peak >> 20) << " MB, index " << ((count * 2 * sizeof(GLuint)) >> 20) << " MB" << std::endl;
+
+        // 比較のために同じキーを std::sort で並べる
+        const auto start(std::chrono::steady_clock::now());
+        std::vector<std::uint64_t> keys(F.size() * 3);
+        for (std::size_t f = 0; f < F.size(); ++f) {
+            for (int j = 0; j < 3; ++j) {
+                const std::uint64_t a(static_cast<std::uint32_t>(F[f](j))), b(static_cast<std::uint32_t>(F[f]((j + 1) % 3)));
+                keys[f * 3 + j] = std::min(a, b) << 32 | std::max(a, b);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        const auto end(std::unique(keys.begin(), keys.end()));
+        const std::size_t unique(static_cast<std::size_t>(std::count_if(keys.begin(), end, [](std::uint64_t k){ return (k >> 32) != (k & 0xffffffffu); })));
+        const double sec(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        std::cout << "std::sort: " << unique << " edges in " << sec * 1000.0 << " ms ("
+        << unique / sec / 1.0e6 << " M edges/s)" << std::endl;
+        return unique == count ? 0 : 2;
+    }
+
+    // 環境遮蔽を求めてメッシュの隣にキャッシュする
+    // 頂点の一部でスレッド数ごとの速度を測ってから全体を求める
+    if (argc >= 3 && std::string(argv[1]) == "--bake-ao") {
+        Mesh mesh;
+        if (!mesh.readMesh(argv[2])) return 1;
+        const int samples(argc > 3 ? std::stoi(argv[3]) : 64);
+        const float radius(argc > 4 ? std::stof(argv[4]) : 0.5f);
+        const BVH bvh(mesh.getVertices(), mesh.getFaces());
+        const AmbientOcclusion ao(bvh, mesh.getVertices(), mesh.getNormals(), samples, radius);
+        std::cout << mesh.getVertexSize() << " vertices, " << ao.getSamples() << " rays per vertex, BVH built in "
+        << bvh.getBuildSeconds() * 1000.0 << " ms" << std::endl;
+
+        std::vector<float> value(mesh.getVertexSize());
+        const std::size_t subset(std::min<std::size_t>(value.size(), 16384));
+        double base(0.0);
+        for (unsigned int threads = 1;; threads = std::min(threads * 2, threadCount())) {
+            JobSystem jobs(threads);
+            const AmbientOcclusion::Stats stats(ao.bake(jobs, 0, subset, value.data()));
+            if (threads == 1) base = stats.raysPerSecond();
+            std::cout << threads << " threads: " << stats.raysPerSecond() / 1.0e6 << " M rays/s, speedup "
+            << stats.raysPerSecond() / base << std::endl;
+            if (threads == threadCount()) break;
+        }
+
+        JobSystem jobs;
+        const AmbientOcclusion::Stats stats(ao.bake(jobs, 0, value.size(), value.data()));
+        std::cout << "baked " << stats.rays << " rays in " << stats.seconds << " s ("
+        << stats.raysPerSecond() / 1.0e6 << " M rays/s)" << std::endl;
+        if (!ao.save(argv[2], mesh.getFaces(), value)) {
+            std::cerr << "Can't write " << AmbientOcclusion::cacheName(argv[2]) << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // BVH の構築と光線の速度を表示する
+    if (argc >= 3 && std::string(argv[1]) == "--bench-pick") {
+        std::vector<Eigen::Vector3f> V;
+        std::vector<Eigen::Vector3i> F;
+        if (std::isdigit(static_cast<unsigned char>(argv[2][0]))) {
+            // 格子状のメッシュの三角形の数は頂点の数のおよそ 2 倍
+            makeTestMesh(std::stoul(argv[2]) / 2, V, F);
+        }
+        else {
+            Mesh mesh;
+            if (!mesh.readMesh(argv[2])) return 1;
+            V = mesh.getVertices();
+            F = mesh.getFaces();
+        }
+        const BVH bvh(V, F);
+        std::cout << F.size() << " triangles, BVH built in " << bvh.getBuildSeconds() * 1000.0 << " ms, "
+        << bvh.getNodeCount() << " nodes, " << (bvh.memoryBytes() >> 20) << " MB" << std::endl;
+
+        // 半径 3 の球面上から原点付近に向かう光線を飛ばす
+        const std::size_t rays(1 << 20);
+        std::vector<float> origin(rays * 3), direction(rays * 3);
+        std::srand(1);
+        for (std::size_t i = 0; i < rays * 3; i += 3) {
+            for (int j = 0; j < 3; ++j) {
+                origin[i + j] = std::rand() / static_cast<float>(RAND_MAX) * 2.0f - 1.0f;
+                direction[i + j] = (std::rand() / static_cast<float>(RAND_MAX) * 2.0f - 1.0f) * 0.5f;
+            }
+            const float l(std::sqrt(origin[i] * origin[i] + origin[i + 1] * origin[i + 1] + origin[i + 2] * origin[i + 2]));
+            for (int j = 0; j < 3; ++j) {
+                origin[i + j] *= 3.0f / l;
+                direction[i + j] -= origin[i + j];
+            }
+        }
+        std::atomic<std::size_t> hits(0);
+        const auto start(std::chrono::steady_clock::now());
+        parallelFor(0, rays, [&](std::size_t first, std::size_t last){
+            std::size_t h(0);
+            for (std::size_t i = first; i < last; ++i)
+                if (bvh.intersect(&origin[i * 3], &direction[i * 3]).triangle != BVH::none) ++h;
+            hits += h;
+        });
+        const double sec(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        std::cout << rays / sec / 1.0e6 << " M rays/s (" << threadCount() << " threads), "
+        << sec / rays * threadCount() * 1.0e6 << " us per ray, " << hits << " hits" << std::endl;
+        return 0;
+    }
+
+    // 同じ入力を再生した二つの記録を比べる
+    if (argc == 4 && std::string(argv[1]) == "--diff-frames") {
+        FrameLog a, b;
+        if (!a.load(argv[2]) || !b.load(argv[3])) {
+            std::cerr << "Can't read " << argv[2] << " or " << argv[3] << std::endl;
+            return 1;
+        }
+        a.print(std::cout, argv[2]);
+        b.print(std::cout, argv[3]);
+        return a.compare(b, std::cout) == 0 ? 0 : 2;
+    }
+
+    // 表示するファイル (複数のファイルかワイルドカードを与えると並べて表示する) とオプション
+    //   --lean : 転送した後に CPU 側のメッシュを捨てる
+    //   --record path : フレームごとの入力を path に記録する
+    //   --replay path : path に記録した入力で一定の時間刻みで描画し，処理時間を path.csv に書き出す
+    //   --headless : 再生か書き出しのときにウィンドウを表示せずにオフスクリーンに描画する
+    //   --hash : 再生するときにフレームごとの画像のハッシュ値も書き出す
+    //   --points : メッシュの頂点を点群として表示する
+    //   --point-budget count : 点群を一フレームに描く点の数
+    //   --capture pattern : フレームの画像を PNG で書き出す (pattern は "frame%05d.png" のような printf の書式)
+    //   --capture-pipe command : フレームの画像を生の RGB で command の標準入力に流す
+    //   --capture-size WxH : 書き出す画像のサイズ (描画先より大きければタイルに分けて描く)
+    //   --capture-tile size : タイルの大きさの上限
+    //   --frames count : 再生しないで書き出すときのフレーム数 (一定の時間刻みで一回転する分が既定)
+    //   --wireframe : メッシュの辺を重ねて表示した状態で始める (W キーで切り替える)
+    //   --latency : 入力から swap が終わるまでの遅れを測って終了時に表示する
+    //   --low-latency : 送り出したフレームが終わるのを待ってから入力を読み，そのフレームで準備して描く (遅れも表示する)
+    //   --profile-jobs : フレームの準備の仕事ごとの処理時間を測って終了時に表示する
+    //   --dynamic-resolution ms : フレーム時間が ms に収まるように縮小したフレームバッファに描いて拡大する
+    //   --resolution-limits min max : 縦横の縮小率の範囲 (既定 0.25 1)
+    //   --resolution-timer gpu|frame : 縮小率を決める時間 (GPU の処理時間か，フレームの始まりの間隔)
+    //   --upload-budget MB : 複数のファイルを表示するときに一フレームに転送するバイト数の上限 (既定 8)
+    //   --load-threads count : 複数のファイルを読み込むスレッドの数 (1 なら一つずつ順に読む)
+    //   --sequence rate : 複数の OBJ ファイルを並べずに一秒に rate 個の時刻の列として再生する
+    //   --ao-radius r : 環境遮蔽のキャッシュを遮蔽を調べる距離が r で求めたときだけ使う
+    //   数値 : ブロックに分割したファイルと点群のメモリの上限 (MB)
+    if (argc < 2) {
+        std::cout << "command line error\n";
+        std::exit(1);
+    }
+    bool lean(false), headless(false), hashing(false), pointMode(false);
+    bool measureLatency(false), lowLatency(false), wireframe(false), profileJobs(false);
+    double targetMs(0.0);
+    float minScale(0.25f), maxScale(1.0f);
+    bool gpuScaling(true);
+    const char *recordPath(NULL), *replayPath(NULL);
+    const char *capturePattern(NULL), *captureCommand(NULL);
+    GLsizei captureWidth(0), captureHeight(0), captureTile(0);
+    std::size_t captureFrames(377);
+    std::size_t budgetMB(512);
+    GLsizei pointBudget(1 << 20);
+    std::size_t uploadBudgetMB(8);
+    unsigned int loadThreads(threadCount());
+    double sequenceRate(0.0);
+    float aoRadius(0.0f);
+    std::vector<std::string> files;
+    expandFiles(argv[1], files);
+    for (int i = 2; i < argc; ++i) {
+        const std::string option(argv[i]);
+        if (option == "--lean") lean = true;
+        else if (option == "--headless") headless = true;
+        else if (option == "--hash") hashing = true;
+        else if (option == "--points") pointMode = true;
+        else if (option == "--latency") measureLatency = true;
+        else if (option == "--wireframe") wireframe = true;
+        else if (option == "--low-latency") lowLatency = true;
+        else if (option == "--profile-jobs") profileJobs = true;
+        else if (option == "--dynamic-resolution" && i + 1 < argc) targetMs = std::stod(argv[++i]);
+        else if (option == "--resolution-limits" && i + 2 < argc) {
+            minScale = std::stof(argv[++i]);
+            maxScale = std::stof(argv[++i]);
+        }
+        else if (option == "--resolution-timer" && i + 1 < argc) gpuScaling = std::string(argv[++i]) != "frame";
+        else if (option == "--upload-budget" && i + 1 < argc) uploadBudgetMB = std::stoul(argv[++i]);
+        else if (option == "--sequence" && i + 1 < argc) sequenceRate = std::stod(argv[++i]);
+        else if (option == "--ao-radius" && i + 1 < argc) aoRadius = std::stof(argv[++i]);
+        else if (option == "--load-threads" && i + 1 < argc) loadThreads = static_cast<unsigned int>(std::stoul(argv[++i]));
+        else if (option == "--point-budget" && i + 1 < argc) pointBudget = static_cast<GLsizei>(std::stol(argv[++i]));
+        else if (option == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (option == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (option == "--capture" && i + 1 < argc) capturePattern = argv[++i];
+        else if (option == "--capture-pipe" && i + 1 < argc) captureCommand = argv[++i];
+        else if (option == "--capture-tile" && i + 1 < argc) captureTile = static_cast<GLsizei>(std::stol(argv[++i]));
+        else if (option == "--frames" && i + 1 < argc) captureFrames = std::stoul(argv[++i]);
+        else if (option == "--capture-size" && i + 1 < argc
+                 && std::sscanf(argv[++i], "%dx%d", &captureWidth, &captureHeight) == 2 && captureWidth > 0 && captureHeight > 0) {}
+        else if (option.find_first_not_of("0123456789") == std::string::npos) budgetMB = std::stoul(option);
+        else if (option.compare(0, 2, "--") != 0) expandFiles(argv[i], files);
+        else {
+            std::cout << "command line error: " << option << "\n";
+            std::exit(1);
+        }
+    }
+
+    // 並べて表示するのは三角形のメッシュだけ
+    const auto isStreamed = [](const std::string &name){
+        return (name.size() > 7 && name.compare(name.size() - 7, 7, ".chunks") == 0)
+        || (name.size() > 7 && name.compare(name.size() - 7, 7, ".points") == 0);
+    };
+    if (sequenceRate > 0.0 && (pointMode || std::any_of(files.begin(), files.end(), isStreamed))) {
+        std::cout << "command line error: only meshes can be played as a sequence\n";
+        std::exit(1);
+    }
+    if (files.size() > 1 && (pointMode || std::any_of(files.begin(), files.end(), isStreamed))) {
+        std::cout << "command line error: only meshes can be shown side by side\n";
+        std::exit(1);
+    }
+
+    // 時刻の列は番号の桁数がそろっていなくても数の順に再生する
+    if (sequenceRate > 0.0) std::stable_sort(files.begin(), files.end(), naturalLess);
+
+    // 再生する入力
+    CameraPath path;
+    if (replayPath && (!path.load(replayPath) || path.size() == 0)) {
+        std::cerr << "Can't read " << replayPath << std::endl;
+        return 1;
+    }
+
     // GLFWを初期化
     if (glfwInit() == GL_FALSE) {
         // 初期化に失敗
@@ -275,8 +790,22 @@ int main(int argc, const char * argv[])
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    // ウィンドウを作成
-    Window window;
+    // 書き出すときは再生するときと同じく一定の時間刻みで描画する
+    const bool capturing(capturePattern || captureCommand);
+    const bool fixedStep(replayPath || capturing);
+
+    // ウィンドウを作成 (再生するときは記録したときの大きさにする)
+    if (fixedStep && headless) glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    Window window(replayPath ? static_cast<int>(path[0].size[0]) : 640, replayPath ? static_cast<int>(path[0].size[1]) : 480);
+
+    // 再生するときと書き出すときは垂直同期を待たない
+    if (fixedStep) glfwSwapInterval(0);
+
+    // ウィンドウを表示しないときの描画先
+    std::unique_ptr<Framebuffer> offscreen;
+    if (fixedStep && headless)
+        offscreen.reset(new Framebuffer(replayPath ? static_cast<GLsizei>(path[0].size[0]) : 640,
+                                        replayPath ? static_cast<GLsizei>(path[0].size[1]) : 480));
 
     // 背景色を指定
     glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
@@ -284,12 +813,15 @@ int main(int argc, const char * argv[])
     // 背面カリングを有効にする
     glFrontFace(GL_CCW);
     glCullFace(GL_BACK);
-    glEnable(GL_CULL_FACE);
+    GLState::get().enable(GL_CULL_FACE);
 
     // デプスバッファを有効にする
     glClearDepth(1.0);
     glDepthFunc(GL_LESS);
-    glEnable(GL_DEPTH_TEST);
+    GLState::get().enable(GL_DEPTH_TEST);
+
+    // 辺を重ねるときは面を少し奥にずらす
+    glPolygonOffset(1.0f, 1.0f);
 
     // プログラムオブジェクトを作成
     const GLuint program(loadProgram("point.vert", "point.frag"));
@@ -297,78 +829,548 @@ int main(int argc, const char * argv[])
     // uniform 変数の場所を取得する
     const GLint modelviewLoc(glGetUniformLocation(program, "modelview"));
     const GLint projectionLoc(glGetUniformLocation(program, "projection"));
+    const GLint pointSizeLoc(glGetUniformLocation(program, "pointSize"));
+    const GLint lineColorLoc(glGetUniformLocation(program, "lineColor"));
+
+    // 環境遮蔽を持たない図形は遮られていないものとして描く
+    glVertexAttrib1f(Object::occlusionLocation, 1.0f);
 
 
 
     // 図形データを作成する
 
-    //std::unique_ptr<const Shape> shape(new SolidShapeIndex(3, 36, solidCubeVertex, 36, solidCubeIndex));
+    //std::unique_ptr<const Shape> shape(new SolidShapeIndex(36, solidCubeVertex, 36, solidCubeIndex));
 
     // メッシュを読み込み，データを作成
-    std::string filename;
-    if (argc != 2){
-        std::cout << "command line error\n";
-        std::exit(1);
-    }
-    filename = std::string(argv[1]);
+    const std::string filename(files[0]);
+    std::unique_ptr<Shape> meshShape;
+    std::unique_ptr<PointShape> pointShape;
+    std::unique_ptr<const PointCloud> cloud;
     Mesh mesh;
-    mesh.reedOBJ(filename);
-    Object::Vertex Vertices[mesh.getVertexSize()];
-    GLuint Indices[mesh.getIndexSize()];
-    mesh.convertMeshData(Vertices, Indices);
-    //mesh.exportOBJ(filename);
-    std::unique_ptr<const Shape> meshShape(new SolidShapeIndex(3, mesh.getVertexSize(), Vertices, mesh.getIndexSize(), Indices));
 
+    // 処理ごとの使用メモリ
+    MemoryUsage memory;
 
+    // ピッキングに使う BVH
+    std::future<std::unique_ptr<const BVH>> bvhTask;
+    std::unique_ptr<const BVH> bvh;
 
+    // 形状処理 (最初に使うときに作る)
+    std::unique_ptr<MeshKernels> kernels;
 
+    // 平滑化した後の頂点の位置と法線 (平滑化するまでは空でメッシュのものを使う)
+    // ピッキングと選んだ頂点の周りの変形はこれを使い，平滑化を止めたら BVH を作り直す
+    std::vector<Eigen::Vector3f> smoothedVertices, smoothedNormals;
+    bool bvhStale(false);
 
-    // タイマーを 0 にセット
-    glfwSetTime(0.0);
+    // BVH ができるのを待っているクリックの入力と変換行列
+    bool clickPending(false);
+    InputState clickInput;
+    Matrix clickProjection, clickModelview;
 
-    // ウィンドウが開いている間繰り返す
-    while (window) {
-        // ウィンドウを消去
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // メッシュに重ねる辺 (最初に表示するときに作る)
+    // インデックスだけをメッシュの Object に持たせて，頂点はメッシュのものを暗い色で描く
+    const auto buildWire = [&]{
+        const MeshEdges edges(mesh.getVertexSize(), mesh.getFaces());
+        Object &object(meshShape->getObject());
+        object.setLines(edges.getIndexSize(), edges.getIndices());
+        memory.set("object (GPU)", object.gpuBytes());
+        std::cout << edges.size() << " edges in " << edges.getSeconds() * 1000.0 << " ms ("
+        << edges.size() / edges.getSeconds() / 1.0e6 << " M edges/s), peak " << (edges.getPeakBytes() >> 20) << " MB" << std::endl;
+    };
 
-        // シェーダプログラムの使用開始
-        glUseProgram(program);
+    // 重ねる辺を描く
+    const auto drawWire = [&]{
+        glUniform4f(lineColorLoc, 0.15f, 0.15f, 0.15f, 1.0f);
+        meshShape->getObject().drawLines();
+        glUniform4f(lineColorLoc, 0.0f, 0.0f, 0.0f, 0.0f);
+    };
 
-        // 直交投影変換行列を求める
-        //const GLfloat *const size(window.getSize());
-        //const GLfloat scale(window.getScale() * 2.0f);
-        //const GLfloat w(size[0] / scale), h(size[1] / scale);
-        //const Matrix projection(Matrix::orthogonal(-w, w, -h, h, 1.0f, 10.0f));
+    // 複数のファイルは描画を始めてから並行に読み込み，読み終わったものから予算の範囲で転送して並べる
+    std::unique_ptr<MeshScene> scene;
 
-        // 透視投影変換行列を求める
-        const GLfloat *const size(window.getSize());
-        const GLfloat fovy(window.getScale() * 0.01f);
-        const GLfloat aspect(size[0] / size[1]);
-        const Matrix projection(Matrix::perspective(fovy, aspect, 1.0f, 10.0f));
+    // 時刻の列は最初の時刻の接続関係を転送しておき，位置と法線だけを先読みしながら入れ替える
+    std::unique_ptr<MeshSequence> sequence;
+
+    // ブロックに分割したファイルなら必要なブロックだけを読み込みながら描画する
+    // メモリの上限のうち 3/4 を GPU のバッファのプールに，残りを先読みに使う
+    std::unique_ptr<const ChunkedMesh> chunkedMesh;
+    std::unique_ptr<ChunkStreamer> streamer;
+    if (sequenceRate > 0.0) {
+        sequence.reset(new MeshSequence(files, sequenceRate));
+        if (!*sequence) return 1;
+        std::cout << files.size() << " steps of " << sequence->getVertexCount() << " vertices and "
+        << sequence->getTriangleCount() << " triangles at " << sequenceRate << " steps/s" << std::endl;
+    }
+    else if (files.size() > 1) {
+        scene.reset(new MeshScene(files, uploadBudgetMB << 20, loadThreads));
+        std::cout << files.size() << " files on " << loadThreads << " threads, "
+        << uploadBudgetMB << " MB per frame" << std::endl;
+    }
+    else if (filename.size() > 7 && filename.compare(filename.size() - 7, 7, ".chunks") == 0) {
+        chunkedMesh.reset(new ChunkedMesh(filename.c_str()));
+        if (!*chunkedMesh) return 1;
+        const std::size_t budget(budgetMB << 20);
+        streamer.reset(new ChunkStreamer(*chunkedMesh, budget / 4 * 3, budget / 4));
+        if (!*streamer) return 1;
+        std::cout << chunkedMesh->getBlockCount() << " blocks, "
+        << streamer->getSlotCount() << " GPU slots" << std::endl;
+    }
+    else if (pointMode || (filename.size() > 7 && filename.compare(filename.size() - 7, 7, ".points") == 0)) {
+        // 点群は並べ替えたファイルならそのまま，メッシュなら頂点を並べ替えて一フレームに予算の数だけ描く
+        // GPU にはメモリの上限に収まる先頭の点だけを予算の数ずつ転送する
+        if (pointMode) {
+            if (!mesh.readMesh(filename)) return 1;
+            cloud.reset(new PointCloud(mesh));
+            mesh.release();
+        }
+        else {
+            cloud.reset(new PointCloud(filename.c_str()));
+        }
+        if (!*cloud || cloud->size() > static_cast<std::uint64_t>(std::numeric_limits<GLsizei>::max())) return 1;
+        memory.set("points (CPU)", cloud->memoryBytes());
+        const GLsizei capacity(static_cast<GLsizei>(std::min<std::size_t>((budgetMB << 20) / sizeof(Object::Vertex), std::numeric_limits<GLsizei>::max())));
+        pointShape.reset(new PointShape(static_cast<GLsizei>(cloud->size()), cloud->data(), cloud->getSpacing(), pointBudget, capacity));
+        memory.set("points (GPU)", pointShape->getObject().gpuBytes());
+        std::cout << cloud->size() << " points, " << pointBudget << " points per frame, up to "
+        << std::min<std::uint64_t>(cloud->size(), capacity) << " on the GPU" << std::endl;
+        memory.print(std::cout, "memory after load:");
+    }
+    else {
+        if (!mesh.readMesh(filename)) return 1;
+        memory.set("mesh", mesh.memoryBytes());
+        //mesh.exportOBJ(filename);
+
+        // インデックスは面の配列をそのまま使い，頂点は小さな作業領域で GPU の並びに直しながら転送する
+        // 見るだけなら静的な一組のバッファで足りるので，形状処理などで初めて書き換えるときに動的に切り替える
+        meshShape.reset(new SolidShapeIndex(mesh.getVertexSize(), NULL, mesh.getIndexSize(), mesh.getIndices()));
+        Object &object(meshShape->getObject());
+        std::vector<Object::Vertex> staging(std::min<std::size_t>(mesh.getVertexSize(), 1 << 18));
+        for (std::size_t first = 0; first < mesh.getVertexSize(); first += staging.size()) {
+            const std::size_t count(std::min<std::size_t>(staging.size(), mesh.getVertexSize() - first));
+            mesh.convertMeshData(staging.data(), first, count);
+            object.update(static_cast<GLint>(first), static_cast<GLsizei>(count), staging.data());
+        }
+        object.flush();
+        memory.set("staging", staging.capacity() * sizeof(Object::Vertex));
+        std::vector<Object::Vertex>().swap(staging);
+
+        // 環境遮蔽のキャッシュがあれば使う
+        std::vector<float> occlusion;
+        if (AmbientOcclusion::load(filename, mesh.getVertices(), mesh.getFaces(), occlusion, 0, aoRadius)) {
+            object.setOcclusion(static_cast<GLsizei>(occlusion.size()), occlusion.data());
+            std::cout << "loaded " << AmbientOcclusion::cacheName(filename) << std::endl;
+        }
+        memory.set("object (CPU)", object.memoryBytes());
+        memory.set("object (GPU)", object.gpuBytes());
+
+        // 辺を表示して始めるなら CPU 側のメッシュを捨てる前に作る
+        if (wireframe) buildWire();
+
+        if (lean) {
+            // GPU に転送したので CPU 側の写しは要らない
+            mesh.release();
+            memory.set("mesh", mesh.memoryBytes());
+        }
+        memory.print(std::cout, "memory after load:");
+    }
 
-        // 拡大縮小の変換行列を求める
-//        const GLfloat scale(window.getScale() * 2.0f);
-//        const Matrix scaling(Matrix::scale(scale / size[0], scale / size[1], 1.0f));
+    // 色で表示している曲率 (0 なら法線)
+    int curvatureKey(0);
 
-        // 平行移動の変換行列を求める
-//        const GLfloat *const position(window.getLocation());
-//        const Matrix translation(Matrix::translate(position[0], position[1], 0.0f));
+    // クリックした頂点の周りの頂点と距離 (D キーで波打たせる)
+    std::vector<std::pair<GLuint, GLfloat>> region;
+    bool waving(false);
 
-        // モデル変換行列を求める
-        const GLfloat *const location(window.getLocation());
-//        const Matrix model(Matrix::translate(location[0], location[1], 0.0f));
+    // 前のフレームで W キーが押されていたかどうか
+    bool wireHeld(false);
 
-        //（回転）
-        const Matrix r(Matrix::rotate(static_cast<GLfloat>(glfwGetTime()), 0.0f, 1.0f, 0.0f));
-        const Matrix model(Matrix::translate(location[0], location[1], 0.0f) * r);
+    // 頂点バッファオブジェクトへの転送の記録
+    std::size_t uploadFrames(0);
+    double maxStall(0.0);
+
+    // フレームの準備 (変換行列，ピッキング，形状処理) はワーカーで行い，このスレッドは OpenGL の呼び出しだけを行う
+    // 次のフレームの準備はこのフレームの描画と並行して行うので，入力は一フレーム遅れて表示に反映される
+    JobSystem jobs;
+    jobs.setProfiling(profileJobs);
+    JobProfile profile;
+    std::vector<JobSystem::Timing> timings;
+    FramePlan plans[2];
+    JobSystem::Counter preparing;
+    int current(0);
+
+    // P キーで回転を止めたかどうかと，止めていた時間の合計と，回転の角度
+    bool paused(false), pauseHeld(false);
+    float pausedTime(0.0f), angle(0.0f);
+
+    // 分割したメッシュのブロックは画面上で大きいブロックを遮蔽物にして隠れているものを描かない
+    if (streamer) streamer->setOcclusionCulling(&jobs);
+
+    // 頂点の位置 V から BVH を作る (読み込んだ後と，平滑化を止めたときに準備の仕事の中で呼ぶ)
+    // 描画を止めないように別のスレッドで構築し，再生するときはクリックしたフレームで必ず選べるようにその場で作る
+    // 平滑化していなければメッシュの位置は変わらないのでそのまま使い，平滑化した位置は次の平滑化で書き換わるので写す
+    const auto buildBVH = [&](const std::vector<Eigen::Vector3f> &V){
+        if (replayPath) {
+            bvh.reset(new BVH(V, mesh.getFaces()));
+            std::cout << "BVH built in " << bvh->getBuildSeconds() * 1000.0 << " ms" << std::endl;
+            return;
+        }
+        bvh.reset();
+        if (&V == &mesh.getVertices()) {
+            bvhTask = std::async(std::launch::async, [&mesh]{
+                return std::unique_ptr<const BVH>(new BVH(mesh.getVertices(), mesh.getFaces()));
+            });
+        }
+        else {
+            bvhTask = std::async(std::launch::async, [&mesh, positions = V]{
+                return std::unique_ptr<const BVH>(new BVH(positions, mesh.getFaces()));
+            });
+        }
+    };
+
+    // ピッキングに使う BVH は描画を始めてから別のスレッドで構築する
+    if (meshShape && !lean) buildBVH(mesh.getVertices());
+
+    // input から plan を作る (ワーカーで実行する)
+    // 準備の仕事は一度に一つしか実行しないので，形状処理やクリックした頂点の状態はこの中だけで書き換えてよい
+    const auto prepare = [&](const InputState &input, FramePlan &plan){
+        const auto pressed = [&input](int key){ return isPressed(input, key); };
+        plan.input = input;
+        plan.vertices.clear();
+        plan.positions.clear();
+
+        // 透視投影変換行列を求める
+        const GLfloat fovy(input.scale * 0.01f);
+        const GLfloat aspect(input.size[0] / input.size[1]);
+        plan.projection = Matrix::perspective(fovy, aspect, 1.0f, 10.0f);
+
+        // P キーを押すたびに回転を止めたり再開したりする (止めている間は角度をそのまま使う)
+        if (pressed(GLFW_KEY_P) && !pauseHeld) {
+            paused = !paused;
+            if (!paused) pausedTime = input.time - angle;
+        }
+        pauseHeld = pressed(GLFW_KEY_P);
+        if (!paused) angle = input.time - pausedTime;
+
+        // モデル変換行列を求める（回転）
+        const Matrix r(Matrix::rotate(angle, 0.0f, 1.0f, 0.0f));
+        const Matrix model(Matrix::translate(input.location[0], input.location[1], 0.0f) * r);
 
         // ビュー変換行列を求める
-//        const Matrix view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
-//        const Matrix view(Matrix::lookat(0.0f, 0.0f, 3.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
         const Matrix view(Matrix::lookat(2.0f, 1.0f, 2.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
 
         // モデルビュー変換行列を求める
-        const Matrix modelview(view * model);
+        plan.modelview = view * model;
+
+        // CPU 側のメッシュを捨てていたら形状処理はできない
+        if (!meshShape || lean) return;
+
+        // 表示している頂点の位置と法線
+        const std::vector<Eigen::Vector3f> &vertices(smoothedVertices.empty() ? mesh.getVertices() : smoothedVertices);
+        const std::vector<Eigen::Vector3f> &normals(smoothedNormals.empty() ? mesh.getNormals() : smoothedNormals);
+
+        // S キーで一様な重み，C キーで余接重みのラプラシアン平滑化を行う
+        const bool smoothing(pressed(GLFW_KEY_S) || pressed(GLFW_KEY_C));
+
+        // 形状処理と，クリックした頂点の周りの変形を並列に行う
+        jobs.invoke("shape", [&]{
+            // H キーで平均曲率，G キーでガウス曲率を色で表示する
+            const int key(pressed(GLFW_KEY_H) ? GLFW_KEY_H : pressed(GLFW_KEY_G) ? GLFW_KEY_G : 0);
+
+            // 形状処理のデータは大きいので最初に使うときに作る
+            if ((smoothing || key != 0) && !kernels)
+                kernels.reset(new MeshKernels(mesh.getVertices(), mesh.getFaces()));
+            if (smoothing) {
+                kernels->smooth(0.5f, pressed(GLFW_KEY_C));
+                kernels->computeNormals();
+            }
+            if (smoothing || key != curvatureKey) {
+                // 頂点属性をすべて作り直す
+                plan.vertices.resize(mesh.getVertexSize());
+                if (key == 0) {
+                    kernels->pack(plan.vertices.data());
+                }
+                else {
+                    std::vector<float> value;
+                    if (key == GLFW_KEY_H) kernels->meanCurvature(value);
+                    else kernels->gaussianCurvature(value);
+                    std::vector<float> magnitude(value.size());
+                    std::transform(value.begin(), value.end(), magnitude.begin(), [](float v){ return std::abs(v); });
+                    std::nth_element(magnitude.begin(), magnitude.begin() + magnitude.size() * 9 / 10, magnitude.end());
+                    kernels->pack(plan.vertices.data(), value, std::max(magnitude[magnitude.size() * 9 / 10], 1e-6f));
+                }
+                curvatureKey = key;
+            }
+        }, "region", [&]{
+            // BVH ができる前にクリックしたら，できてからそのクリックの位置で選ぶ
+            if (input.clicked) {
+                clickPending = true;
+                clickInput = input;
+                clickProjection = plan.projection;
+                clickModelview = plan.modelview;
+            }
+
+            // クリックした位置にある三角形と頂点を求め，その周りの頂点を探す
+            if (bvh && clickPending) {
+                clickPending = false;
+                const int picked(pick(*bvh, mesh.getFaces(), clickProjection, clickModelview, clickInput.location));
+                if (picked >= 0) {
+                    const Eigen::Vector3f center(vertices[picked]);
+                    const std::size_t n(mesh.getVertexSize()), grain(1 << 16);
+                    std::vector<std::vector<std::pair<GLuint, GLfloat>>> found((n + grain - 1) / grain);
+                    jobs.parallelFor(0, found.size(), 1, [&](std::size_t first, std::size_t last){
+                        for (std::size_t k = first; k < last; ++k) {
+                            const std::size_t end(std::min(n, (k + 1) * grain));
+                            for (std::size_t i = k * grain; i < end; ++i) {
+                                const GLfloat distance((vertices[i] - center).norm());
+                                if (distance < 0.1f) found[k].emplace_back(static_cast<GLuint>(i), distance);
+                            }
+                        }
+                    }, "search");
+                    region.clear();
+                    for (const auto &f : found) region.insert(region.end(), f.begin(), f.end());
+                }
+            }
+
+            // D キーを押している間は選んだ頂点の周りを法線方向に波打たせ，離したら元に戻す
+            if (!region.empty() && (waving || pressed(GLFW_KEY_D))) {
+                waving = pressed(GLFW_KEY_D);
+                const GLfloat phase(input.time * 8.0f);
+                plan.positions.resize(region.size());
+                for (std::size_t k = 0; k < region.size(); ++k) {
+                    const auto &r(region[k]);
+                    const GLfloat height(waving ? 0.01f * std::cos(r.second * 60.0f - phase) * (1.0f - r.second * 10.0f) : 0.0f);
+                    plan.positions[k].first = r.first;
+                    for (int j = 0; j < 3; ++j)
+                        plan.positions[k].second[j] = vertices[r.first](j) + normals[r.first](j) * height;
+                }
+            }
+        });
+
+        // 平滑化した位置をピッキングと変形に使えるように取り出す
+        if (smoothing) {
+            kernels->unpack(smoothedVertices, smoothedNormals);
+            bvhStale = true;
+        }
+
+        // 平滑化を止めたら今の位置で BVH を作り直す (作り直している間は古い位置で選ばない)
+        if (bvhStale && !smoothing && !bvhTask.valid()) {
+            bvhStale = false;
+            buildBVH(smoothedVertices);
+        }
+    };
+
+    // フレームの番号と，再生するときのフレームごとの処理時間と画像
+    std::size_t frame(0);
+    FrameLog log(replayPath ? path.size() : 0);
+    std::vector<std::uint8_t> pixels;
+
+    // 解像度を変えて描くときの縮小率と描画先 (点群は描く点の数で処理の量を抑えるので使わない)
+    std::unique_ptr<ResolutionScaler> scaler(targetMs > 0.0 && !pointShape ? new ResolutionScaler(targetMs, minScale, maxScale) : NULL);
+    std::unique_ptr<Framebuffer> scaledTarget;
+    auto lastFrameStart(std::chrono::steady_clock::now());
+
+    // 縮小して描いた画像を拡大するプログラムと，頂点属性を持たない頂点配列オブジェクト
+    GLuint upscaleProgram(0), upscaleArray(0);
+    if (scaler) {
+        upscaleProgram = loadProgram("upscale.vert", "upscale.frag");
+        GLState::get().useProgram(upscaleProgram);
+        glUniform1i(glGetUniformLocation(upscaleProgram, "image"), 0);
+        glGenVertexArrays(1, &upscaleArray);
+    }
+
+    // GPU の処理時間 (再生するときは記録し，解像度を変えるときは縮小率を決めるのに使う)
+    // 時間のクエリが使えなければ GPU の処理時間は記録せず，縮小率はフレームの始まりの間隔で決める
+    std::unique_ptr<GpuTimer> gpuTimer(replayPath || (scaler && gpuScaling) ? new GpuTimer : NULL);
+    if (gpuTimer && !*gpuTimer) {
+        std::cerr << "Timer queries are not supported; GPU times are not measured" << std::endl;
+        gpuTimer.reset();
+        gpuScaling = false;
+    }
+    const auto gpuTime([&](long n, double ms){
+        if (replayPath) log[n].gpu = ms;
+        if (scaler && gpuScaling) scaler->add(n, ms);
+    });
+
+    // 入力から表示までの遅れ (plans のそれぞれに反映した最も古い入力の時刻)
+    std::unique_ptr<LatencyProbe> probe(measureLatency || lowLatency ? new LatencyProbe : NULL);
+    double inputTimes[2] = { -1.0, -1.0 };
+
+    // 前のフレームの変換行列 (点群は視点が止まっている間だけ描き足す)
+    Matrix lastProjection, lastModelview;
+    lastProjection.loadIdentity();
+    lastModelview.loadIdentity();
+
+    // フレームの画像の書き出し
+    // 描画先と同じサイズならそのまま読み出し，違うサイズならタイルに分けて描き直して読み出す
+    std::unique_ptr<FrameCapture> capture;
+    std::unique_ptr<Framebuffer> tile;
+    GLsizei tileSize(0);
+    if (capturing) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        const GLsizei width(offscreen ? offscreen->getWidth() : viewport[2]);
+        const GLsizei height(offscreen ? offscreen->getHeight() : viewport[3]);
+
+        // 点群は描き足した画像を持っているので描画先のサイズでしか書き出せない
+        if (pointShape && captureWidth > 0) std::cerr << "Point clouds are captured at the window size" << std::endl;
+        if (pointShape || captureWidth == 0) {
+            captureWidth = width;
+            captureHeight = height;
+        }
+
+        // タイルはフレームバッファとビューポートの大きさの上限に収める
+        GLint limits[4];
+        glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, limits);
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, limits + 1);
+        glGetIntegerv(GL_MAX_VIEWPORT_DIMS, limits + 2);
+        tileSize = *std::min_element(limits, limits + 4);
+        if (captureTile > 0) tileSize = std::min(tileSize, captureTile);
+
+        capture.reset(new FrameCapture(captureWidth, captureHeight, capturePattern, captureCommand));
+        if (!*capture) return 1;
+    }
+
+    // タイマーを 0 にセット
+    glfwSetTime(0.0);
+
+    // フレーム n の入力を求める
+    // 再生するときは記録した入力を使い，時刻は記録したときの時刻ではなく一定の刻みで進める
+    // 入力の時刻は受け取ったイベントの時刻で，再生するときは記録した入力が変わったフレームの始まりにする
+    const auto readInput = [&](std::size_t n, double &eventTime){
+        InputState input(window.getInput(static_cast<float>(glfwGetTime()), trackedKeys, static_cast<int>(std::size(trackedKeys))));
+        eventTime = window.takeEventTime();
+        if (replayPath) {
+            input = path[n];
+            input.time = n * path.getTimestep();
+            eventTime = n > 0 && isChanged(path[n], path[n - 1]) ? glfwGetTime() : -1.0;
+        }
+        else if (capturing) {
+            input.time = n / 60.0f;
+        }
+        else if (recordPath) {
+            path.append(input);
+        }
+        return input;
+    };
+
+    // 描くフレームの数 (再生するときは記録が終わるまで，書き出すときは指定したフレーム数まで)
+    const std::size_t frameCount(replayPath ? path.size() : capturing ? captureFrames : std::numeric_limits<std::size_t>::max());
+
+    // 並行して準備するときは最初のフレームだけここで準備し，以後は各フレームで次のフレームの入力を読んで準備する
+    if (!lowLatency && frameCount > 0) {
+        const InputState input(readInput(0, inputTimes[current]));
+        jobs.submit("prepare", [&, input]{ prepare(input, plans[current]); }, preparing);
+    }
+
+    // ウィンドウが開いている間繰り返す
+    while (window && frame < frameCount) {
+        const auto frameStart(std::chrono::steady_clock::now());
+
+        // GPU の処理時間を使わないときは前のフレームからの間隔で縮小率を決める
+        if (scaler && !gpuScaling && frame > 0)
+            scaler->add(static_cast<long>(frame) - 1, std::chrono::duration<double, std::milli>(frameStart - lastFrameStart).count());
+        lastFrameStart = frameStart;
+
+        // このフレームの準備が終わるのを待つ (低遅延モードではここで入力を読んで準備する)
+        if (lowLatency) {
+            const InputState input(readInput(frame, inputTimes[current]));
+            jobs.submit("prepare", [&, input]{ prepare(input, plans[current]); }, preparing);
+        }
+        jobs.wait(preparing);
+        FramePlan &plan(plans[current]);
+        const double planInput(inputTimes[current]);
+
+        // 準備の仕事が動いていない間に，構築の終わった BVH を受け取る
+        if (bvhTask.valid() && bvhTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            bvh = bvhTask.get();
+            std::cout << "BVH built in " << bvh->getBuildSeconds() * 1000.0 << " ms" << std::endl;
+        }
+        if (bvh) memory.set("BVH", bvh->memoryBytes());
+        if (kernels) memory.set("kernels", kernels->memoryBytes());
+
+        // 次のフレームの入力を読んで準備を始める (低遅延モードでは次のフレームの始まりで読む)
+        const int next(current ^ 1);
+        if (!lowLatency && frame + 1 < frameCount) {
+            const InputState input(readInput(frame + 1, inputTimes[next]));
+            jobs.submit("prepare", [&, input, next]{ prepare(input, plans[next]); }, preparing);
+        }
+
+        // 準備した頂点属性を Object の写しに書き込む
+        // 書き換えた頂点の範囲だけが転送される
+        if (!plan.vertices.empty() || !plan.positions.empty()) {
+            Object &object(meshShape->getObject());
+            if (!object.isDynamic()) {
+                object.makeDynamic();
+                memory.set("object (CPU)", object.memoryBytes());
+                memory.set("object (GPU)", object.gpuBytes());
+            }
+        }
+        if (!plan.vertices.empty())
+            std::copy(plan.vertices.begin(), plan.vertices.end(), meshShape->getObject().modify(0, static_cast<GLsizei>(plan.vertices.size())));
+        for (const auto &p : plan.positions)
+            std::copy(p.second.begin(), p.second.end(), meshShape->getObject().modify(p.first, 1)->position);
+
+        // W キーを押すたびに辺を重ねて表示するかどうかを切り替える (CPU 側のメッシュがあれば最初に表示するときに作る)
+        if (isPressed(plan.input, GLFW_KEY_W) && !wireHeld) {
+            wireframe = !wireframe;
+            if (wireframe && meshShape && !meshShape->getObject().hasLines() && !lean) buildWire();
+        }
+        wireHeld = isPressed(plan.input, GLFW_KEY_W);
+        const bool showWire(wireframe && meshShape && meshShape->getObject().hasLines());
+
+        // ウィンドウを表示しないときはオフスクリーンに描く
+        if (offscreen) {
+            offscreen->resize(static_cast<GLsizei>(plan.input.size[0]), static_cast<GLsizei>(plan.input.size[1]));
+            offscreen->bind();
+        }
+
+        // 解像度を下げているときは縮小したフレームバッファに描く (描画先のビューポートは拡大するときに使う)
+        GLint destination[4];
+        bool scaling(false);
+        if (scaler) {
+            glGetIntegerv(GL_VIEWPORT, destination);
+            const GLsizei w(scaler->scaled(destination[2])), h(scaler->scaled(destination[3]));
+            scaling = w != destination[2] || h != destination[3];
+            if (scaling) {
+                if (!scaledTarget) scaledTarget.reset(new Framebuffer(w, h));
+                scaledTarget->resize(w, h);
+                scaledTarget->bind();
+            }
+        }
+
+        // GPU の処理時間を計り始める (前のフレームより前に計ったものの結果が出ていれば先に読み出す)
+        if (gpuTimer) {
+            gpuTimer->collect(gpuTime);
+            gpuTimer->begin(static_cast<long>(frame));
+        }
+
+        // ウィンドウを消去
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // シェーダプログラムの使用開始
+        GLState::get().useProgram(program);
+
+        // 準備した変換行列
+        const Matrix &projection(plan.projection);
+        const Matrix &modelview(plan.modelview);
+        const GLfloat *const size(plan.input.size);
+
+        // 書き換えた頂点属性を転送する
+        if (meshShape) {
+            meshShape->getObject().flush();
+            const Object::UploadStats &upload(meshShape->getObject().getUploadStats());
+            if (upload.calls > 0) {
+                ++uploadFrames;
+                maxStall = std::max(maxStall, upload.stallSeconds);
+            }
+        }
+
+        // 読み終わったメッシュを転送する (すべて終わったら読み込みの時間を表示する)
+        if (scene && scene->upload()) scene->print(std::cout);
+
+        // 時刻の列は表示する時刻になったものを転送する
+        if (sequence) sequence->update(plan.input.time);
 
         // uniform 変数に値を設定する
         glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection.data());
@@ -376,7 +1378,32 @@ int main(int argc, const char * argv[])
 
         // 図形を描画する
         //shape->draw();
-        meshShape->draw();
+        if (streamer) {
+            // 見えているブロックを転送して描画する
+            // O キーを押している間はオクルージョンカリングを行わない
+            streamer->update(projection, modelview, size[1], !isPressed(plan.input, GLFW_KEY_O));
+            streamer->draw();
+        }
+        else if (pointShape) {
+            // 点群は視点が止まっている間は前のフレームの続きを描き足す
+            const bool moved(!std::equal(projection.data(), projection.data() + 16, lastProjection.data())
+                             || !std::equal(modelview.data(), modelview.data() + 16, lastModelview.data()));
+            pointShape->render(moved, pointSizeLoc, offscreen ? offscreen->getName() : 0);
+            lastProjection = projection;
+            lastModelview = modelview;
+        }
+        else if (scene) {
+            scene->draw(modelviewLoc, modelview);
+        }
+        else if (sequence) {
+            sequence->draw();
+        }
+        else {
+            // 辺を重ねるときは面を奥にずらして辺が埋もれないようにする
+            GLState::get().set(GL_POLYGON_OFFSET_FILL, showWire);
+            meshShape->draw();
+            if (showWire) drawWire();
+        }
 
         
         /*
@@ -390,7 +1417,176 @@ int main(int argc, const char * argv[])
         //shape->draw();
         */
 
+        // 縮小して描いた画像を画面全体を覆う三角形に貼って描画先に線形補間で拡大する
+        // glBlitFramebuffer は実装によっては拡大がテクスチャを貼るより大幅に遅い
+        if (scaling) {
+            glBindFramebuffer(GL_FRAMEBUFFER, offscreen ? offscreen->getName() : 0);
+            glViewport(destination[0], destination[1], destination[2], destination[3]);
+            GLState::get().disable(GL_DEPTH_TEST);
+            GLState::get().useProgram(upscaleProgram);
+            GLState::get().bindVertexArray(upscaleArray);
+            glBindTexture(GL_TEXTURE_2D, scaledTarget->getTexture());
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            GLState::get().enable(GL_DEPTH_TEST);
+            GLState::get().useProgram(program);
+        }
+
+        // 画像の読み出しは計測に含めない
+        if (gpuTimer) gpuTimer->end();
+
+        // 画像を書き出す
+        if (capture) {
+            capture->begin();
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            if (capture->getWidth() == viewport[2] && capture->getHeight() == viewport[3] && (captureTile == 0 || pointShape)) {
+                // 描画先からそのまま読み出す
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen ? offscreen->getName() : 0);
+                if (!offscreen) glReadBuffer(GL_BACK);
+                capture->read(0, 0, viewport[2], viewport[3]);
+            }
+            else {
+                // 書き出す画像の画角は縦に合わせ，タイルごとに正規化デバイス座標の範囲を拡大した投影変換行列で描き直す
+                // 分割したメッシュのブロックはこのフレームで描画先に選んだものを描く
+                const GLsizei cw(capture->getWidth()), ch(capture->getHeight());
+                if (!tile) tile.reset(new Framebuffer(std::min(tileSize, cw), std::min(tileSize, ch)));
+                const Matrix fit(Matrix::scale((size[0] / size[1]) / (static_cast<GLfloat>(cw) / ch), 1.0f, 1.0f) * projection);
+                for (GLsizei y = 0; y < ch; y += tileSize) {
+                    for (GLsizei x = 0; x < cw; x += tileSize) {
+                        const GLsizei w(std::min(tileSize, cw - x)), h(std::min(tileSize, ch - y));
+                        const GLfloat x0(2.0f * x / cw - 1.0f), x1(2.0f * (x + w) / cw - 1.0f);
+                        const GLfloat y0(2.0f * y / ch - 1.0f), y1(2.0f * (y + h) / ch - 1.0f);
+                        const Matrix crop(Matrix::scale(2.0f / (x1 - x0), 2.0f / (y1 - y0), 1.0f)
+                                          * Matrix::translate(-0.5f * (x0 + x1), -0.5f * (y0 + y1), 0.0f));
+                        tile->bind();
+                        glViewport(0, 0, w, h);
+                        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                        glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, (crop * fit).data());
+                        if (streamer) streamer->draw();
+                        else if (scene) scene->draw(modelviewLoc, modelview);
+                        else if (sequence) sequence->draw();
+                        else meshShape->draw();
+                        if (showWire) drawWire();
+                        glBindFramebuffer(GL_READ_FRAMEBUFFER, tile->getName());
+                        capture->read(x, y, w, h);
+                    }
+                }
+
+                // 描画先と投影変換行列を戻す
+                glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection.data());
+                glBindFramebuffer(GL_FRAMEBUFFER, offscreen ? offscreen->getName() : 0);
+                glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            }
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            capture->end();
+        }
+
+        // 処理時間と画像を記録する
+        if (replayPath) {
+            log[frame].cpu = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+            if (hashing) {
+                if (offscreen) {
+                    offscreen->readPixels(pixels);
+                }
+                else {
+                    GLint viewport[4];
+                    glGetIntegerv(GL_VIEWPORT, viewport);
+                    pixels.resize(static_cast<std::size_t>(viewport[2]) * viewport[3] * 4);
+                    glReadBuffer(GL_BACK);
+                    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                    glReadPixels(0, 0, viewport[2], viewport[3], GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+                }
+                log[frame].hash = FrameLog::hash(pixels.data(), pixels.size());
+            }
+        }
+        ++frame;
+        current = next;
+
+        // 仕事の処理時間を集計する
+        jobs.takeTimings(timings);
+        profile.add(timings);
+        timings.clear();
+
         // カラーバッファを入れ替える
-        window.swapBuffers();
+        if (!offscreen) window.swapBuffers();
+
+        // 入力から表示までの遅れを測る (低遅延モードでは送り出したフレームが終わるまで次の入力を読まない)
+        if (probe) {
+            probe->swapped(planInput);
+            if (lowLatency) probe->limit(0);
+            else probe->collect();
+        }
+    }
+
+    // 先に始めた準備の終わりを待つ
+    jobs.wait(preparing);
+    jobs.takeTimings(timings);
+    profile.add(timings);
+    if (profileJobs) profile.print(std::cout, "jobs:");
+
+    if (recordPath) {
+        if (path.save(recordPath)) std::cout << "recorded " << path.size() << " frames to " << recordPath << std::endl;
+        else std::cerr << "Can't write " << recordPath << std::endl;
+    }
+
+    if (replayPath) {
+        if (gpuTimer) gpuTimer->collect(gpuTime, true);
+        const std::string csv(std::string(replayPath) + ".csv");
+        if (!log.save(csv.c_str())) std::cerr << "Can't write " << csv << std::endl;
+        log.print(std::cout, csv.c_str());
+    }
+
+    if (scaler) {
+        scaler->print(std::cout, static_cast<long>(frame));
+        GLState::get().deleteVertexArrays(1, &upscaleArray);
+        glDeleteProgram(upscaleProgram);
+    }
+
+    if (probe) {
+        probe->collect(true);
+        probe->print(std::cout, lowLatency ? "latency (low-latency mode)" : "latency");
+    }
+
+    if (capture) {
+        capture->finish();
+        const FrameCapture::Stats &stats(capture->getStats());
+        if (stats.frames > 0)
+            std::cout << "captured " << stats.frames << " frames of " << capture->getWidth() << "x" << capture->getHeight()
+            << " at " << stats.frames / stats.seconds << " fps, wait " << stats.waitSeconds / stats.frames * 1000.0
+            << " ms, write " << stats.writeSeconds / stats.frames * 1000.0 << " ms per frame, "
+            << (stats.bytes >> 20) << " MB" << std::endl;
+    }
+
+    if (scene && !scene->isComplete()) scene->print(std::cout);
+
+    if (sequence) sequence->print(std::cout);
+
+    if (meshShape) memory.print(std::cout, "memory at exit:");
+
+    // 状態の写しで省いた呼び出しの数
+    const char *const kinds[] = { "program", "vertex array", "buffer", "capability" };
+    for (int k = 0; k < GLState::kindCount; ++k) {
+        const GLState::Counters &c(GLState::get().getCounters(static_cast<GLState::Kind>(k)));
+        std::cout << kinds[k] << " binds: " << c.issued << " issued, " << c.elided << " elided" << std::endl;
+    }
+    if (GLState::get().getMismatches() > 0)
+        std::cout << GLState::get().getMismatches() << " GL state cache mismatches" << std::endl;
+
+    if (meshShape && uploadFrames > 0) {
+        const Object::UploadStats &total(meshShape->getObject().getTotalUploadStats());
+        std::cout << "uploaded " << total.bytes / uploadFrames / 1024.0 << " KB per frame in " << uploadFrames
+        << " frames, stall " << total.stallSeconds / uploadFrames * 1000.0 << " ms per frame (max "
+        << maxStall * 1000.0 << " ms), " << total.calls << " calls, " << total.orphans << " orphaned" << std::endl;
+    }
+
+    if (streamer) {
+        const ChunkStreamer::Stats &stats(streamer->getStats());
+        std::cout << "streamed " << (stats.totalUploaded >> 20) << " MB, "
+        << stats.evictions << " evictions" << std::endl;
+        if (stats.frames > 0 && stats.totalVisible > 0)
+            std::cout << "occlusion culled " << 100.0 * stats.totalOccluded / stats.totalVisible << "% of "
+            << stats.totalVisible / stats.frames << " blocks in the frustum per frame, "
+            << stats.totalOcclusionSeconds / stats.frames * 1000.0 << " ms per frame" << std::endl;
     }
 }
@@ -2,12 +2,19 @@
 uniform mat4 modelview;
 uniform mat4 projection;
 
+// 点の大きさ (点の間隔 × ビューポートの高さ / 2，点を描くときだけ使う)
+uniform float pointSize;
+
+// 辺の色 (メッシュに辺を重ねて描くときだけ設定し，a が 0 なら頂点の色を使う)
+uniform vec4 lineColor;
+
 //const vec4 Lpos = vec4(0.0, 0.0, 5.0, 1.0);
 //const vec3 Ldiff = vec3(1.0);
 //const vec3 Kdiff = vec3(0.6, 0.6, 0.2);
 
 in vec4 position;
 in vec4 color;
+in float occlusion;
 out vec4 vertex_color;
 
 //in vec3 normal;
@@ -17,11 +24,14 @@ out vec4 vertex_color;
 
 void main()
 {
-    vertex_color = color;
+    vertex_color = lineColor.a > 0.0 ? lineColor : vec4(color.rgb * occlusion, color.a);
 
 //    vec4 P = modelview * position;
 //    vec3 L = normalize((Lpos * P.w - P * Lpos.w).xyz);
 //    Idiff = max(dot(normal, L), 0.0) * Kdiff * Ldiff;
     
     gl_Position = projection * modelview * position;
+
+    // 点の間隔を画面上の大きさに直す
+    gl_PointSize = max(pointSize * projection[1][1] / gl_Position.w, 1.0);
 }
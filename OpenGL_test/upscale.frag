@@ -0,0 +1,12 @@
+#version 150 core
+
+// 縮小して描いた画像 (線形補間で拡大する)
+uniform sampler2D image;
+
+in vec2 texcoord;
+out vec4 fragment;
+
+void main()
+{
+    fragment = texture(image, texcoord);
+}
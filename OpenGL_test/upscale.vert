@@ -0,0 +1,11 @@
+#version 150 core
+
+// 縮小して描いた画像のテクスチャ座標
+out vec2 texcoord;
+
+void main()
+{
+    // 頂点番号から画面全体を覆う三角形を作る
+    texcoord = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(texcoord * 2.0 - 1.0, 0.0, 1.0);
+}